@@ -0,0 +1,118 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'SLAC PGP Gen3 Card'.
+// It is subject to the license terms in the LICENSE.txt file found in the
+// top-level directory of this distribution and at:
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+// No part of 'SLAC PGP Gen3 Card', including this file,
+// may be copied, modified, propagated, or distributed except according to
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <iomanip>
+#include <iostream>
+#include <string.h>
+#include <stdlib.h>
+
+#include "../include/PgpCardG3Mod.h"
+#include "../include/PgpCardG3Wrap.h"
+
+#define DEVNAME "/dev/PgpCardG3_0"
+
+using namespace std;
+
+// Polls RX completions directly from the card in bypass mode
+int main (int argc, char **argv) {
+   int                        s;
+   uint                       count;
+   uint                       frames;
+   uint                       idx;
+   uint                       descA;
+   uint                       descB;
+   uint                       *dma;
+   unsigned char              *pool;
+   PgpCardBufInfo             info;
+   volatile struct PgpCardReg *reg;
+
+   if ( argc > 1 ) frames = strtoul(argv[1],NULL,0);
+   else frames = 10;
+
+   if ( (s = open(DEVNAME, (O_RDWR|O_SYNC))) <= 0 ) {
+      cout << "Error opening file" << endl;
+      return(1);
+   }
+
+   if ( pgpcard_bypassEnable(s) != 0 ) {
+      cout << "Error enabling bypass mode" << endl;
+      close(s);
+      return(1);
+   }
+
+   // Map the registers
+   reg = (volatile struct PgpCardReg *)mmap(NULL, sizeof(struct PgpCardReg), (PROT_READ|PROT_WRITE), (MAP_SHARED|MAP_LOCKED), s, 0);
+   if ( reg == MAP_FAILED ) {
+      cout << "Error mapping registers" << endl;
+      pgpcard_bypassDisable(s);
+      close(s);
+      return(1);
+   }
+
+   // Build the bus address table and map the RX pool
+   memset(&info,0,sizeof(PgpCardBufInfo));
+   pgpcard_bufInfo(s,&info);
+   dma = (uint *)malloc(sizeof(uint)*info.count);
+   for (idx=0; idx < info.count; idx++) {
+      info.index = idx;
+      pgpcard_bufInfo(s,&info);
+      dma[idx] = info.dma;
+   }
+   pool = (unsigned char *)mmap(NULL, info.count * info.stride, PROT_READ, MAP_SHARED, s, PGP_MAP_RX_POOL);
+   if ( pool == MAP_FAILED ) {
+      cout << "Error mapping rx pool" << endl;
+      munmap((void *)reg, sizeof(struct PgpCardReg));
+      pgpcard_bypassDisable(s);
+      close(s);
+      return(1);
+   }
+
+   cout << "Polling " << dec << info.count << " rx buffers of " << info.size << " bytes" << endl;
+
+   count = 0;
+   while ( count < frames ) {
+
+      // Wait for a completion
+      if ( (reg->rxStatus & 0x80000000) == 0 ) continue;
+      descA = reg->rxRead[0];
+      descB = reg->rxRead[1];
+      if ( (descB & 0x1) == 0 ) continue;
+
+      for (idx=0; idx < info.count; idx++) if ( dma[idx] == (descB & 0xFFFFFFFC) ) break;
+      if ( idx == info.count ) {
+         cout << "Unknown rx descriptor 0x" << hex << setw(8) << setfill('0') << descB << endl;
+         continue;
+      }
+
+      cout << "Lane=" << dec << ((descA >> 26) & 0x7);
+      cout << ", Vc=" << dec << ((descA >> 24) & 0x3);
+      cout << ", Words=" << dec << (descA & 0x00FFFFFF);
+      cout << ", Eofe=" << dec << ((descA >> 30) & 0x1);
+      cout << ", FifoErr=" << dec << ((descA >> 31) & 0x1);
+      cout << ", Data[0]=0x" << hex << setw(8) << setfill('0') << *((uint *)(pool + idx * info.stride)) << endl;
+
+      // Give the buffer back to the card
+      reg->rxFree[(descA >> 26) & 0x7] = dma[idx];
+      count++;
+   }
+
+   munmap(pool, info.count * info.stride);
+   munmap((void *)reg, sizeof(struct PgpCardReg));
+   free(dma);
+   pgpcard_bypassDisable(s);
+   close(s);
+   return(0);
+}
+
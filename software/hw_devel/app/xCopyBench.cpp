@@ -0,0 +1,85 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'SLAC PGP Gen3 Card'.
+// It is subject to the license terms in the LICENSE.txt file found in the
+// top-level directory of this distribution and at:
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+// No part of 'SLAC PGP Gen3 Card', including this file,
+// may be copied, modified, propagated, or distributed except according to
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+
+#include <sys/types.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <iomanip>
+#include <iostream>
+#include <string.h>
+#include <stdlib.h>
+
+#include "../include/PgpCardG3Mod.h"
+#include "../include/PgpCardG3Wrap.h"
+
+#define DEVNAME "/dev/PgpCardG3_0"
+
+using namespace std;
+
+// Compares copy bandwidth out of consistent and streaming RX buffers
+// The pools are resized for each allocation and restored to the module defaults on exit.
+int main (int argc, char **argv) {
+   int          s;
+   uint         mode;
+   uint         size;
+   uint         loops;
+   PgpCardPool  pool;
+   PgpCardBench bench;
+   void         *data;
+   const char   *name[2] = {"consistent", "streaming "};
+
+   if ( argc > 1 ) size = strtoul(argv[1],NULL,0);
+   else size = 0x100000;
+   if ( argc > 2 ) loops = strtoul(argv[2],NULL,0);
+   else loops = 1000;
+
+   if ( (s = open(DEVNAME, O_RDWR)) <= 0 ) {
+      cout << "Error opening file" << endl;
+      return(1);
+   }
+
+   data = malloc(size);
+   memset(data,0,size);
+
+   for (mode=0; mode < 2; mode++) {
+      memset(&pool,0,sizeof(PgpCardPool));
+      pool.txCount     = 32;
+      pool.txSize      = 0x200000;
+      pool.rxCount     = 32;
+      pool.rxSize      = size;
+      pool.rxStreaming = mode;
+      if ( pgpcard_poolResize(s,&pool) != 0 ) {
+         cout << "Error allocating " << name[mode] << " pools" << endl;
+         continue;
+      }
+
+      memset(&bench,0,sizeof(PgpCardBench));
+      bench.data  = (unsigned long)data;
+      bench.size  = size;
+      bench.loops = loops;
+      if ( pgpcard_copyBench(s,&bench) != 0 || bench.nsec == 0 ) {
+         cout << "Error running " << name[mode] << " benchmark" << endl;
+         continue;
+      }
+
+      cout << name[mode] << ": " << dec << loops << " x " << size << " bytes in ";
+      cout << (bench.nsec / 1000) << " us, ";
+      cout << fixed << setprecision(1) << ((double)size * loops * 1000.0 / bench.nsec) << " MB/s" << endl;
+   }
+
+   pgpcard_poolRelease(s);
+   pgpcard_poolArm(s,NULL);
+
+   free(data);
+   close(s);
+   return(0);
+}
+
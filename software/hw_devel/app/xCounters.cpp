@@ -0,0 +1,82 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'SLAC PGP Gen3 Card'.
+// It is subject to the license terms in the LICENSE.txt file found in the
+// top-level directory of this distribution and at:
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+// No part of 'SLAC PGP Gen3 Card', including this file,
+// may be copied, modified, propagated, or distributed except according to
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+
+#include <sys/types.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <iomanip>
+#include <iostream>
+#include <string.h>
+#include <stdlib.h>
+
+#include "../include/PgpCardG3Mod.h"
+#include "../include/PgpCardG3Wrap.h"
+
+#define DEVNAME "/dev/PgpCardG3_0"
+
+using namespace std;
+
+// Starts counter sampling and prints per lane rates from the queued snapshots, one snapshot a second
+int main (int argc, char **argv) {
+   int              s;
+   uint             x;
+   uint             first;
+   double           secs;
+   PgpCardCntConfig cfg;
+   PgpCardCntSnap   snap;
+   PgpCardCntSnap   last;
+
+   memset(&cfg,0,sizeof(PgpCardCntConfig));
+   cfg.apply = PGP_CNT_START;
+   if ( argc > 1 ) cfg.period = strtoul(argv[1],NULL,0);
+   else cfg.period = 1000;
+   if ( cfg.period == 0 ) cfg.period = 1000;
+   cfg.snapEvery = 1000000 / cfg.period;
+
+   if ( (s = open(DEVNAME, O_RDWR)) <= 0 ) {
+      cout << "Error opening file" << endl;
+      return(1);
+   }
+
+   if ( pgpcard_cntConfig(s,&cfg) != 0 ) {
+      cout << "Error starting counter sampling" << endl;
+      close(s);
+      return(1);
+   }
+   cout << "Sampling every " << dec << cfg.period << " us" << endl;
+   cfg.apply = 0;
+
+   first = 1;
+   while (1) {
+      while ( pgpcard_cntSnapshot(s,&snap) == 0 ) {
+         if ( ! first ) {
+            secs = (double)(snap.time - last.time) / 1.0e9;
+            for (x=0; x < 8; x++) {
+               cout << "Lane " << dec << x << ": Rx=" << fixed << setprecision(1);
+               cout << ((snap.cnt.rxCount[x][0] + snap.cnt.rxCount[x][1] + snap.cnt.rxCount[x][2] + snap.cnt.rxCount[x][3]) -
+                        (last.cnt.rxCount[x][0] + last.cnt.rxCount[x][1] + last.cnt.rxCount[x][2] + last.cnt.rxCount[x][3])) / secs;
+               cout << " Hz, CellErr=" << (snap.cnt.cellErr[x] - last.cnt.cellErr[x]) / secs;
+               cout << " Hz, LinkErr=" << (snap.cnt.linkErr[x] - last.cnt.linkErr[x]) / secs;
+               cout << " Hz, LinkDown=" << dec << snap.cnt.linkDown[x] << endl;
+            }
+         }
+         last  = snap;
+         first = 0;
+      }
+      pgpcard_cntConfig(s,&cfg);
+      if ( cfg.late != 0 ) cout << "Late samples=" << dec << cfg.late << endl;
+      usleep(100000);
+   }
+
+   close(s);
+   return(0);
+}
+
@@ -0,0 +1,73 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'SLAC PGP Gen3 Card'.
+// It is subject to the license terms in the LICENSE.txt file found in the
+// top-level directory of this distribution and at:
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+// No part of 'SLAC PGP Gen3 Card', including this file,
+// may be copied, modified, propagated, or distributed except according to
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+
+#include <sys/types.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <iostream>
+#include <string.h>
+#include <stdlib.h>
+
+#include "../include/PgpCardG3Mod.h"
+#include "../include/PgpCardG3Wrap.h"
+
+#define DEVNAME "/dev/PgpCardG3_0"
+
+using namespace std;
+
+// Enables the link monitor and prints its events
+int main (int argc, char **argv) {
+   int              s;
+   uint             x;
+   PgpCardLinkMon   mon;
+   PgpCardLinkEvent event;
+   const char       *type[3] = {"Down", "Reset", "Up"};
+
+   memset(&mon,0,sizeof(PgpCardLinkMon));
+   if ( argc > 1 ) mon.laneMask = strtoul(argv[1],NULL,0);
+   else mon.laneMask = 0xFF;
+   if ( argc > 2 ) mon.downLimit = strtoul(argv[2],NULL,0);
+   else mon.downLimit = 100;
+   mon.period = 10;
+
+   if ( (s = open(DEVNAME, O_RDWR)) <= 0 ) {
+      cout << "Error opening file" << endl;
+      return(1);
+   }
+
+   if ( pgpcard_linkMonitor(s,&mon) != 0 ) {
+      cout << "Error enabling link monitor" << endl;
+      close(s);
+      return(1);
+   }
+
+   cout << "Monitoring lanes 0x" << hex << mon.laneMask;
+   cout << ", Down=0x" << hex << mon.linkDown << endl;
+   for (x=0; x < 8; x++) {
+      if ( ((mon.laneMask >> x) & 0x1) == 0 ) continue;
+      cout << "Lane " << dec << x << ": Resets=" << mon.resets[x];
+      cout << ", Recovered=" << mon.recovered[x];
+      cout << ", LastDown=" << mon.lastDown[x] << " ms" << endl;
+   }
+
+   while (1) {
+      while ( pgpcard_linkEvent(s,&event) == 0 ) {
+         cout << dec << event.time << " ms: Lane " << event.lane << " " << type[event.type % 3];
+         if ( event.type != PGP_LINK_DOWN ) cout << " after " << event.duration << " ms";
+         cout << ", DownCount=" << event.downCount << endl;
+      }
+      usleep(100000);
+   }
+
+   close(s);
+   return(0);
+}
+
@@ -0,0 +1,68 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'SLAC PGP Gen3 Card'.
+// It is subject to the license terms in the LICENSE.txt file found in the
+// top-level directory of this distribution and at:
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+// No part of 'SLAC PGP Gen3 Card', including this file,
+// may be copied, modified, propagated, or distributed except according to
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+
+#include <sys/types.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <iostream>
+#include <string.h>
+#include <stdlib.h>
+
+#include "../include/PgpCardG3Mod.h"
+#include "../include/PgpCardG3Wrap.h"
+
+#define DEVNAME "/dev/PgpCardG3_0"
+
+using namespace std;
+
+// Enables the link state watch and prints each change as soon as poll() reports POLLPRI
+int main (int argc, char **argv) {
+   int               s;
+   uint              period;
+   struct pollfd     pfd;
+   PgpCardStateEvent event;
+
+   if ( argc > 1 ) period = strtoul(argv[1],NULL,0);
+   else period = 1000;
+
+   if ( (s = open(DEVNAME, O_RDWR)) <= 0 ) {
+      cout << "Error opening file" << endl;
+      return(1);
+   }
+
+   if ( pgpcard_linkState(s,period) != 0 ) {
+      cout << "Error enabling link state watch" << endl;
+      close(s);
+      return(1);
+   }
+   cout << "Watching link state every " << dec << period << " us" << endl;
+
+   while (1) {
+      pfd.fd      = s;
+      pfd.events  = POLLPRI;
+      pfd.revents = 0;
+      if ( poll(&pfd,1,-1) < 0 ) break;
+      if ( (pfd.revents & POLLPRI) == 0 ) continue;
+
+      while ( pgpcard_linkStateEvent(s,&event) == 0 ) {
+         cout << dec << event.time << " ns: Seq=" << event.seq;
+         cout << ", LocLink=0x" << hex << event.locLink << " (0x" << event.locChanged << ")";
+         cout << ", RemLink=0x" << hex << event.remLink << " (0x" << event.remChanged << ")";
+         cout << ", EvrReady=" << dec << event.evrReady << (event.evrChanged ? " (changed)" : "") << endl;
+      }
+   }
+
+   pgpcard_linkState(s,0);
+   close(s);
+   return(0);
+}
+
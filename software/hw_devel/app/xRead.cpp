@@ -39,6 +39,12 @@ int main (int argc, char **argv) {
    uint          eofe;
    uint          fifoErr;
    uint          lengthErr;
+   uint          seq;
+   uint          gseq;
+   uint          next[32];
+   bool          seen[32];
+
+   memset(seen,0,sizeof(seen));
 
    if ( (s = open(DEVNAME, O_RDWR)) <= 0 ) {
       cout << "Error opening file" << endl;
@@ -51,7 +57,7 @@ int main (int argc, char **argv) {
 
    // DMA Read
    do {
-      ret = pgpcard_recv(s,data,maxSize,&lane,&vc,&eofe,&fifoErr,&lengthErr);
+      ret = pgpcard_recvSeq(s,data,maxSize,&lane,&vc,&eofe,&fifoErr,&lengthErr,&seq,&gseq);
 
       if ( ret != 0 ) {
 
@@ -61,6 +67,13 @@ int main (int argc, char **argv) {
          cout << ", Eofe=" << dec << eofe;
          cout << ", FifoErr=" << dec << fifoErr;
          cout << ", LengthErr=" << dec << lengthErr;
+         cout << ", Seq=" << dec << seq;
+         cout << ", GSeq=" << dec << gseq;
+
+         // Frames dropped by the driver leave a gap in the lane/VC sequence
+         if ( seen[lane*4+vc] && seq != next[lane*4+vc] ) cout << ", Gap=" << dec << (seq - next[lane*4+vc]);
+         seen[lane*4+vc] = true;
+         next[lane*4+vc] = seq + 1;
          cout << endl << "   ";
 #if PRINT_DATA
          int x;
@@ -0,0 +1,97 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'SLAC PGP Gen3 Card'.
+// It is subject to the license terms in the LICENSE.txt file found in the
+// top-level directory of this distribution and at:
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+// No part of 'SLAC PGP Gen3 Card', including this file,
+// may be copied, modified, propagated, or distributed except according to
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <sys/types.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <iostream>
+#include <string.h>
+#include <stdlib.h>
+
+#include "../include/PgpCardG3Mod.h"
+#include "../include/PgpCardG3Wrap.h"
+
+#define DEVNAME "/dev/PgpCardG3_0"
+
+using namespace std;
+
+// Records frames to a file through a pipe without copying them to user space
+// Each frame in the file is preceded by a PgpCardSpliceHdr
+int main (int argc, char **argv) {
+   int           s;
+   int           out;
+   int           pfd[2];
+   ssize_t       ret;
+   ssize_t       wr;
+   unsigned long total;
+   unsigned long maxBytes;
+
+   if ( argc < 2 ) {
+      cout << "Usage: xRecord file [bytes]" << endl;
+      return(1);
+   }
+   if ( argc > 2 ) maxBytes = strtoul(argv[2],NULL,0);
+   else maxBytes = 0x10000000;
+
+   if ( (s = open(DEVNAME, O_RDWR)) <= 0 ) {
+      cout << "Error opening file" << endl;
+      return(1);
+   }
+
+   if ( (out = open(argv[1], (O_WRONLY|O_CREAT|O_TRUNC), 0644)) < 0 ) {
+      cout << "Error opening " << argv[1] << endl;
+      close(s);
+      return(1);
+   }
+
+   if ( pipe(pfd) != 0 ) {
+      cout << "Error creating pipe" << endl;
+      close(out);
+      close(s);
+      return(1);
+   }
+
+   total = 0;
+   while ( total < maxBytes ) {
+
+      // Device to pipe
+      ret = splice(s, NULL, pfd[1], NULL, 0x100000, SPLICE_F_MOVE);
+      if ( ret <= 0 ) {
+         cout << "Splice from device failed. Ret=" << dec << ret << endl;
+         break;
+      }
+
+      // Pipe to file
+      while ( ret > 0 ) {
+         wr = splice(pfd[0], NULL, out, NULL, ret, SPLICE_F_MOVE);
+         if ( wr <= 0 ) {
+            cout << "Splice to file failed. Ret=" << dec << wr << endl;
+            ret = -1;
+            break;
+         }
+         ret   -= wr;
+         total += wr;
+      }
+      if ( ret < 0 ) break;
+   }
+
+   cout << "Recorded " << dec << total << " bytes" << endl;
+
+   close(pfd[0]);
+   close(pfd[1]);
+   close(out);
+   close(s);
+   return(0);
+}
+
@@ -0,0 +1,113 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'SLAC PGP Gen3 Card'.
+// It is subject to the license terms in the LICENSE.txt file found in the
+// top-level directory of this distribution and at:
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+// No part of 'SLAC PGP Gen3 Card', including this file,
+// may be copied, modified, propagated, or distributed except according to
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <iomanip>
+#include <iostream>
+#include <string.h>
+#include <stdlib.h>
+
+#include "../include/PgpCardG3Mod.h"
+#include "../include/PgpCardG3Wrap.h"
+
+#define DEVNAME "/dev/PgpCardG3_0"
+
+using namespace std;
+
+// Receives through the shared RX ring and prints the frame rate once a second
+// poll() is only called when the ring is empty.
+int main (int argc, char **argv) {
+   int                     s;
+   uint                    size;
+   uint                    tail;
+   uint                    frames;
+   uint                    errors;
+   unsigned long           bytes;
+   time_t                  last;
+   unsigned char           *map;
+   volatile PgpCardRingHdr *hdr;
+   PgpCardRingRec          *rec;
+   struct pollfd           pfd;
+
+   if ( argc > 1 ) size = strtoul(argv[1],NULL,0);
+   else size = 0x1000000;
+
+   if ( (s = open(DEVNAME, O_RDWR)) <= 0 ) {
+      cout << "Error opening file" << endl;
+      return(1);
+   }
+
+   if ( pgpcard_rxRing(s,&size) != 0 ) {
+      cout << "Error starting shared rx ring" << endl;
+      close(s);
+      return(1);
+   }
+
+   map = (unsigned char *)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, s, PGP_MAP_RX_RING);
+   if ( map == MAP_FAILED ) {
+      cout << "Error mapping shared rx ring" << endl;
+      close(s);
+      return(1);
+   }
+   hdr = (volatile PgpCardRingHdr *)map;
+   cout << "Ring size " << dec << hdr->size << " bytes" << endl;
+
+   pfd.fd     = s;
+   pfd.events = POLLIN;
+   frames     = 0;
+   errors     = 0;
+   bytes      = 0;
+   last       = time(NULL);
+   tail       = hdr->tail;
+
+   while (1) {
+
+      // Wait only when the ring is empty
+      if ( tail == hdr->head ) {
+         poll(&pfd,1,1000);
+      }
+      else {
+         __sync_synchronize();
+         rec = (PgpCardRingRec *)(map + hdr->dataOff + tail);
+         if ( rec->pgpLane != PGP_RING_WRAP ) {
+            frames++;
+            bytes += rec->dataSize * 4;
+            if ( rec->eofe || rec->fifoErr || rec->lengthErr ) errors++;
+         }
+         tail += rec->recSize;
+         if ( tail >= hdr->size || rec->pgpLane == PGP_RING_WRAP ) tail = 0;
+
+         // Record is consumed before its space is handed back
+         __sync_synchronize();
+         hdr->tail = tail;
+      }
+
+      if ( time(NULL) != last ) {
+         last = time(NULL);
+         cout << "Frames=" << dec << frames << ", Errors=" << errors;
+         cout << ", Rate=" << fixed << setprecision(1) << ((double)bytes / 1.0e6) << " MB/s";
+         cout << ", Full=" << hdr->full << endl;
+         frames = 0;
+         errors = 0;
+         bytes  = 0;
+      }
+   }
+
+   munmap(map,size);
+   close(s);
+   return(0);
+}
+
@@ -32,6 +32,9 @@ using namespace std;
 
 int main (int argc, char **argv) {
    PgpCardStatus status;
+   PgpCardDrvStatus drvStatus;
+   PgpCardCntConfig cntConfig;
+   PgpCardCntSnap   cntSnap;
    int           s;
    int           ret;
    int           x;
@@ -248,6 +251,85 @@ int main (int argc, char **argv) {
    cout << endl;
 #endif 
 
+   memset(&drvStatus,0,sizeof(PgpCardDrvStatus));
+   pgpcard_drvStatus(s, &drvStatus);
+
+   cout << "Read PGP Driver Status:" << endl << endl;
+   cout << "        RxFilter: 0x" << hex << setw(8) << setfill('0') << drvStatus.rxFilter << endl;
+   for(x=0;x<8;x++){
+      cout << "RxFiltered[" << dec << x << "][3:0]: ";
+      for(y=0;y<4;y++){
+         cout << dec << drvStatus.rxFiltered[x*4+3-y];
+         if(y!=3) cout << ", "; else cout << endl;
+      }
+   }
+   cout << "       RxErrMode: " << dec << drvStatus.rxErrMode << endl;
+   cout << "  RxErrors[7:0]: ";
+   for(x=0;x<8;x++){
+      cout << dec << drvStatus.rxErrors[7-x];
+      if(x!=7) cout << ", "; else cout << endl;
+   }
+   cout << "RxErrDropped[7:0]: ";
+   for(x=0;x<8;x++){
+      cout << dec << drvStatus.rxErrDropped[7-x];
+      if(x!=7) cout << ", "; else cout << endl;
+   }
+   cout << "     RxGroupMask: 0x" << hex << setw(8) << setfill('0') << drvStatus.rxGroupMask << endl;
+   for(x=0;x<PGP_GROUP_MAX;x++){
+      if ( drvStatus.rxGroup[x] == 0 ) continue;
+      cout << "     RxGroup[" << dec << x << "]: Mask=0x" << hex << setw(8) << setfill('0') << drvStatus.rxGroup[x];
+      cout << ", Frames=" << dec << drvStatus.rxGroupFrames[x] << endl;
+   }
+   cout << "      RxPrioMask: 0x" << hex << setw(8) << setfill('0') << drvStatus.rxPrioMask << endl;
+   cout << "    RxPrioFrames: " << dec << drvStatus.rxPrioFrames << endl;
+   cout << "        TxReaped: " << dec << drvStatus.txReaped << endl;
+   cout << "     RxPauseMask: 0x" << hex << setw(2) << setfill('0') << drvStatus.rxPauseMask;
+   cout << ", Auto=0x" << hex << setw(2) << setfill('0') << drvStatus.rxPauseAuto;
+   cout << ", HighWater=" << dec << drvStatus.rxHighWater << endl;
+   cout << " RxLaneHeld[7:0]: ";
+   for(x=0;x<8;x++){
+      cout << dec << drvStatus.rxLaneHeld[7-x];
+      if(x!=7) cout << ", "; else cout << endl;
+   }
+   cout << "   RxPauses[7:0]: ";
+   for(x=0;x<8;x++){
+      cout << dec << drvStatus.rxPauses[7-x];
+      if(x!=7) cout << ", "; else cout << endl;
+   }
+   cout << "      RxRingSize: " << dec << drvStatus.rxRingSize;
+   cout << ", Frames=" << drvStatus.rxRingFrames;
+   cout << ", Full=" << drvStatus.rxRingFull << endl;
+   for(x=0;x<8;x++){
+      cout << "RxSeqDrops[" << dec << x << "][3:0]: ";
+      for(y=0;y<4;y++){
+         cout << dec << drvStatus.rxSeqDrops[x*4+3-y];
+         if(y!=3) cout << ", "; else cout << endl;
+      }
+   }
+   cout << endl;
+
+   // Extended counters are only meaningful while the driver samples them
+   memset(&cntConfig,0,sizeof(PgpCardCntConfig));
+   if ( pgpcard_cntConfig(s, &cntConfig) == 0 && cntConfig.running && pgpcard_cntRead(s, &cntSnap) == 0 ) {
+      cout << "Read PGP Extended Counters:" << endl << endl;
+      cout << "         Samples: " << dec << cntConfig.samples << ", Late=" << cntConfig.late;
+      cout << ", Period=" << cntConfig.period << " us" << endl;
+      for(x=0;x<8;x++){
+         cout << "       Lane[" << dec << 7-x << "]: RxCount[3:0]=";
+         for(y=0;y<4;y++){
+            cout << cntSnap.cnt.rxCount[7-x][3-y];
+            if(y!=3) cout << ", ";
+         }
+         cout << ", CellErr=" << cntSnap.cnt.cellErr[7-x];
+         cout << ", LinkDown=" << cntSnap.cnt.linkDown[7-x];
+         cout << ", LinkErr=" << cntSnap.cnt.linkErr[7-x];
+         cout << ", FifoErr=" << cntSnap.cnt.fifoErr[7-x] << endl;
+      }
+      cout << "           RxDma: " << dec << cntSnap.cnt.rxDma << endl;
+      cout << "           TxDma: " << dec << cntSnap.cnt.txDma << endl;
+      cout << endl;
+   }
+
    pgpcard_dumpDebug(s);
 
    cout << "Clearing debug level" << endl;
@@ -0,0 +1,78 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'SLAC PGP Gen3 Card'.
+// It is subject to the license terms in the LICENSE.txt file found in the
+// top-level directory of this distribution and at:
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+// No part of 'SLAC PGP Gen3 Card', including this file,
+// may be copied, modified, propagated, or distributed except according to
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+
+#include <sys/types.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <iomanip>
+#include <iostream>
+#include <string.h>
+#include <stdlib.h>
+
+#include "../include/PgpCardG3Mod.h"
+#include "../include/PgpCardG3Wrap.h"
+
+#define DEVNAME "/dev/PgpCardG3_0"
+
+using namespace std;
+
+// Runs the driver trigger generator and prints the achieved rate and jitter once a second
+int main (int argc, char **argv) {
+   int            s;
+   uint           x;
+   uint           secs;
+   double         rate;
+   PgpCardTrigger trig;
+
+   if ( argc < 3 ) {
+      cout << "Usage: xTrigger rate_hz seconds [opcode ...]" << endl;
+      return(1);
+   }
+   rate = strtod(argv[1],NULL);
+   secs = strtoul(argv[2],NULL,0);
+   if ( rate <= 0 ) {
+      cout << "Invalid rate" << endl;
+      return(1);
+   }
+
+   memset(&trig,0,sizeof(PgpCardTrigger));
+   trig.apply  = PGP_TRIG_START;
+   trig.period = (uint)(1.0e9 / rate);
+   for (x=3; x < (uint)argc && trig.codeCnt < PGP_TRIG_CODES; x++) trig.opCode[trig.codeCnt++] = strtoul(argv[x],NULL,0);
+   if ( trig.codeCnt == 0 ) trig.opCode[trig.codeCnt++] = 0;
+
+   if ( (s = open(DEVNAME, O_RDWR)) <= 0 ) {
+      cout << "Error opening file" << endl;
+      return(1);
+   }
+
+   if ( pgpcard_trigGen(s,&trig) != 0 ) {
+      cout << "Error starting trigger generator" << endl;
+      close(s);
+      return(1);
+   }
+
+   for (x=0; x < secs; x++) {
+      sleep(1);
+      trig.apply = 0;
+      pgpcard_trigGen(s,&trig);
+      cout << "Sent=" << dec << trig.sent << ", Missed=" << trig.missed;
+      if ( trig.elapsed > 0 ) cout << ", Rate=" << fixed << setprecision(3) << ((double)trig.sent * 1.0e9 / trig.elapsed) << " Hz";
+      cout << ", LateAvg=" << dec << trig.lateAvg << " ns, LateMax=" << trig.lateMax << " ns" << endl;
+   }
+
+   trig.apply = PGP_TRIG_STOP;
+   pgpcard_trigGen(s,&trig);
+
+   close(s);
+   return(0);
+}
+
@@ -0,0 +1,71 @@
+//////////////////////////////////////////////////////////////////////////////
+// This file is part of 'SLAC PGP Gen3 Card'.
+// It is subject to the license terms in the LICENSE.txt file found in the
+// top-level directory of this distribution and at:
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+// No part of 'SLAC PGP Gen3 Card', including this file,
+// may be copied, modified, propagated, or distributed except according to
+// the terms contained in the LICENSE.txt file.
+//////////////////////////////////////////////////////////////////////////////
+
+#include <sys/types.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <iostream>
+#include <string.h>
+#include <stdlib.h>
+
+#include "../include/PgpCardG3Mod.h"
+#include "../include/PgpCardG3Wrap.h"
+
+#define DEVNAME "/dev/PgpCardG3_0"
+
+using namespace std;
+
+// Enables the DMA watchdog and prints the per lane report once a second
+// Pass "reclaim" as the only argument to take back stuck buffers once.
+int main (int argc, char **argv) {
+   int             s;
+   uint            x;
+   PgpCardWatchdog dog;
+
+   memset(&dog,0,sizeof(PgpCardWatchdog));
+   if ( argc > 1 && strcmp(argv[1],"reclaim") == 0 ) dog.apply = PGP_DOG_RECLAIM;
+   else {
+      dog.apply       = PGP_DOG_SET;
+      dog.period      = 100;
+      dog.txAge       = (argc > 1) ? strtoul(argv[1],NULL,0) : 1000;
+      dog.rxAge       = (argc > 2) ? strtoul(argv[2],NULL,0) : 1000;
+      dog.autoReclaim = (argc > 3) ? strtoul(argv[3],NULL,0) : 0;
+   }
+
+   if ( (s = open(DEVNAME, O_RDWR)) <= 0 ) {
+      cout << "Error opening file" << endl;
+      return(1);
+   }
+
+   if ( pgpcard_dmaWatchdog(s,&dog) != 0 ) {
+      cout << "Error configuring watchdog" << endl;
+      close(s);
+      return(1);
+   }
+
+   while (1) {
+      cout << "Period=" << dec << dog.period << " ms, TxAge=" << dog.txAge << " ms, RxAge=" << dog.rxAge;
+      cout << " ms, Auto=" << dog.autoReclaim << ", Reclaims=" << dog.reclaims << ", LateDone=" << dog.lateDone << endl;
+      for (x=0; x < 8; x++) {
+         cout << "Lane " << dec << x << ": TxStuck=" << dog.txStuck[x] << ", TxOldest=" << dog.txOldest[x] << " ms";
+         cout << ", RxLost=" << dog.rxLost[x] << ", TxReclaimed=" << dog.txReclaimed[x];
+         cout << ", RxReclaimed=" << dog.rxReclaimed[x] << endl;
+      }
+      if ( dog.apply == PGP_DOG_RECLAIM ) break;
+      sleep(1);
+      dog.apply = 0;
+      pgpcard_dmaWatchdog(s,&dog);
+   }
+
+   close(s);
+   return(0);
+}
+
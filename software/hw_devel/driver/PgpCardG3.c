@@ -40,23 +40,76 @@ module_exit(PgpCard_Exit);
 // Global Variable
 struct PgpDevice gPgpDevices[MAX_PCI_DEVICES];
 
+// Default pool sizing, used when pools are allocated at open or armed without a configuration
+static uint cfgTxCount = DEF_TX_BUF_CNT;
+static uint cfgTxSize  = DEF_TX_BUF_SIZE;
+static uint cfgRxCount = DEF_RX_BUF_CNT;
+static uint cfgRxSize  = DEF_RX_BUF_SIZE;
+module_param(cfgTxCount,uint,0644);
+module_param(cfgTxSize,uint,0644);
+module_param(cfgRxCount,uint,0644);
+module_param(cfgRxSize,uint,0644);
+MODULE_PARM_DESC(cfgTxCount,"Default number of TX buffers");
+MODULE_PARM_DESC(cfgTxSize,"Default TX buffer size in bytes");
+MODULE_PARM_DESC(cfgRxCount,"Default number of RX buffers");
+MODULE_PARM_DESC(cfgRxSize,"Default RX buffer size in bytes");
+
+// Pool allocation policy
+static uint cfgArmOnOpen   = 1;
+static uint cfgFreeOnClose = 0;
+module_param(cfgArmOnOpen,uint,0644);
+module_param(cfgFreeOnClose,uint,0644);
+MODULE_PARM_DESC(cfgArmOnOpen,"Allocate DMA pools on open, otherwise IOCTL_Pool_Arm is required");
+MODULE_PARM_DESC(cfgFreeOnClose,"Default for releasing DMA pools on close");
+
+// RX buffers use cached memory with streaming mappings instead of consistent memory
+static uint cfgRxStreaming = 0;
+module_param(cfgRxStreaming,uint,0644);
+MODULE_PARM_DESC(cfgRxStreaming,"Default for allocating RX buffers with streaming DMA mappings");
+
 
 // Open Returns 0 on success, error code on failure
 int PgpCard_Open(struct inode *inode, struct file *filp) {
    struct PgpDevice *pgpDevice;
+   struct PgpFile   *pgpFile;
+   int res;
 
    // Extract structure for card
    pgpDevice = container_of(inode->i_cdev, struct PgpDevice, cdev);
-   filp->private_data = pgpDevice;
 
-   // File is already open
-   if ( pgpDevice->isOpen != 0 ) {
-      printk(KERN_WARNING"%s: Open: module open failed. Device is already open. Maj=%i\n",MOD_NAME,pgpDevice->major);
-      return ERROR;
-   } else {
-      pgpDevice->isOpen = 1;
-      return SUCCESS;
+   // Per file state, the file accepts every lane and VC until it sets a filter
+   if ( (pgpFile = (struct PgpFile *)kzalloc(sizeof(struct PgpFile),GFP_KERNEL)) == NULL ) {
+      printk(KERN_WARNING"%s: Open: could not allocate file state. Maj=%i\n",MOD_NAME,pgpDevice->major);
+      return -ENOMEM;
+   }
+   pgpFile->pgpDevice = pgpDevice;
+   pgpFile->rxFilter  = 0xFFFFFFFF;
+   pgpFile->rxErrMode = PGP_RX_ERR_DELIVER;
+   filp->private_data = pgpFile;
+
+   // Allocate pools on first use, later opens share the card and may join a consumer group
+   down_write(&(pgpDevice->poolSem));
+
+   // Bypass belongs to a single file
+   if ( pgpDevice->bypassOwner != NULL ) {
+      up_write(&(pgpDevice->poolSem));
+      kfree(pgpFile);
+      printk(KERN_WARNING"%s: Open: device is in bypass mode. Maj=%i\n",MOD_NAME,pgpDevice->major);
+      return -EBUSY;
    }
+   if ( cfgArmOnOpen ) {
+      res = PgpCard_PoolAlloc(pgpDevice,NULL);
+      if ( res != SUCCESS ) {
+         up_write(&(pgpDevice->poolSem));
+         kfree(pgpFile);
+         return res;
+      }
+   }
+   list_add_tail(&(pgpFile->list),&(pgpDevice->files));
+   pgpDevice->isOpen++;
+   PgpCard_FileMasks(pgpDevice);
+   up_write(&(pgpDevice->poolSem));
+   return SUCCESS;
 }
 
 
@@ -64,16 +117,53 @@ int PgpCard_Open(struct inode *inode, struct file *filp) {
 // Called when the device is closed
 // Returns 0 on success, error code on failure
 int PgpCard_Release(struct inode *inode, struct file *filp) {
-   struct PgpDevice *pgpDevice = (struct PgpDevice *)filp->private_data;
+   struct PgpFile   *pgpFile   = (struct PgpFile *)filp->private_data;
+   struct PgpDevice *pgpDevice = pgpFile->pgpDevice;
+
+   // Closing and the last close teardown are one step, an open can not slip in between
+   down_write(&(pgpDevice->poolSem));
 
    // File is not open
    if ( pgpDevice->isOpen == 0 ) {
+      up_write(&(pgpDevice->poolSem));
       printk(KERN_WARNING"%s: Release: module close failed. Device is not open. Maj=%i\n",MOD_NAME,pgpDevice->major);
       return ERROR;
-   } else {
-      pgpDevice->isOpen = 0;
-      return SUCCESS;
    }
+
+   // Frames queued for this file go back to the card
+   PgpCard_GroupLeave(pgpDevice,filp);
+
+   // The bypass owner hands the card back, if the fifos do not drain the next opener may retry
+   if ( pgpDevice->bypassOwner == filp ) {
+      PgpCard_BypassExit(pgpDevice);
+      pgpDevice->bypassOwner = NULL;
+   }
+
+   // Card state derived from the open files no longer includes this one
+   PgpCard_StateWatch(pgpDevice,pgpFile,0);
+   list_del(&(pgpFile->list));
+   pgpDevice->isOpen--;
+   PgpCard_FileMasks(pgpDevice);
+
+   // Remaining state is torn down when the last file closes
+   if ( pgpDevice->isOpen == 0 ) {
+
+      // Stop the shared RX ring, it can no longer be mapped
+      if ( pgpDevice->rxRing != NULL ) PgpCard_RingSetup(pgpDevice,0);
+
+      // Take the card back from user space
+      if ( pgpDevice->bypass ) PgpCard_BypassExit(pgpDevice);
+
+      // Go back to driver RX buffers
+      if ( pgpDevice->rxUserCnt ) PgpCard_RxUnregister(pgpDevice);
+
+      // Release pools on last close, they are kept if the card still owns TX buffers
+      if ( pgpDevice->freeOnClose ) PgpCard_PoolRelease(pgpDevice);
+   }
+   up_write(&(pgpDevice->poolSem));
+
+   kfree(pgpFile);
+   return SUCCESS;
 }
 
 
@@ -81,15 +171,22 @@ int PgpCard_Release(struct inode *inode, struct file *filp) {
 // Called when the device is written to
 // Returns write count on success. Error code on failure.
 ssize_t PgpCard_Write(struct file *filp, const char* buffer, size_t count, loff_t* f_pos) {
-   __u32       descA;
-   __u32       descB;
+   unsigned long flags;
+   struct TxBuffer *txBuffer;
    PgpCardTx*  pgpCardTx;
    PgpCardTx   myPgpCardTx;
    __u32        buf[count / sizeof(__u32)];
    __u32       theRightWriteSize = sizeof(PgpCardTx);
    __u32       largeMemoryModel;
+   __u32       zeroCopy;
+   __u32       zcFull;
+   __u32       gather;
+   __u32       iovCnt;
+   __u32       x;
+   __u32       offset;
+   PgpCardIov  iov[PGP_IOV_MAX];
 
-   struct PgpDevice* pgpDevice = (struct PgpDevice *)filp->private_data;
+   struct PgpDevice* pgpDevice = ((struct PgpFile *)filp->private_data)->pgpDevice;
 
    // Copy command structure from user space
    if ( copy_from_user(buf, buffer, count) ) {
@@ -118,6 +215,10 @@ ssize_t PgpCard_Write(struct file *filp, const char* buffer, size_t count, loff_
 
    switch (pgpCardTx->cmd) {
      case IOCTL_Normal_Write :
+     case IOCTL_ZeroCopy_Write :
+     case IOCTL_Gather_Write :
+       zeroCopy = (pgpCardTx->cmd == IOCTL_ZeroCopy_Write);
+       gather   = (pgpCardTx->cmd == IOCTL_Gather_Write);
        if (count != theRightWriteSize) {
          printk(KERN_WARNING "%s: Write(%u) passed size is not expected(%u) size(%u). Maj=%i\n",
                     MOD_NAME,
@@ -125,59 +226,150 @@ ssize_t PgpCard_Write(struct file *filp, const char* buffer, size_t count, loff_
                     (unsigned)sizeof(PgpCardTx),
                     (unsigned)count, pgpDevice->major);
        }
-       if ( (pgpCardTx->size*4) > pgpDevice->txBuffSize ) {
+       if ( pgpCardTx->pgpLane > 7 ) {
+         printk(KERN_WARNING "%s: Write: Invalid pgpCardTx->pgpLane: %i. Maj=%i\n", MOD_NAME, pgpCardTx->pgpLane, pgpDevice->major);
+         return(ERROR);
+       }
+
+       // Gather list, size is the entry count, frame size is the sum of the entries
+       if ( gather ) {
+         iovCnt = pgpCardTx->size;
+         if ( iovCnt == 0 || iovCnt > PGP_IOV_MAX ) {
+           printk(KERN_WARNING "%s: Write: Invalid gather count: %i. Maj=%i\n", MOD_NAME, iovCnt, pgpDevice->major);
+           return(ERROR);
+         }
+         if ( copy_from_user(iov,pgpCardTx->data,iovCnt*sizeof(PgpCardIov)) ) {
+           printk(KERN_WARNING "%s: Write: failed to copy gather list from user(%p) space. Maj=%i\n",
+               MOD_NAME, pgpCardTx->data, pgpDevice->major);
+           return(ERROR);
+         }
+         offset = 0;
+         for (x=0; x < iovCnt; x++) {
+           if ( iov[x].size > MAX_BUF_SIZE ) return(ERROR);
+           offset += iov[x].size;
+         }
+         if ( (offset & 0x3) != 0 || offset > MAX_BUF_SIZE ) {
+           printk(KERN_WARNING "%s: Write: gather length %i is not a dword multiple. Maj=%i\n", MOD_NAME, offset, pgpDevice->major);
+           return(ERROR);
+         }
+         pgpCardTx->size = offset / 4;
+       }
+
+       down_read(&(pgpDevice->poolSem));
+       if ( ! pgpDevice->poolReady ) {
+         up_read(&(pgpDevice->poolSem));
+         printk(KERN_WARNING"%s: Write: DMA pools are not allocated. Maj=%i\n",MOD_NAME,pgpDevice->major);
+         return(ERROR);
+       }
+       if ( pgpDevice->bypass ) {
+         up_read(&(pgpDevice->poolSem));
+         return(-EBUSY);
+       }
+       if ( (pgpCardTx->size*4) > (zeroCopy ? MAX_BUF_SIZE : pgpDevice->txBuffSize) ) {
+         up_read(&(pgpDevice->poolSem));
          printk(KERN_WARNING"%s: Write: passed size is too large for TX buffer. Maj=%i\n",MOD_NAME,pgpDevice->major);
          return(ERROR);
        }
 
-       // No buffers are available
-       while ( pgpDevice->txRead == pgpDevice->txWrite ) {
-         if ( filp->f_flags & O_NONBLOCK ) return(-EAGAIN);
+       // Zero copy, the user pages are sent in place, the address is reported through IOCTL_ZeroCopy_Done
+       if ( zeroCopy ) {
+         while ( (txBuffer = PgpCard_TxZcAcquire(pgpDevice,pgpCardTx->pgpLane,&zcFull)) == NULL ) {
+           if ( PgpCard_TxReap(pgpDevice) > 0 ) continue;
+           if ( zcFull ) {
+             up_read(&(pgpDevice->poolSem));
+             return(-ENOSPC);
+           }
+           up_read(&(pgpDevice->poolSem));
+           if ( filp->f_flags & O_NONBLOCK ) return(-EAGAIN);
+           if (wait_event_interruptible(pgpDevice->outq,PgpCard_TxZcAvail(pgpDevice,pgpCardTx->pgpLane))) return (-ERESTARTSYS);
+           down_read(&(pgpDevice->poolSem));
+           if ( ! pgpDevice->poolReady || pgpDevice->bypass ) {
+             up_read(&(pgpDevice->poolSem));
+             return(ERROR);
+           }
+         }
+         if ( PgpCard_TxZcMap(pgpDevice,txBuffer,pgpCardTx) == SUCCESS ) {
+           PgpCard_TxPost(pgpDevice,txBuffer);
+           up_read(&(pgpDevice->poolSem));
+           return(pgpCardTx->size);
+         }
+
+         // Pages are not usable by the card, copy instead and complete at once
+         spin_lock_irqsave(&(pgpDevice->txLock),flags);
+         PgpCard_TxZcCancel(pgpDevice,txBuffer);
+         if ( (pgpCardTx->size*4) > pgpDevice->txBuffSize ) pgpDevice->txZcUsed--;
+         spin_unlock_irqrestore(&(pgpDevice->txLock),flags);
+         if ( (pgpCardTx->size*4) > pgpDevice->txBuffSize ) {
+           up_read(&(pgpDevice->poolSem));
+           printk(KERN_WARNING"%s: Write: zero copy frame is not contiguous and too large for TX buffer. Maj=%i\n",MOD_NAME,pgpDevice->major);
+           return(ERROR);
+         }
+       }
+
+       // No buffers are available or lane is at its quota, collect completions before sleeping
+       while ( (txBuffer = PgpCard_TxAcquire(pgpDevice,pgpCardTx->pgpLane)) == NULL ) {
+         if ( PgpCard_TxReap(pgpDevice) > 0 ) continue;
+         up_read(&(pgpDevice->poolSem));
+         if ( filp->f_flags & O_NONBLOCK ) {
+           if ( zeroCopy ) PgpCard_TxZcUnreserve(pgpDevice);
+           return(-EAGAIN);
+         }
          if ( pgpDevice->debug > 2 ) printk(KERN_DEBUG"%s: Write: going to sleep. Maj=%i\n",MOD_NAME,pgpDevice->major);
-         if (wait_event_interruptible(pgpDevice->outq,(pgpDevice->txRead != pgpDevice->txWrite))) return (-ERESTARTSYS);
+         if (wait_event_interruptible(pgpDevice->outq,PgpCard_TxAvail(pgpDevice,(1 << pgpCardTx->pgpLane)))) {
+           if ( zeroCopy ) PgpCard_TxZcUnreserve(pgpDevice);
+           return (-ERESTARTSYS);
+         }
          if ( pgpDevice->debug > 2 ) printk(KERN_DEBUG"%s: Write: woke up. Maj=%i\n",MOD_NAME,pgpDevice->major);
+         down_read(&(pgpDevice->poolSem));
+         if ( ! pgpDevice->poolReady || pgpDevice->bypass ) {
+           up_read(&(pgpDevice->poolSem));
+           if ( zeroCopy ) PgpCard_TxZcUnreserve(pgpDevice);
+           return(ERROR);
+         }
        }
 
-       // Copy data from user space
-       if ( copy_from_user(pgpDevice->txQueue[pgpDevice->txRead]->buffer,pgpCardTx->data,(pgpCardTx->size*4)) ) {
+       // Copy data from user space, gather lists are copied in one pass
+       if ( gather ) {
+         for (x=0, offset=0; x < iovCnt; x++) {
+           if ( copy_from_user(txBuffer->buffer+offset,(void __user *)(unsigned long)iov[x].data,iov[x].size) ) break;
+           offset += iov[x].size;
+         }
+       }
+       if ( gather ? (x < iovCnt) : copy_from_user(txBuffer->buffer,pgpCardTx->data,(pgpCardTx->size*4)) ) {
          printk(KERN_WARNING "%s: Write: failed to copy from user(%p) space. Maj=%i\n",
              MOD_NAME,
              pgpCardTx->data,
              pgpDevice->major);
+         spin_lock_irqsave(&(pgpDevice->txLock),flags);
+         PgpCard_TxRelease(pgpDevice,txBuffer);
+         if ( zeroCopy ) pgpDevice->txZcUsed--;
+         spin_unlock_irqrestore(&(pgpDevice->txLock),flags);
+         up_read(&(pgpDevice->poolSem));
          return ERROR;
        }
 
        // Fields for tracking purpose
-       pgpDevice->txQueue[pgpDevice->txRead]->lane   = pgpCardTx->pgpLane;
-       pgpDevice->txQueue[pgpDevice->txRead]->vc     = pgpCardTx->pgpVc;
-       pgpDevice->txQueue[pgpDevice->txRead]->length = pgpCardTx->size;
-
-       // Generate Tx descriptor
-       descA  = (pgpCardTx->pgpLane << 27) & 0xF8000000; // Bits 31:27 = Lane
-       descA += (pgpCardTx->pgpVc   << 24) & 0x07000000; // Bits 26:24 = VC
-       descA += (pgpCardTx->size         ) & 0x00FFFFFF; // Bits 23:00 = Length
-       descB = pgpDevice->txQueue[pgpDevice->txRead]->dma;
-      
+       txBuffer->vc     = pgpCardTx->pgpVc;
+       txBuffer->length = pgpCardTx->size;
+
        // Debug
        if ( pgpDevice->debug > 1 ) {
          printk(KERN_DEBUG"%s: Write: Words=%i, Lane=%i, VC=%i, Addr=%p, Map=%p. Maj=%d\n",
              MOD_NAME, pgpCardTx->size, pgpCardTx->pgpLane, pgpCardTx->pgpVc,
-             (pgpDevice->txQueue[pgpDevice->txRead]->buffer), (void*)(pgpDevice->txQueue[pgpDevice->txRead]->dma),
+             (txBuffer->buffer), (void*)(txBuffer->dma),
              pgpDevice->major);
        }
 
-       // Write descriptor
-       if(pgpCardTx->pgpLane < 8) {
-         iowrite32(descA,&(pgpDevice->reg->txWrA[pgpCardTx->pgpLane]));
-         asm("nop");
-         iowrite32(descB,&(pgpDevice->reg->txWrB[pgpCardTx->pgpLane]));
-         asm("nop");          
-       } else {
-         printk(KERN_DEBUG "%s: Write: Invalid pgpCardTx->pgpLane: %i\n", MOD_NAME, pgpCardTx->pgpLane);
-       }
+       // Queue for the lane, descriptor is written when the scheduler selects it
+       PgpCard_TxPost(pgpDevice,txBuffer);
 
-       // Increment read pointer
-       pgpDevice->txRead = (pgpDevice->txRead + 1) % (pgpDevice->txBuffCnt+2);
+       // Copied zero copy frame, user buffer is free already
+       if ( zeroCopy ) {
+         spin_lock_irqsave(&(pgpDevice->txLock),flags);
+         PgpCard_TxZcDone(pgpDevice,(unsigned long)pgpCardTx->data);
+         spin_unlock_irqrestore(&(pgpDevice->txLock),flags);
+       }
+       up_read(&(pgpDevice->poolSem));
        return(pgpCardTx->size);
        break;
      default :
@@ -200,8 +392,15 @@ ssize_t PgpCard_Read(struct file *filp, char *buffer, size_t count, loff_t *f_po
    __u32       maxSize;
    __u32       copyLength;
    __u32       largeMemoryModel;
+   __u32       frameError;
+   __u32       drop;
+   __u32       prio = 0;
+   unsigned long flags;
+   struct RxBuffer  *rxBuffer;
+   struct PgpReader *reader;
 
-   struct PgpDevice *pgpDevice = (struct PgpDevice *)filp->private_data;
+   struct PgpFile   *pgpFile   = (struct PgpFile *)filp->private_data;
+   struct PgpDevice *pgpDevice = pgpFile->pgpDevice;
 
    // Copy command structure from user space
    if ( copy_from_user(buf, buffer, count) ) {
@@ -217,7 +416,7 @@ ssize_t PgpCard_Read(struct file *filp, char *buffer, size_t count, loff_t *f_po
    // Verify that size of passed structure and get variables from the correct structure.
    if ( !largeMemoryModel ) {
      // small memory model
-     if ( count != sizeof(PgpCardRx32) ) {
+     if ( count != sizeof(PgpCardRx32) && count != RX32_SIZE_NOSEQ ) {
        printk(KERN_WARNING"%s: Read: passed size is not expected(%u) size(%u). Maj=%i\n",MOD_NAME, (unsigned)sizeof(PgpCardRx32), (unsigned)count, pgpDevice->major);
        return(ERROR);
      } else {
@@ -226,7 +425,7 @@ ssize_t PgpCard_Read(struct file *filp, char *buffer, size_t count, loff_t *f_po
      }
    } else {
      // large memory model
-     if ( count != sizeof(PgpCardRx) ) {
+     if ( count != sizeof(PgpCardRx) && count != RX_SIZE_NOSEQ ) {
        printk(KERN_WARNING"%s: Read: passed size is not expected(%u) size(%u). Maj=%i\n",MOD_NAME, (unsigned)sizeof(PgpCardRx), (unsigned)count, pgpDevice->major);
        return(ERROR);
      } else {
@@ -235,36 +434,85 @@ ssize_t PgpCard_Read(struct file *filp, char *buffer, size_t count, loff_t *f_po
      }
    }
 
-   // No data is ready
-   while ( pgpDevice->rxRead == pgpDevice->rxWrite ) {
+   down_read(&(pgpDevice->poolSem));
+   if ( ! pgpDevice->poolReady ) {
+      up_read(&(pgpDevice->poolSem));
+      printk(KERN_WARNING"%s: Read: DMA pools are not allocated. Maj=%i\n",MOD_NAME,pgpDevice->major);
+      return(ERROR);
+   }
+   if ( pgpDevice->bypass || pgpDevice->rxUserCnt ||
+        (pgpDevice->rxRing != NULL && ! PgpCard_GroupMember(pgpDevice,filp)) ) {
+      up_read(&(pgpDevice->poolSem));
+      return(-EBUSY);
+   }
+
+   // Wait for a frame, consumer group members take frames from their own queue
+next:
+   while (1) {
+      spin_lock_irqsave(&(pgpDevice->rxLock),flags);
+      if ( (reader = PgpCard_GroupFind(pgpDevice,filp)) != NULL ) rxBuffer = PgpCard_GroupPop(pgpDevice,reader,filp);
+      spin_unlock_irqrestore(&(pgpDevice->rxLock),flags);
+      if ( reader != NULL ) {
+         if ( rxBuffer != NULL ) break;
+      }
+      else if ( PgpCard_RxDepth(pgpDevice) > 0 ) {
+         mutex_lock(&(pgpDevice->rxReadLock));
+         if ( (rxBuffer = PgpCard_RxHead(pgpDevice,&prio)) != NULL ) break;
+         mutex_unlock(&(pgpDevice->rxReadLock));
+      }
+      up_read(&(pgpDevice->poolSem));
       if ( filp->f_flags & O_NONBLOCK ) return(-EAGAIN);
       if ( pgpDevice->debug > 2 ) printk(KERN_DEBUG"%s: Read: going to sleep. Maj=%i\n",MOD_NAME,pgpDevice->major);
-      if (wait_event_interruptible(pgpDevice->inq,(pgpDevice->rxRead != pgpDevice->rxWrite))) return (-ERESTARTSYS);
+      if (wait_event_interruptible(pgpDevice->inq,PgpCard_RxReady(pgpDevice,filp))) return (-ERESTARTSYS);
       if ( pgpDevice->debug > 2 ) printk(KERN_DEBUG"%s: Read: woke up. Maj=%i\n",MOD_NAME,pgpDevice->major);
+      down_read(&(pgpDevice->poolSem));
+   }
+
+   // Head frame is partly spliced into a pipe
+   if ( reader == NULL && pgpDevice->rxSpliceOff != 0 ) {
+      mutex_unlock(&(pgpDevice->rxReadLock));
+      up_read(&(pgpDevice->poolSem));
+      return(-EBUSY);
+   }
+
+   // Errored frame this file does not want, it goes back to the card
+   spin_lock_irqsave(&(pgpDevice->rxLock),flags);
+   drop = PgpCard_RxErrDrop(pgpDevice,rxBuffer,pgpFile->rxErrMode);
+   spin_unlock_irqrestore(&(pgpDevice->rxLock),flags);
+   if ( drop ) {
+      if ( reader == NULL ) {
+         PgpCard_RxPop(pgpDevice,prio);
+         mutex_unlock(&(pgpDevice->rxReadLock));
+      }
+      goto next;
    }
 
-   // Report frame error
-   if (pgpDevice->rxQueue[pgpDevice->rxRead]->eofe |
-       pgpDevice->rxQueue[pgpDevice->rxRead]->fifoError |
-       pgpDevice->rxQueue[pgpDevice->rxRead]->lengthError) {
+   // Report frame error, rate limited so that a bad link does not slow healthy lanes
+   frameError = (rxBuffer->eofe |
+                 rxBuffer->fifoError |
+                 rxBuffer->lengthError);
+   if ( frameError && printk_ratelimit() ) {
      printk(KERN_WARNING "%s: Read: error encountered  eofe(%u), fifoError(%u), lengthError(%u)\n",
          MOD_NAME,
-         pgpDevice->rxQueue[pgpDevice->rxRead]->eofe,
-         pgpDevice->rxQueue[pgpDevice->rxRead]->fifoError,
-         pgpDevice->rxQueue[pgpDevice->rxRead]->lengthError);
+         rxBuffer->eofe,
+         rxBuffer->fifoError,
+         rxBuffer->lengthError);
    }
 
+   // Metadata only for errored frames
+   if ( frameError && pgpFile->rxErrMode == PGP_RX_ERR_META ) copyLength = 0;
+
    // User buffer is short
-   if ( maxSize < pgpDevice->rxQueue[pgpDevice->rxRead]->length ) {
+   else if ( maxSize < rxBuffer->length ) {
       printk(KERN_WARNING"%s: Read: user buffer is too small. Rx=%i, User=%i. Maj=%i\n",
-         MOD_NAME, pgpDevice->rxQueue[pgpDevice->rxRead]->length, maxSize, pgpDevice->major);
+         MOD_NAME, rxBuffer->length, maxSize, pgpDevice->major);
       copyLength = maxSize;
-      pgpDevice->rxQueue[pgpDevice->rxRead]->lengthError |= 1;
+      rxBuffer->lengthError |= 1;
    }
-   else copyLength = pgpDevice->rxQueue[pgpDevice->rxRead]->length;
+   else copyLength = rxBuffer->length;
 
    // Copy to user
-   if ( copy_to_user(dp, pgpDevice->rxQueue[pgpDevice->rxRead]->buffer, copyLength*4) ) {
+   if ( copyLength > 0 && copy_to_user(dp, rxBuffer->buffer, copyLength*4) ) {
       printk(KERN_WARNING"%s: Read: failed to copy to user. Maj=%i\n",MOD_NAME,pgpDevice->major);
       ret = ERROR;
    }
@@ -272,30 +520,38 @@ ssize_t PgpCard_Read(struct file *filp, char *buffer, size_t count, loff_t *f_po
 
    // Copy associated data
    if (largeMemoryModel) {
-     p64->rxSize    = pgpDevice->rxQueue[pgpDevice->rxRead]->length;
-     p64->eofe      = pgpDevice->rxQueue[pgpDevice->rxRead]->eofe;
-     p64->fifoErr   = pgpDevice->rxQueue[pgpDevice->rxRead]->fifoError;
-     p64->lengthErr = pgpDevice->rxQueue[pgpDevice->rxRead]->lengthError;
-     p64->pgpLane   = pgpDevice->rxQueue[pgpDevice->rxRead]->lane;
-     p64->pgpVc     = pgpDevice->rxQueue[pgpDevice->rxRead]->vc;
+     p64->rxSize    = rxBuffer->length;
+     p64->eofe      = rxBuffer->eofe;
+     p64->fifoErr   = rxBuffer->fifoError;
+     p64->lengthErr = rxBuffer->lengthError;
+     p64->pgpLane   = rxBuffer->lane;
+     p64->pgpVc     = rxBuffer->vc;
+     if ( count == sizeof(PgpCardRx) ) {
+       p64->seq  = rxBuffer->seq;
+       p64->gseq = rxBuffer->gseq;
+     }
      if ( pgpDevice->debug > 1 ) {
        printk(KERN_DEBUG"%s: Read: Words=%i, Lane=%i, VC=%i, Eofe=%i, FifoErr=%i, LengthErr=%i, Addr=%p, Map=%p, Maj=%i\n",
            MOD_NAME, p64->rxSize, p64->pgpLane, p64->pgpVc, p64->eofe,
-           p64->fifoErr, p64->lengthErr, (pgpDevice->rxQueue[pgpDevice->rxRead]->buffer),
-           (void*)(pgpDevice->rxQueue[pgpDevice->rxRead]->dma),(unsigned)pgpDevice->major);
+           p64->fifoErr, p64->lengthErr, (rxBuffer->buffer),
+           (void*)(rxBuffer->dma),(unsigned)pgpDevice->major);
      }
    } else {
-     p32->rxSize    = pgpDevice->rxQueue[pgpDevice->rxRead]->length;
-     p32->eofe      = pgpDevice->rxQueue[pgpDevice->rxRead]->eofe;
-     p32->fifoErr   = pgpDevice->rxQueue[pgpDevice->rxRead]->fifoError;
-     p32->lengthErr = pgpDevice->rxQueue[pgpDevice->rxRead]->lengthError;
-     p32->pgpLane   = pgpDevice->rxQueue[pgpDevice->rxRead]->lane;
-     p32->pgpVc     = pgpDevice->rxQueue[pgpDevice->rxRead]->vc;
+     p32->rxSize    = rxBuffer->length;
+     p32->eofe      = rxBuffer->eofe;
+     p32->fifoErr   = rxBuffer->fifoError;
+     p32->lengthErr = rxBuffer->lengthError;
+     p32->pgpLane   = rxBuffer->lane;
+     p32->pgpVc     = rxBuffer->vc;
+     if ( count == sizeof(PgpCardRx32) ) {
+       p32->seq  = rxBuffer->seq;
+       p32->gseq = rxBuffer->gseq;
+     }
      if ( pgpDevice->debug > 1 ) {
        printk(KERN_DEBUG"%s: Read: Words=%i, Lane=%i, VC=%i, Eofe=%i, FifoErr=%i, LengthErr=%i, Addr=%p, Map=%p, Maj=%i\n",
            MOD_NAME, p32->rxSize, p32->pgpLane, p32->pgpVc, p32->eofe,
-           p32->fifoErr, p32->lengthErr, (pgpDevice->rxQueue[pgpDevice->rxRead]->buffer),
-           (void*)(pgpDevice->rxQueue[pgpDevice->rxRead]->dma),(unsigned)pgpDevice->major);
+           p32->fifoErr, p32->lengthErr, (rxBuffer->buffer),
+           (void*)(rxBuffer->dma),(unsigned)pgpDevice->major);
      }
    }
 
@@ -305,19 +561,31 @@ ssize_t PgpCard_Read(struct file *filp, char *buffer, size_t count, loff_t *f_po
          MOD_NAME,
          buffer,
          pgpDevice->major);
+     if ( reader != NULL ) {
+        spin_lock_irqsave(&(pgpDevice->rxLock),flags);
+        PgpCard_RxReturn(pgpDevice,rxBuffer);
+        spin_unlock_irqrestore(&(pgpDevice->rxLock),flags);
+     }
+     else mutex_unlock(&(pgpDevice->rxReadLock));
+     up_read(&(pgpDevice->poolSem));
      return ERROR;
    }
 
-   // Return entry to RX queue
-   iowrite32(pgpDevice->rxQueue[pgpDevice->rxRead]->dma,&(pgpDevice->reg->rxFree[pgpDevice->rxQueue[pgpDevice->rxRead]->lane]));
-   asm("nop");
+   // Return entry to RX queue, returns are grouped to batch the register writes
+   spin_lock_irqsave(&(pgpDevice->rxLock),flags);
+   PgpCard_RxReturn(pgpDevice,rxBuffer);
+   spin_unlock_irqrestore(&(pgpDevice->rxLock),flags);
 
-   if ( pgpDevice->debug > 1 ) printk(KERN_DEBUG"%s: Read: Added buffer %.8x to RX queue. Maj=%i\n",
-      MOD_NAME,(__u32)(pgpDevice->rxQueue[pgpDevice->rxRead]->dma),pgpDevice->major);
+   if ( pgpDevice->debug > 1 ) printk(KERN_DEBUG"%s: Read: Queued buffer %.8x for return to RX queue. Maj=%i\n",
+      MOD_NAME,(__u32)(rxBuffer->dma),pgpDevice->major);
 
    // Increment read pointer
-   pgpDevice->rxRead = (pgpDevice->rxRead + 1) % (pgpDevice->rxBuffCnt+2);
+   if ( reader == NULL ) {
+      PgpCard_RxPop(pgpDevice,prio);
+      mutex_unlock(&(pgpDevice->rxReadLock));
+   }
 
+   up_read(&(pgpDevice->poolSem));
    return(ret);
 }
 
@@ -331,17 +599,24 @@ int PgpCard_Ioctl(struct inode *inode, struct file *filp, __u32 cmd, unsigned lo
 }
 
 int my_Ioctl(struct file *filp, __u32 cmd, __u64 argument) {
-   PgpCardStatus  status;
-   PgpCardStatus *stat = &status;
+   PgpCardStatus *stat;
    __u32          tmp;
    __u32          mask;
    __u32          x, y;
    __u32          found;
    __u32          bcnt;
    __u32          read;
+   unsigned long  flags;
+   PgpCardDrvStatus *drvStatus;
+   PgpCardCntSnap *cntSnap;
+   __u32          next;
+   __u32          ringSize;
+   __u64          userAddr;
+   int            ret;
    __u32          arg = argument & 0xffffffffLL;
 
-   struct PgpDevice *pgpDevice = (struct PgpDevice *)filp->private_data;
+   struct PgpFile   *pgpFile   = (struct PgpFile *)filp->private_data;
+   struct PgpDevice *pgpDevice = pgpFile->pgpDevice;
    if (pgpDevice->debug > 1) printk(KERN_DEBUG "%s: entering my_Ioctl, arg(%llu)\n", MOD_NAME, argument);
 
    // Determine command
@@ -350,6 +625,7 @@ int my_Ioctl(struct file *filp, __u32 cmd, __u64 argument) {
       // Status read
       case IOCTL_Read_Status:
         if (pgpDevice->debug > 0) printk(KERN_DEBUG "%s IOCTL_ReadStatus\n", MOD_NAME);
+         if ( (stat = (PgpCardStatus *)kmalloc(sizeof(PgpCardStatus),GFP_KERNEL)) == NULL ) return(-ENOMEM);
 
          // Write scratchpad
          pgpDevice->reg->scratch = SPAD_WRITE;
@@ -475,7 +751,9 @@ int my_Ioctl(struct file *filp, __u32 cmd, __u64 argument) {
          }           
 
          // Copy to user
-         if ((read = copy_to_user((__u32*)argument, stat, sizeof(PgpCardStatus)))) {
+         read = copy_to_user((__u32*)argument, stat, sizeof(PgpCardStatus));
+         kfree(stat);
+         if ( read ) {
             printk(KERN_WARNING "%s: Read Status: failed to copy %u to user. Maj=%i\n",
                 MOD_NAME,
                 read,
@@ -495,15 +773,37 @@ int my_Ioctl(struct file *filp, __u32 cmd, __u64 argument) {
          
       // Count Reset
       case IOCTL_Count_Reset:         
+         spin_lock_irqsave(&(pgpDevice->regLock),flags);
          pgpDevice->reg->cardRstStat |= 0x1;//set the reset counter bit
          pgpDevice->reg->cardRstStat &= 0xFFFFFFFE;//clear the reset counter bit
+         memset(&(pgpDevice->cnt),0,sizeof(PgpCardCounters));
+         pgpDevice->cntSamples  = 0;
+         pgpDevice->cntLate     = 0;
+         pgpDevice->cntSnapRead = pgpDevice->cntSnapWrite;
+         PgpCard_CntSync(pgpDevice);
+         spin_unlock_irqrestore(&(pgpDevice->regLock),flags);
+         memset(pgpDevice->rxFiltered,0,sizeof(pgpDevice->rxFiltered));
+         memset(pgpDevice->rxErrors,0,sizeof(pgpDevice->rxErrors));
+         memset(pgpDevice->rxErrDropped,0,sizeof(pgpDevice->rxErrDropped));
+         pgpDevice->rxPrioFrames = 0;
+         pgpDevice->txReaped     = 0;
+         memset(pgpDevice->dogTxReclaimed,0,sizeof(pgpDevice->dogTxReclaimed));
+         memset(pgpDevice->dogRxReclaimed,0,sizeof(pgpDevice->dogRxReclaimed));
+         pgpDevice->dogReclaims  = 0;
+         pgpDevice->dogLateDone  = 0;
+         memset(pgpDevice->rxPauses,0,sizeof(pgpDevice->rxPauses));
+         pgpDevice->rxRingFrames = 0;
+         pgpDevice->rxRingFull   = 0;
+         memset(pgpDevice->rxSeqDrops,0,sizeof(pgpDevice->rxSeqDrops));
          if (pgpDevice->debug > 0) printk(KERN_DEBUG "%s: Count reset\n", MOD_NAME);
          return(SUCCESS);
          break;         
 
       // Set Loopback
       case IOCTL_Set_Loop:
-         pgpDevice->reg->pgpCardStat[0] |= (0x1 << ((arg&0x7) + 0));         
+         spin_lock_irqsave(&(pgpDevice->regLock),flags);
+         pgpDevice->reg->pgpCardStat[0] |= (0x1 << ((arg&0x7) + 0));
+         spin_unlock_irqrestore(&(pgpDevice->regLock),flags);
          if (pgpDevice->debug > 0) printk(KERN_DEBUG "%s: Set loopback for %u\n", MOD_NAME, arg);
          return(SUCCESS);
          break;
@@ -511,14 +811,18 @@ int my_Ioctl(struct file *filp, __u32 cmd, __u64 argument) {
       // Clr Loopback
       case IOCTL_Clr_Loop:
          mask = 0xFFFFFFFF ^ (0x1 << ((arg&0x7) + 0));  
+         spin_lock_irqsave(&(pgpDevice->regLock),flags);
          pgpDevice->reg->pgpCardStat[0] &= mask;
+         spin_unlock_irqrestore(&(pgpDevice->regLock),flags);
          if (pgpDevice->debug > 0) printk(KERN_DEBUG "%s: Clr loopback for %u\n", MOD_NAME, arg);
          return(SUCCESS);
          break;
 
       // Set RX reset
       case IOCTL_Set_Rx_Reset:
-         pgpDevice->reg->pgpCardStat[0] |= (0x1 << ((arg&0x7) + 8));    
+         spin_lock_irqsave(&(pgpDevice->regLock),flags);
+         pgpDevice->reg->pgpCardStat[0] |= (0x1 << ((arg&0x7) + 8));
+         spin_unlock_irqrestore(&(pgpDevice->regLock),flags);
          if (pgpDevice->debug > 0) printk(KERN_DEBUG "%s: Rx reset set for %u\n", MOD_NAME, arg);
          return(SUCCESS);
          break;
@@ -526,14 +830,18 @@ int my_Ioctl(struct file *filp, __u32 cmd, __u64 argument) {
       // Clr RX reset
       case IOCTL_Clr_Rx_Reset:
          mask = 0xFFFFFFFF ^ (0x1 << ((arg&0x7) + 8)); 
+         spin_lock_irqsave(&(pgpDevice->regLock),flags);
          pgpDevice->reg->pgpCardStat[0] &= mask;
+         spin_unlock_irqrestore(&(pgpDevice->regLock),flags);
          if (pgpDevice->debug > 0) printk(KERN_DEBUG "%s: Rx reset clr for %u\n", MOD_NAME, arg);
          return(SUCCESS);
          break;
 
       // Set TX reset
       case IOCTL_Set_Tx_Reset:
-         pgpDevice->reg->pgpCardStat[0] |= (0x1 << ((arg&0x7) + 16)); 
+         spin_lock_irqsave(&(pgpDevice->regLock),flags);
+         pgpDevice->reg->pgpCardStat[0] |= (0x1 << ((arg&0x7) + 16));
+         spin_unlock_irqrestore(&(pgpDevice->regLock),flags);
          if (pgpDevice->debug > 0) printk(KERN_DEBUG "%s: Tx reset set for %u\n", MOD_NAME, arg);
         return(SUCCESS);
          break;
@@ -541,49 +849,63 @@ int my_Ioctl(struct file *filp, __u32 cmd, __u64 argument) {
       // Clr TX reset
       case IOCTL_Clr_Tx_Reset:
          mask = 0xFFFFFFFF ^ (0x1 << ((arg&0x7) + 16)); 
+         spin_lock_irqsave(&(pgpDevice->regLock),flags);
          pgpDevice->reg->pgpCardStat[0] &= mask;
+         spin_unlock_irqrestore(&(pgpDevice->regLock),flags);
          if (pgpDevice->debug > 0) printk(KERN_DEBUG "%s: Tx reset clr for %u\n", MOD_NAME, arg);
          return(SUCCESS);
          break;        
          
       // Enable EVR
       case IOCTL_Evr_Enable:
-         pgpDevice->reg->evrCardStat[1] |= 0x1;  
+         spin_lock_irqsave(&(pgpDevice->regLock),flags);
+         pgpDevice->reg->evrCardStat[1] |= 0x1;
+         spin_unlock_irqrestore(&(pgpDevice->regLock),flags);
          if (pgpDevice->debug > 0) printk(KERN_DEBUG "%s: Enable EVR\n", MOD_NAME);
          return(SUCCESS);
          break;
 
       // Disable EVR
       case IOCTL_Evr_Disable:
-         pgpDevice->reg->evrCardStat[1] &= 0xFFFFFFFE;  
+         spin_lock_irqsave(&(pgpDevice->regLock),flags);
+         pgpDevice->reg->evrCardStat[1] &= 0xFFFFFFFE;
+         spin_unlock_irqrestore(&(pgpDevice->regLock),flags);
          if (pgpDevice->debug > 0) printk(KERN_DEBUG "%s: Disable EVR\n", MOD_NAME);
          return(SUCCESS);
          break;  
 
       // Set Reset EVR
       case IOCTL_Evr_Set_Reset:
-         pgpDevice->reg->evrCardStat[1] |= 0x2;  
+         spin_lock_irqsave(&(pgpDevice->regLock),flags);
+         pgpDevice->reg->evrCardStat[1] |= 0x2;
+         spin_unlock_irqrestore(&(pgpDevice->regLock),flags);
          if (pgpDevice->debug > 0) printk(KERN_DEBUG "%s: Set Reset EVR\n", MOD_NAME);
          return(SUCCESS);
          break;
 
       // Clear Reset EVR
       case IOCTL_Evr_Clr_Reset:
-         pgpDevice->reg->evrCardStat[1] &= 0xFFFFFFFD;  
+         spin_lock_irqsave(&(pgpDevice->regLock),flags);
+         pgpDevice->reg->evrCardStat[1] &= 0xFFFFFFFD;
+         spin_unlock_irqrestore(&(pgpDevice->regLock),flags);
          if (pgpDevice->debug > 0) printk(KERN_DEBUG "%s: Clear Reset EVR\n", MOD_NAME);
          return(SUCCESS);
          break; 
 
       // Set PLL Reset EVR
       case IOCTL_Evr_Set_PLL_RST:
-         pgpDevice->reg->evrCardStat[1] |= 0x4;  
+         spin_lock_irqsave(&(pgpDevice->regLock),flags);
+         pgpDevice->reg->evrCardStat[1] |= 0x4;
+         spin_unlock_irqrestore(&(pgpDevice->regLock),flags);
          if (pgpDevice->debug > 0) printk(KERN_DEBUG "%s: Set Reset EVR\n", MOD_NAME);
          return(SUCCESS);
          break;
 
       // Clear PLL Reset EVR
       case IOCTL_Evr_Clr_PLL_RST:
-         pgpDevice->reg->evrCardStat[1] &= 0xFFFFFFFB;  
+         spin_lock_irqsave(&(pgpDevice->regLock),flags);
+         pgpDevice->reg->evrCardStat[1] &= 0xFFFFFFFB;
+         spin_unlock_irqrestore(&(pgpDevice->regLock),flags);
          if (pgpDevice->debug > 0) printk(KERN_DEBUG "%s: Clear Reset EVR\n", MOD_NAME);
          return(SUCCESS);
          break;          
@@ -819,168 +1141,3345 @@ int my_Ioctl(struct file *filp, __u32 cmd, __u64 argument) {
          return(SUCCESS);
          break;           
          
-      // No Operation
-      case IOCTL_NOP:
-         asm("nop");//no operation function
-         printk(KERN_WARNING "%s: NOP to %u\n", MOD_NAME, arg);
+      // Set TX per lane buffer quota
+      case IOCTL_Tx_Lane_Quota:
+         if ( arg == 0 || arg > pgpDevice->txBuffCnt ) {
+            printk(KERN_WARNING "%s: Invalid TX lane quota %u, buffers=%u. Maj=%i\n", MOD_NAME, arg, pgpDevice->txBuffCnt, pgpDevice->major);
+            return(ERROR);
+         }
+         pgpDevice->txLaneQuota = arg;
+         wake_up_interruptible(&(pgpDevice->outq));
+         if (pgpDevice->debug > 0) printk(KERN_DEBUG "%s: Set TX lane quota to %u\n", MOD_NAME, arg);
          return(SUCCESS);
-         break;          
-         
-      // Set Debug
-      case IOCTL_Set_Debug:
-         pgpDevice->debug = arg;
-         printk(KERN_WARNING "%s: debug set to %u\n", MOD_NAME, arg);
+         break;
+
+      // Set TX scheduler weight for a lane
+      case IOCTL_Tx_Lane_Weight:
+         if ( (arg >> 8) == 0 || (arg >> 8) > MAX_TX_LANE_WEIGHT ) {
+            printk(KERN_WARNING "%s: Invalid TX lane weight %u. Maj=%i\n", MOD_NAME, arg >> 8, pgpDevice->major);
+            return(ERROR);
+         }
+         pgpDevice->txLaneWeight[arg&0x7] = (arg >> 8);
+         if (pgpDevice->debug > 0) printk(KERN_DEBUG "%s: Set TX lane weight for %u to %u\n", MOD_NAME, arg&0x7, arg>>8);
          return(SUCCESS);
-         break;         
+         break;
 
-      // Dump Debug
-      case IOCTL_Dump_Debug:
+      // Set TX hardware fifo threshold
+      case IOCTL_Tx_Fifo_Thresh:
+         spin_lock_irqsave(&(pgpDevice->txLock),flags);
+         pgpDevice->txFifoThresh = arg;
+         PgpCard_TxSchedule(pgpDevice);
+         spin_unlock_irqrestore(&(pgpDevice->txLock),flags);
+         if (pgpDevice->debug > 0) printk(KERN_DEBUG "%s: Set TX fifo threshold to %u\n", MOD_NAME, arg);
+         return(SUCCESS);
+         break;
 
-        if (pgpDevice->debug > 0) {
-          printk(KERN_DEBUG "%s IOCTL_Dump_Debug\n", MOD_NAME);
+      // Set TX lanes considered by poll
+      case IOCTL_Tx_Poll_Mask:
+         pgpDevice->txPollMask = arg & 0xFF;
+         if (pgpDevice->debug > 0) printk(KERN_DEBUG "%s: Set TX poll mask to 0x%x\n", MOD_NAME, arg);
+         return(SUCCESS);
+         break;
 
-          // Rx Buffers
-          if ( pgpDevice->rxRead > pgpDevice->rxWrite )
-            bcnt = (__u32)((int)(pgpDevice->rxWrite - pgpDevice->rxRead) + pgpDevice->rxBuffCnt + 2);
-          else bcnt = (pgpDevice->rxWrite - pgpDevice->rxRead);
-          printk(KERN_DEBUG"%s: Ioctl: Rx Queue contains %i out of %i buffers. Maj=%i.\n",MOD_NAME,bcnt,pgpDevice->rxBuffCnt,pgpDevice->major);
+      // Set lane/VC receive filter
+      case IOCTL_Rx_Filter:
+         down_write(&(pgpDevice->poolSem));
+         pgpFile->rxFilter = arg;
+         PgpCard_FileMasks(pgpDevice);
+         up_write(&(pgpDevice->poolSem));
+         if (pgpDevice->debug > 0) printk(KERN_DEBUG "%s: Set RX filter mask to 0x%.8x, card accepts 0x%.8x\n", MOD_NAME, arg, pgpDevice->rxFilter);
+         return(SUCCESS);
+         break;
 
-         // Rx Fifo 
-         bcnt = 0;
-         for (x=0; x < 8; x++) { 
-            // Get the register
-            tmp = pgpDevice->reg->rxFreeStat[x];
-            // Check for FWFT valid
-            if( ((tmp >> 30) & 0x1) == 0x1) bcnt++;
-            // Check the FIFO fill count
-            bcnt += ((tmp >> 0) & 0x3FF);       
-         }           
-         printk(KERN_DEBUG"%s: Ioctl: Rx Fifo contains %i out of %i buffers. Maj=%i.\n",MOD_NAME,bcnt,pgpDevice->rxBuffCnt,pgpDevice->major);
+      // Set lane/VC strict priority mask, frames already queued keep their place
+      case IOCTL_Rx_Priority:
+         pgpDevice->rxPrioMask = arg;
+         if (pgpDevice->debug > 0) printk(KERN_DEBUG "%s: Set RX priority mask to 0x%.8x\n", MOD_NAME, arg);
+         return(SUCCESS);
+         break;
 
-          // Tx Buffers
-          if ( pgpDevice->txRead > pgpDevice->txWrite )
-            bcnt = (__u32)((int)(pgpDevice->txWrite - pgpDevice->txRead) + pgpDevice->txBuffCnt + 2);
-          else bcnt = (pgpDevice->txWrite - pgpDevice->txRead);
-          printk(KERN_DEBUG"%s: Ioctl: Tx Queue contains %i out of %i buffers. Maj=%i.\n",MOD_NAME,bcnt,pgpDevice->txBuffCnt,pgpDevice->major);
+      // Copy metadata and leading words of the head frame without consuming it
+      case IOCTL_Rx_Peek: {
+         PgpCardPeek    peek;
 
-          // Attempt to find missing tx buffers
-          for (x=0; x < pgpDevice->txBuffCnt; x++) {
-            found = 0;
-            read  = pgpDevice->txRead;
-            for (y=0; y < bcnt && read != pgpDevice->txWrite; y++) {
-              if ( pgpDevice->txQueue[read] == pgpDevice->txBuffer[x] ) {
-                found = 1;
-                break;
-              }
-              read = (read+1)%(pgpDevice->txBuffCnt+2);
-            }
-            if ( ! found ) 
-              printk(KERN_DEBUG"%s: Ioctl: Tx Buffer %p is missing! Lane=%i, Vc=%i, Length=%i, Maj=%i\n",MOD_NAME,
-                  pgpDevice->txBuffer[x]->buffer, pgpDevice->txBuffer[x]->lane, pgpDevice->txBuffer[x]->vc,
-                  pgpDevice->txBuffer[x]->length, pgpDevice->major);
-            else
-              printk(KERN_DEBUG"%s: Ioctl: Tx Buffer %p found. Maj=%i\n",MOD_NAME,pgpDevice->txBuffer[x]->buffer,pgpDevice->major);
-          }
+         if ( copy_from_user(&peek,(void __user *)argument,sizeof(PgpCardPeek)) ) {
+            printk(KERN_WARNING "%s: Rx Peek: failed to copy peek request from user. Maj=%i\n", MOD_NAME, pgpDevice->major);
+            return ERROR;
+         }
+         down_read(&(pgpDevice->poolSem));
+         mutex_lock(&(pgpDevice->rxReadLock));
+         ret = PgpCard_RxPeek(pgpDevice,&peek);
+         mutex_unlock(&(pgpDevice->rxReadLock));
+         up_read(&(pgpDevice->poolSem));
+         if ( ret != SUCCESS ) return(ret);
+         if ( copy_to_user((void __user *)argument,&peek,sizeof(PgpCardPeek)) ) {
+            printk(KERN_WARNING "%s: Rx Peek: failed to copy peek result to user. Maj=%i\n", MOD_NAME, pgpDevice->major);
+            return ERROR;
+         }
+         return(SUCCESS);
+         break;
+      }
 
-          // Queue dump
-          read  = pgpDevice->txRead;
-          for (y=0; y < bcnt && read != pgpDevice->txWrite; y++) {
-            printk(KERN_DEBUG"%s: Ioctl: Tx Queue Entry %p. Maj=%i\n",MOD_NAME, pgpDevice->txQueue[y]->buffer,pgpDevice->major);
-            read = (read+1)%(pgpDevice->txBuffCnt+2);
-          }
-        } else {
-          printk(KERN_WARNING "%s: attempt to dump debug with debug level of zero\n", MOD_NAME);
-        }
-        return(SUCCESS);
+      // Drop the head frame without copying it
+      case IOCTL_Rx_Discard:
+         down_read(&(pgpDevice->poolSem));
+         mutex_lock(&(pgpDevice->rxReadLock));
+         ret = PgpCard_RxDiscard(pgpDevice);
+         mutex_unlock(&(pgpDevice->rxReadLock));
+         up_read(&(pgpDevice->poolSem));
+         if (pgpDevice->debug > 1) printk(KERN_DEBUG "%s: Rx discard, ret=%i\n", MOD_NAME, ret);
+         return(ret);
          break;
 
-      default:
-         return(ERROR);
+      // Receive into a user registered region
+      case IOCTL_Rx_User_Register: {
+         PgpCardRegion  region;
+
+         if ( copy_from_user(&region,(void __user *)argument,sizeof(PgpCardRegion)) ) {
+            printk(KERN_WARNING "%s: Rx User Register: failed to copy region from user. Maj=%i\n", MOD_NAME, pgpDevice->major);
+            return ERROR;
+         }
+         down_write(&(pgpDevice->poolSem));
+         ret = PgpCard_RxRegister(pgpDevice,&region);
+         up_write(&(pgpDevice->poolSem));
+         if ( ret != SUCCESS ) return(ret);
+         if ( copy_to_user((void __user *)argument,&region,sizeof(PgpCardRegion)) ) {
+            printk(KERN_WARNING "%s: Rx User Register: failed to copy region to user. Maj=%i\n", MOD_NAME, pgpDevice->major);
+            return ERROR;
+         }
+         return(SUCCESS);
          break;
-   }
-}
+      }
 
-// IRQ Handler
-static irqreturn_t PgpCard_IRQHandler(int irq, void *dev_id, struct pt_regs *regs) {
-   __u32        stat;
-   __u32        descA;
-   __u32        descB;
-   __u32        idx;
-   __u32        next;
-   irqreturn_t ret;
+      // Release the user region, receive into driver buffers again
+      case IOCTL_Rx_User_Unregister:
+         down_write(&(pgpDevice->poolSem));
+         ret = PgpCard_RxUnregister(pgpDevice);
+         up_write(&(pgpDevice->poolSem));
+         if (pgpDevice->debug > 0) printk(KERN_DEBUG "%s: Rx user unregister, ret=%i\n", MOD_NAME, ret);
+         return(ret);
+         break;
 
-   struct PgpDevice *pgpDevice = (struct PgpDevice *)dev_id;
+      // Take the next frame in the user region
+      case IOCTL_Rx_User_Recv: {
+         PgpCardRxDesc  rxDesc;
+
+         down_read(&(pgpDevice->poolSem));
+         mutex_lock(&(pgpDevice->rxReadLock));
+         ret = PgpCard_RxUserRecv(pgpDevice,&rxDesc);
+         mutex_unlock(&(pgpDevice->rxReadLock));
+         up_read(&(pgpDevice->poolSem));
+         if ( ret != SUCCESS ) return(ret);
+         if ( copy_to_user((void __user *)argument,&rxDesc,sizeof(PgpCardRxDesc)) ) {
+            printk(KERN_WARNING "%s: Rx User Recv: failed to copy descriptor to user. Maj=%i\n", MOD_NAME, pgpDevice->major);
+            return ERROR;
+         }
+         return(SUCCESS);
+         break;
+      }
 
-   // Read IRQ Status
-   stat = ioread32(&(pgpDevice->reg->irq));
-   asm("nop");   
+      // Give a user region buffer back to the card
+      case IOCTL_Rx_User_Return:
+         down_read(&(pgpDevice->poolSem));
+         ret = PgpCard_RxUserReturn(pgpDevice,arg);
+         up_read(&(pgpDevice->poolSem));
+         if (pgpDevice->debug > 1) printk(KERN_DEBUG "%s: Rx user return %i, ret=%i\n", MOD_NAME, arg, ret);
+         return(ret);
+         break;
 
-   // Is this the source
-   if ( (stat & 0x2) != 0 ) {
+      // Apply a card configuration and read it back
+      case IOCTL_Card_Config: {
+         PgpCardConfig  config;
 
-      if ( pgpDevice->debug > 0 ) printk(KERN_DEBUG"%s: Irq: IRQ Called. Maj=%i\n", MOD_NAME,pgpDevice->major);
+         if ( copy_from_user(&config,(void __user *)argument,sizeof(PgpCardConfig)) ) {
+            printk(KERN_WARNING "%s: Card Config: failed to copy config from user. Maj=%i\n", MOD_NAME, pgpDevice->major);
+            return ERROR;
+         }
+         spin_lock_irqsave(&(pgpDevice->regLock),flags);
+         PgpCard_CfgApply(pgpDevice,&config);
+         PgpCard_CfgRead(pgpDevice,&config);
+         spin_unlock_irqrestore(&(pgpDevice->regLock),flags);
+         if (pgpDevice->debug > 0) printk(KERN_DEBUG "%s: Card config applied, Apply=0x%x\n", MOD_NAME, config.apply);
+         if ( copy_to_user((void __user *)argument,&config,sizeof(PgpCardConfig)) ) {
+            printk(KERN_WARNING "%s: Card Config: failed to copy config to user. Maj=%i\n", MOD_NAME, pgpDevice->major);
+            return ERROR;
+         }
+         return(SUCCESS);
+         break;
+      }
 
-      // Disable interrupts
-      iowrite32(0,&(pgpDevice->reg->irq));
-      asm("nop");
+      // Configure the link monitor and read its counters
+      case IOCTL_Link_Monitor: {
+         PgpCardLinkMon linkMon;
 
-      // Read Tx completion status
-      stat = ioread32(&(pgpDevice->reg->txStat[1]));
-      asm("nop");       
+         if ( copy_from_user(&linkMon,(void __user *)argument,sizeof(PgpCardLinkMon)) ) {
+            printk(KERN_WARNING "%s: Link Monitor: failed to copy from user. Maj=%i\n", MOD_NAME, pgpDevice->major);
+            return ERROR;
+         }
+         if ( linkMon.period != 0 ) {
+            spin_lock_irqsave(&(pgpDevice->regLock),flags);
+            PgpCard_MonRelease(pgpDevice);
+            pgpDevice->monMask      = linkMon.laneMask & 0xFF;
+            pgpDevice->monPeriod    = linkMon.period;
+            pgpDevice->monDownLimit = linkMon.downLimit;
+            pgpDevice->monDown     &= pgpDevice->monMask;
+            pgpDevice->monNext      = jiffies;
+            PgpCard_LinkUpdate(pgpDevice);
+            spin_unlock_irqrestore(&(pgpDevice->regLock),flags);
+            if (pgpDevice->debug > 0) printk(KERN_DEBUG "%s: Link monitor mask 0x%x, period %u ms, limit %u ms\n",
+                                             MOD_NAME, pgpDevice->monMask, pgpDevice->monPeriod, pgpDevice->monDownLimit);
+         }
+         spin_lock_irqsave(&(pgpDevice->regLock),flags);
+         linkMon.laneMask  = pgpDevice->monMask;
+         linkMon.period    = pgpDevice->monPeriod;
+         linkMon.downLimit = pgpDevice->monDownLimit;
+         linkMon.linkDown  = pgpDevice->monDown;
+         for (x=0; x < 8; x++) {
+            linkMon.resets[x]    = pgpDevice->monResets[x];
+            linkMon.recovered[x] = pgpDevice->monRecovered[x];
+            linkMon.lastDown[x]  = pgpDevice->monLastDown[x];
+         }
+         spin_unlock_irqrestore(&(pgpDevice->regLock),flags);
+         if ( copy_to_user((void __user *)argument,&linkMon,sizeof(PgpCardLinkMon)) ) {
+            printk(KERN_WARNING "%s: Link Monitor: failed to copy to user. Maj=%i\n", MOD_NAME, pgpDevice->major);
+            return ERROR;
+         }
+         return(SUCCESS);
+         break;
+      }
 
-      // Tx Data is ready
-      if ( (stat & 0x80000000) != 0 ) {
+      // Start, stop or read back the trigger generator
+      case IOCTL_Trig_Gen: {
+         PgpCardTrigger trigger;
 
-         do {
+         if ( copy_from_user(&trigger,(void __user *)argument,sizeof(PgpCardTrigger)) ) {
+            printk(KERN_WARNING "%s: Trig Gen: failed to copy from user. Maj=%i\n", MOD_NAME, pgpDevice->major);
+            return ERROR;
+         }
+         if ( trigger.apply == PGP_TRIG_START ) ret = PgpCard_TrigStart(pgpDevice,&trigger);
+         else if ( trigger.apply == PGP_TRIG_STOP ) {
+            hrtimer_cancel(&(pgpDevice->trigTimer));
+            spin_lock_irqsave(&(pgpDevice->regLock),flags);
+            if ( pgpDevice->trigRunning ) pgpDevice->trigStop = ktime_get();
+            pgpDevice->trigRunning = 0;
+            spin_unlock_irqrestore(&(pgpDevice->regLock),flags);
+            ret = SUCCESS;
+         }
+         else ret = SUCCESS;
+         if ( ret != SUCCESS ) return(ret);
+         if (pgpDevice->debug > 0 && trigger.apply != 0) printk(KERN_DEBUG "%s: Trigger generator %s, period %u ns\n",
+                                                                MOD_NAME, (trigger.apply == PGP_TRIG_START) ? "started" : "stopped", trigger.period);
+         PgpCard_TrigRead(pgpDevice,&trigger);
+         if ( copy_to_user((void __user *)argument,&trigger,sizeof(PgpCardTrigger)) ) {
+            printk(KERN_WARNING "%s: Trig Gen: failed to copy to user. Maj=%i\n", MOD_NAME, pgpDevice->major);
+            return ERROR;
+         }
+         return(SUCCESS);
+         break;
+      }
 
-            // Read dma value
-            stat = ioread32(&(pgpDevice->reg->txRead));
-            asm("nop");            
-            
-            if( (stat & 0x1) == 0x1 ) {
+      // Watch link state from this file at a new sampling period, or stop watching until the next poll
+      case IOCTL_Link_State:
+         if ( arg != 0 && arg < STATE_MIN_PERIOD ) {
+            printk(KERN_WARNING "%s: Link State: invalid period %u us. Maj=%i\n", MOD_NAME, arg, pgpDevice->major);
+            return ERROR;
+         }
+         spin_lock_irqsave(&(pgpDevice->regLock),flags);
+         if ( arg != 0 ) pgpDevice->statePeriod = arg;
+         spin_unlock_irqrestore(&(pgpDevice->regLock),flags);
+         PgpCard_StateWatch(pgpDevice,pgpFile,(arg != 0));
+         if (pgpDevice->debug > 0) printk(KERN_DEBUG "%s: Set link state period to %u us\n", MOD_NAME, arg);
+         return(SUCCESS);
+         break;
 
-               if ( pgpDevice->debug > 0 ) printk(KERN_DEBUG"%s: Irq: Return TX Status Value %.8x. Maj=%i\n",MOD_NAME,stat,pgpDevice->major);
-            
-               // Find TX buffer entry
-               for ( idx=0; idx < pgpDevice->txBuffCnt; idx++ ) {
-                  if ( pgpDevice->txBuffer[idx]->dma == (stat & 0xFFFFFFFC) ) break;
-               }
+      // Next link state event
+      case IOCTL_Link_State_Event: {
+         PgpCardStateEvent stateEvent;
 
-               // Entry was found
-               if ( idx < pgpDevice->txBuffCnt ) {
+         spin_lock_irqsave(&(pgpDevice->regLock),flags);
+         if ( pgpDevice->stateEventRead == pgpDevice->stateEventWrite ) ret = -EAGAIN;
+         else {
+            stateEvent = pgpDevice->stateEvent[pgpDevice->stateEventRead % STATE_EVENT_CNT];
+            pgpDevice->stateEventRead++;
+            ret = SUCCESS;
+         }
+         spin_unlock_irqrestore(&(pgpDevice->regLock),flags);
+         if ( ret != SUCCESS ) return(ret);
+         if ( copy_to_user((void __user *)argument,&stateEvent,sizeof(PgpCardStateEvent)) ) {
+            printk(KERN_WARNING "%s: Link State Event: failed to copy to user. Maj=%i\n", MOD_NAME, pgpDevice->major);
+            return ERROR;
+         }
+         return(SUCCESS);
+         break;
+      }
 
-                  // Return to queue
-                  next = (pgpDevice->txWrite+1) % (pgpDevice->txBuffCnt+2);
-                  if ( next == pgpDevice->txRead ) printk(KERN_WARNING"%s: Irq: Tx queue pointer collision. Maj=%i\n",MOD_NAME,pgpDevice->major);
-                  pgpDevice->txQueue[pgpDevice->txWrite] = pgpDevice->txBuffer[idx];
-                  //printk(KERN_WARNING"%s: Irq: pgpDevice->txWrite = next=%i\n",MOD_NAME,next);
-                  pgpDevice->txWrite = next;
+      // Start, stop or read back counter sampling
+      case IOCTL_Cnt_Config: {
+         PgpCardCntConfig cntConfig;
 
-                  // Wake up any writers
-                  wake_up_interruptible(&(pgpDevice->outq));
-               }
-               else printk(KERN_WARNING"%s: Irq: Failed to locate TX descriptor %.8x. Maj=%i\n",MOD_NAME,(__u32)(stat&0xFFFFFFFC),pgpDevice->major);
-            }
-            
-         // Repeat while next valid flag is set
-         } while ( (stat & 0x1) == 0x1 );
+         if ( copy_from_user(&cntConfig,(void __user *)argument,sizeof(PgpCardCntConfig)) ) {
+            printk(KERN_WARNING "%s: Cnt Config: failed to copy from user. Maj=%i\n", MOD_NAME, pgpDevice->major);
+            return ERROR;
+         }
+         if ( cntConfig.apply == PGP_CNT_START ) {
+            if ( (ret = PgpCard_CntStart(pgpDevice,&cntConfig)) != SUCCESS ) return(ret);
+         }
+         else if ( cntConfig.apply == PGP_CNT_STOP ) {
+            spin_lock_irqsave(&(pgpDevice->regLock),flags);
+            pgpDevice->cntRunning = 0;
+            spin_unlock_irqrestore(&(pgpDevice->regLock),flags);
+            hrtimer_cancel(&(pgpDevice->cntTimer));
+         }
+         if (pgpDevice->debug > 0 && cntConfig.apply != 0) printk(KERN_DEBUG "%s: Counter sampling %s, period %u us\n",
+                                                                  MOD_NAME, (cntConfig.apply == PGP_CNT_START) ? "started" : "stopped", cntConfig.period);
+         PgpCard_CntRead(pgpDevice,&cntConfig);
+         if ( copy_to_user((void __user *)argument,&cntConfig,sizeof(PgpCardCntConfig)) ) {
+            printk(KERN_WARNING "%s: Cnt Config: failed to copy to user. Maj=%i\n", MOD_NAME, pgpDevice->major);
+            return ERROR;
+         }
+         return(SUCCESS);
+         break;
       }
 
-      // Read Rx completion status
-      stat = ioread32(&(pgpDevice->reg->rxStatus));
-      asm("nop");
+      // Current counter totals or the oldest queued snapshot
+      case IOCTL_Cnt_Snapshot:
+         if ( copy_from_user(&next,(void __user *)argument,sizeof(__u32)) ) {
+            printk(KERN_WARNING "%s: Cnt Snapshot: failed to copy from user. Maj=%i\n", MOD_NAME, pgpDevice->major);
+            return ERROR;
+         }
+         if ( (cntSnap = (PgpCardCntSnap *)kmalloc(sizeof(PgpCardCntSnap),GFP_KERNEL)) == NULL ) return(-ENOMEM);
+         cntSnap->next = next;
+         ret = SUCCESS;
+         spin_lock_irqsave(&(pgpDevice->regLock),flags);
+         if ( cntSnap->next == 0 ) {
+            cntSnap->sample = pgpDevice->cntSamples;
+            cntSnap->time   = ktime_to_ns(pgpDevice->cntTime);
+            cntSnap->cnt    = pgpDevice->cnt;
+         }
+         else if ( pgpDevice->cntSnapRead == pgpDevice->cntSnapWrite ) ret = -EAGAIN;
+         else {
+            *cntSnap = pgpDevice->cntSnap[pgpDevice->cntSnapRead % CNT_SNAP_CNT];
+            cntSnap->next = 1;
+            pgpDevice->cntSnapRead++;
+         }
+         spin_unlock_irqrestore(&(pgpDevice->regLock),flags);
+         if ( ret == SUCCESS && copy_to_user((void __user *)argument,cntSnap,sizeof(PgpCardCntSnap)) ) ret = ERROR;
+         kfree(cntSnap);
+         if ( ret == ERROR ) {
+            printk(KERN_WARNING "%s: Cnt Snapshot: failed to copy to user. Maj=%i\n", MOD_NAME, pgpDevice->major);
+            return ERROR;
+         }
+         return(ret);
+         break;
 
-      // Data is ready
-      if ( (stat & 0x80000000) != 0 ) {
+      // Configure the DMA watchdog, reclaim stuck buffers or read back the report
+      case IOCTL_Dma_Watchdog: {
+         PgpCardWatchdog dog;
 
-         do {
-            
-            // Read descriptor
-            descA = ioread32(&(pgpDevice->reg->rxRead[0]));
-            asm("nop");
-            descB = ioread32(&(pgpDevice->reg->rxRead[1]));
-            asm("nop");
-            
+         if ( copy_from_user(&dog,(void __user *)argument,sizeof(PgpCardWatchdog)) ) {
+            printk(KERN_WARNING "%s: Dma Watchdog: failed to copy from user. Maj=%i\n", MOD_NAME, pgpDevice->major);
+            return ERROR;
+         }
+         ret = SUCCESS;
+         if ( dog.apply & PGP_DOG_SET ) {
+            pgpDevice->dogPeriod = 0;
+            cancel_delayed_work_sync(&(pgpDevice->dogWork));
+            pgpDevice->dogTxAge  = dog.txAge;
+            pgpDevice->dogRxAge  = dog.rxAge;
+            pgpDevice->dogAuto   = dog.autoReclaim;
+            pgpDevice->dogPeriod = dog.period;
+            if ( pgpDevice->dogPeriod ) schedule_delayed_work(&(pgpDevice->dogWork),msecs_to_jiffies(pgpDevice->dogPeriod));
+            if (pgpDevice->debug > 0) printk(KERN_DEBUG "%s: Dma watchdog period %u ms, tx age %u ms, rx age %u ms, auto %u\n",
+                                             MOD_NAME, pgpDevice->dogPeriod, pgpDevice->dogTxAge, pgpDevice->dogRxAge, pgpDevice->dogAuto);
+         }
+         if ( dog.apply & PGP_DOG_RECLAIM ) {
+            down_write(&(pgpDevice->poolSem));
+            if ( pgpDevice->poolReady && ! pgpDevice->bypass ) PgpCard_DogReclaim(pgpDevice);
+            else ret = -EBUSY;
+            up_write(&(pgpDevice->poolSem));
+         }
+         down_read(&(pgpDevice->poolSem));
+         if ( pgpDevice->poolReady && ! pgpDevice->bypass ) PgpCard_DogCheck(pgpDevice);
+         up_read(&(pgpDevice->poolSem));
+         PgpCard_DogRead(pgpDevice,&dog);
+         if ( copy_to_user((void __user *)argument,&dog,sizeof(PgpCardWatchdog)) ) {
+            printk(KERN_WARNING "%s: Dma Watchdog: failed to copy to user. Maj=%i\n", MOD_NAME, pgpDevice->major);
+            return ERROR;
+         }
+         return(ret);
+         break;
+      }
+
+      // Next link monitor event
+      case IOCTL_Link_Event: {
+         PgpCardLinkEvent linkEvent;
+
+         spin_lock_irqsave(&(pgpDevice->regLock),flags);
+         if ( pgpDevice->monEventRead == pgpDevice->monEventWrite ) ret = -EAGAIN;
+         else {
+            linkEvent = pgpDevice->monEvent[pgpDevice->monEventRead % MON_EVENT_CNT];
+            pgpDevice->monEventRead++;
+            ret = SUCCESS;
+         }
+         spin_unlock_irqrestore(&(pgpDevice->regLock),flags);
+         if ( ret != SUCCESS ) return(ret);
+         if ( copy_to_user((void __user *)argument,&linkEvent,sizeof(PgpCardLinkEvent)) ) {
+            printk(KERN_WARNING "%s: Link Event: failed to copy to user. Maj=%i\n", MOD_NAME, pgpDevice->major);
+            return ERROR;
+         }
+         return(SUCCESS);
+         break;
+      }
+
+      // Next user buffer released by a zero copy write
+      case IOCTL_ZeroCopy_Done:
+         spin_lock_irqsave(&(pgpDevice->txLock),flags);
+         if ( pgpDevice->txZcDoneRead == pgpDevice->txZcDoneWrite ) ret = -EAGAIN;
+         else {
+            userAddr = pgpDevice->txZcDone[pgpDevice->txZcDoneRead % TX_ZC_DONE_CNT];
+            pgpDevice->txZcDoneRead++;
+            pgpDevice->txZcUsed--;
+            ret = SUCCESS;
+         }
+         spin_unlock_irqrestore(&(pgpDevice->txLock),flags);
+         if ( ret != SUCCESS ) return(ret);
+         if ( copy_to_user((void __user *)argument,&userAddr,sizeof(__u64)) ) {
+            printk(KERN_WARNING "%s: ZeroCopy Done: failed to copy address to user. Maj=%i\n", MOD_NAME, pgpDevice->major);
+            return ERROR;
+         }
+         return(SUCCESS);
+         break;
+
+      // Set errored frame policy
+      case IOCTL_Rx_Err_Mode:
+         if ( arg > PGP_RX_ERR_META ) {
+            printk(KERN_WARNING "%s: Rx Err Mode: invalid mode %i. Maj=%i\n", MOD_NAME, arg, pgpDevice->major);
+            return ERROR;
+         }
+         down_write(&(pgpDevice->poolSem));
+         pgpFile->rxErrMode = arg;
+         PgpCard_FileMasks(pgpDevice);
+         up_write(&(pgpDevice->poolSem));
+         if (pgpDevice->debug > 0) printk(KERN_DEBUG "%s: Set RX error mode to %i, card drop %i\n", MOD_NAME, arg, pgpDevice->rxErrDrop);
+         return(SUCCESS);
+         break;
+
+      // Read driver status
+      case IOCTL_Read_Drv_Status:
+         if ( (drvStatus = (PgpCardDrvStatus *)kzalloc(sizeof(PgpCardDrvStatus),GFP_KERNEL)) == NULL ) return(-ENOMEM);
+         drvStatus->rxFilter = pgpDevice->rxFilter;
+         for (x=0; x < 32; x++) drvStatus->rxFiltered[x] = pgpDevice->rxFiltered[x];
+         drvStatus->rxErrMode = pgpFile->rxErrMode;
+         for (x=0; x < 8; x++) {
+            drvStatus->rxErrors[x]     = pgpDevice->rxErrors[x];
+            drvStatus->rxErrDropped[x] = pgpDevice->rxErrDropped[x];
+         }
+         drvStatus->rxGroupMask = pgpDevice->rxGroupMask;
+         for (x=0; x < PGP_GROUP_MAX; x++) {
+            drvStatus->rxGroup[x]       = pgpDevice->reader[x].mask;
+            drvStatus->rxGroupFrames[x] = pgpDevice->reader[x].frames;
+         }
+         drvStatus->rxPrioMask   = pgpDevice->rxPrioMask;
+         drvStatus->rxPrioFrames = pgpDevice->rxPrioFrames;
+         drvStatus->txReaped     = pgpDevice->txReaped;
+         drvStatus->rxPauseMask  = pgpDevice->rxPauseUser;
+         drvStatus->rxPauseAuto  = pgpDevice->rxPauseAuto;
+         drvStatus->rxHighWater  = pgpDevice->rxHighWater;
+         for (x=0; x < 8; x++) {
+            drvStatus->rxLaneHeld[x] = pgpDevice->rxLaneHeld[x];
+            drvStatus->rxPauses[x]   = pgpDevice->rxPauses[x];
+         }
+         drvStatus->rxRingSize   = pgpDevice->rxRingSize;
+         drvStatus->rxRingFrames = pgpDevice->rxRingFrames;
+         drvStatus->rxRingFull   = pgpDevice->rxRingFull;
+         for (x=0; x < 32; x++) drvStatus->rxSeqDrops[x] = pgpDevice->rxSeqDrops[x];
+         read = copy_to_user((void __user *)argument,drvStatus,sizeof(PgpCardDrvStatus));
+         kfree(drvStatus);
+         if ( read ) {
+            printk(KERN_WARNING "%s: Read Drv Status: failed to copy status to user. Maj=%i\n", MOD_NAME, pgpDevice->major);
+            return ERROR;
+         }
+         return(SUCCESS);
+         break;
+
+      // Set RX return batch size
+      case IOCTL_Rx_Ret_Batch:
+         if ( arg == 0 || arg > MAX_RX_BUF_CNT ) {
+            printk(KERN_WARNING "%s: Rx Ret Batch: invalid batch size %i. Maj=%i\n", MOD_NAME, arg, pgpDevice->major);
+            return ERROR;
+         }
+         spin_lock_irqsave(&(pgpDevice->rxLock),flags);
+         pgpDevice->rxRetBatch = arg;
+         if ( pgpDevice->poolReady ) PgpCard_RxFlush(pgpDevice);
+         spin_unlock_irqrestore(&(pgpDevice->rxLock),flags);
+         if (pgpDevice->debug > 0) printk(KERN_DEBUG "%s: Set RX return batch to %i\n", MOD_NAME, arg);
+         return(SUCCESS);
+         break;
+
+      // Pause receive on a lane mask, resume the others
+      case IOCTL_Rx_Pause:
+         spin_lock_irqsave(&(pgpDevice->rxLock),flags);
+         PgpCard_RxPauseSet(pgpDevice,arg & 0xFF,pgpDevice->rxPauseAuto);
+         spin_unlock_irqrestore(&(pgpDevice->rxLock),flags);
+         if (pgpDevice->debug > 0) printk(KERN_DEBUG "%s: Set RX pause mask to 0x%.2x\n", MOD_NAME, arg & 0xFF);
+         return(SUCCESS);
+         break;
+
+      // Set automatic pause level, lanes paused by the old level are resumed
+      case IOCTL_Rx_High_Water:
+         if ( arg > MAX_RX_BUF_CNT ) {
+            printk(KERN_WARNING "%s: Rx High Water: invalid level %i. Maj=%i\n", MOD_NAME, arg, pgpDevice->major);
+            return ERROR;
+         }
+         spin_lock_irqsave(&(pgpDevice->rxLock),flags);
+         pgpDevice->rxHighWater = arg;
+         PgpCard_RxPauseSet(pgpDevice,pgpDevice->rxPauseUser,0);
+         spin_unlock_irqrestore(&(pgpDevice->rxLock),flags);
+         if (pgpDevice->debug > 0) printk(KERN_DEBUG "%s: Set RX high water mark to %i\n", MOD_NAME, arg);
+         return(SUCCESS);
+         break;
+
+      // Start, resize or stop the shared RX ring
+      case IOCTL_Rx_Ring:
+         if ( copy_from_user(&ringSize,(void __user *)argument,sizeof(__u32)) ) {
+            printk(KERN_WARNING "%s: Rx Ring: failed to copy from user. Maj=%i\n", MOD_NAME, pgpDevice->major);
+            return ERROR;
+         }
+         down_write(&(pgpDevice->poolSem));
+         ret      = PgpCard_RingSetup(pgpDevice,ringSize);
+         if ( ret == SUCCESS ) pgpDevice->rxRingErrMode = pgpFile->rxErrMode;
+         ringSize = pgpDevice->rxRing ? (PAGE_SIZE + pgpDevice->rxRingSize) : 0;
+         up_write(&(pgpDevice->poolSem));
+         if ( ret != SUCCESS ) return(ret);
+         if (pgpDevice->debug > 0) printk(KERN_DEBUG "%s: Shared rx ring mapping is %i bytes\n", MOD_NAME, ringSize);
+         if ( copy_to_user((void __user *)argument,&ringSize,sizeof(__u32)) ) {
+            printk(KERN_WARNING "%s: Rx Ring: failed to copy to user. Maj=%i\n", MOD_NAME, pgpDevice->major);
+            return ERROR;
+         }
+         return(SUCCESS);
+         break;
+
+      // Set RX free list low water mark
+      case IOCTL_Rx_Ret_Thresh:
+         pgpDevice->rxRetThresh = arg;
+         if (pgpDevice->debug > 0) printk(KERN_DEBUG "%s: Set RX return threshold to %i\n", MOD_NAME, arg);
+         return(SUCCESS);
+         break;
+
+      // Set RX return flush delay
+      case IOCTL_Rx_Ret_Delay:
+         if ( arg == 0 ) {
+            printk(KERN_WARNING "%s: Rx Ret Delay: delay must be non zero. Maj=%i\n", MOD_NAME, pgpDevice->major);
+            return ERROR;
+         }
+         pgpDevice->rxRetDelay = arg;
+         if (pgpDevice->debug > 0) printk(KERN_DEBUG "%s: Set RX return delay to %i usec\n", MOD_NAME, arg);
+         return(SUCCESS);
+         break;
+
+      // Allocate DMA pools
+      case IOCTL_Pool_Arm: {
+         PgpCardPool    pool;
+
+         if ( argument != 0 ) {
+            if ( copy_from_user(&pool,(void __user *)argument,sizeof(PgpCardPool)) ) {
+               printk(KERN_WARNING "%s: Pool Arm: failed to copy pool configuration from user. Maj=%i\n", MOD_NAME, pgpDevice->major);
+               return ERROR;
+            }
+         }
+         down_write(&(pgpDevice->poolSem));
+         if ( pgpDevice->poolReady ) ret = -EBUSY;
+         else ret = PgpCard_PoolAlloc(pgpDevice,(argument != 0) ? &pool : NULL);
+         up_write(&(pgpDevice->poolSem));
+         if (pgpDevice->debug > 0) printk(KERN_DEBUG "%s: Pool arm, ret=%i\n", MOD_NAME, ret);
+         return(ret);
+         break;
+      }
+
+      // Join the consumer group for a lane/VC mask
+      case IOCTL_Rx_Group_Join:
+         down_read(&(pgpDevice->poolSem));
+         ret = PgpCard_GroupJoin(pgpDevice,filp,arg);
+         up_read(&(pgpDevice->poolSem));
+         if (pgpDevice->debug > 0) printk(KERN_DEBUG "%s: Rx group join, mask 0x%x, ret=%i\n", MOD_NAME, arg, ret);
+         return(ret);
+         break;
+
+      // Leave the consumer group
+      case IOCTL_Rx_Group_Leave:
+         down_read(&(pgpDevice->poolSem));
+         PgpCard_GroupLeave(pgpDevice,filp);
+         up_read(&(pgpDevice->poolSem));
+         if (pgpDevice->debug > 0) printk(KERN_DEBUG "%s: Rx group leave\n", MOD_NAME);
+         return(SUCCESS);
+         break;
+
+      // Time copies out of the RX pool
+      case IOCTL_Copy_Bench: {
+         PgpCardBench   bench;
+
+         if ( copy_from_user(&bench,(void __user *)argument,sizeof(PgpCardBench)) ) {
+            printk(KERN_WARNING "%s: Copy Bench: failed to copy from user. Maj=%i\n", MOD_NAME, pgpDevice->major);
+            return ERROR;
+         }
+         down_read(&(pgpDevice->poolSem));
+         ret = PgpCard_CopyBench(pgpDevice,&bench);
+         up_read(&(pgpDevice->poolSem));
+         if ( ret != SUCCESS ) return(ret);
+         if ( copy_to_user((void __user *)argument,&bench,sizeof(PgpCardBench)) ) {
+            printk(KERN_WARNING "%s: Copy Bench: failed to copy to user. Maj=%i\n", MOD_NAME, pgpDevice->major);
+            return ERROR;
+         }
+         return(SUCCESS);
+         break;
+      }
+
+      // Resize DMA pools, returns the resulting sizing
+      case IOCTL_Pool_Resize: {
+         PgpCardPool    pool;
+
+         if ( copy_from_user(&pool,(void __user *)argument,sizeof(PgpCardPool)) ) {
+            printk(KERN_WARNING "%s: Pool Resize: failed to copy pool configuration from user. Maj=%i\n", MOD_NAME, pgpDevice->major);
+            return ERROR;
+         }
+         down_write(&(pgpDevice->poolSem));
+         if ( pgpDevice->poolReady ) ret = PgpCard_PoolResize(pgpDevice,&pool);
+         else ret = PgpCard_PoolAlloc(pgpDevice,&pool);
+         pool.txCount     = pgpDevice->txBuffCnt;
+         pool.txSize      = pgpDevice->txBuffSize;
+         pool.rxCount     = pgpDevice->rxBuffCnt;
+         pool.rxSize      = pgpDevice->rxBuffSize;
+         pool.freeOnClose = pgpDevice->freeOnClose;
+         pool.rxStreaming = pgpDevice->rxStreaming;
+         up_write(&(pgpDevice->poolSem));
+
+         // Sleeping readers and writers re-evaluate against the new pools
+         wake_up_interruptible(&(pgpDevice->inq));
+         wake_up_interruptible(&(pgpDevice->outq));
+
+         if ( copy_to_user((void __user *)argument,&pool,sizeof(PgpCardPool)) ) {
+            printk(KERN_WARNING "%s: Pool Resize: failed to copy pool configuration to user. Maj=%i\n", MOD_NAME, pgpDevice->major);
+            return ERROR;
+         }
+         if (pgpDevice->debug > 0) printk(KERN_DEBUG "%s: Pool resize, ret=%i\n", MOD_NAME, ret);
+         return(ret);
+         break;
+      }
+
+      // Release DMA pools
+      case IOCTL_Pool_Release:
+         down_write(&(pgpDevice->poolSem));
+         ret = PgpCard_PoolRelease(pgpDevice);
+         up_write(&(pgpDevice->poolSem));
+         if (pgpDevice->debug > 0) printk(KERN_DEBUG "%s: Pool release, ret=%i\n", MOD_NAME, ret);
+         return(ret);
+         break;
+
+      // Hand the descriptor fifos and pools to user space
+      case IOCTL_Bypass_Enable:
+         down_write(&(pgpDevice->poolSem));
+         ret = PgpCard_BypassEnter(pgpDevice,filp);
+         up_write(&(pgpDevice->poolSem));
+         if (pgpDevice->debug > 0) printk(KERN_DEBUG "%s: Bypass enable, ret=%i\n", MOD_NAME, ret);
+         return(ret);
+         break;
+
+      // Return the descriptor fifos to the driver
+      case IOCTL_Bypass_Disable:
+         down_write(&(pgpDevice->poolSem));
+         if ( pgpDevice->bypassOwner != NULL && pgpDevice->bypassOwner != filp ) ret = -EPERM;
+         else ret = PgpCard_BypassExit(pgpDevice);
+         up_write(&(pgpDevice->poolSem));
+         wake_up_interruptible(&(pgpDevice->outq));
+         if (pgpDevice->debug > 0) printk(KERN_DEBUG "%s: Bypass disable, ret=%i\n", MOD_NAME, ret);
+         return(ret);
+         break;
+
+      // Buffer bus address and map offset
+      case IOCTL_Bypass_BufInfo: {
+         PgpCardBufInfo bufInfo;
+
+         if ( copy_from_user(&bufInfo,(void __user *)argument,sizeof(PgpCardBufInfo)) ) {
+            printk(KERN_WARNING "%s: Bypass BufInfo: failed to copy buffer info from user. Maj=%i\n", MOD_NAME, pgpDevice->major);
+            return ERROR;
+         }
+         down_read(&(pgpDevice->poolSem));
+         ret = PgpCard_BufInfo(pgpDevice,&bufInfo);
+         up_read(&(pgpDevice->poolSem));
+         if ( ret != SUCCESS ) return(ret);
+         if ( copy_to_user((void __user *)argument,&bufInfo,sizeof(PgpCardBufInfo)) ) {
+            printk(KERN_WARNING "%s: Bypass BufInfo: failed to copy buffer info to user. Maj=%i\n", MOD_NAME, pgpDevice->major);
+            return ERROR;
+         }
+         return(SUCCESS);
+         break;
+      }
+
+      // No Operation
+      case IOCTL_NOP:
+         asm("nop");//no operation function
+         printk(KERN_WARNING "%s: NOP to %u\n", MOD_NAME, arg);
+         return(SUCCESS);
+         break;          
+         
+      // Set Debug
+      case IOCTL_Set_Debug:
+         pgpDevice->debug = arg;
+         printk(KERN_WARNING "%s: debug set to %u\n", MOD_NAME, arg);
+         return(SUCCESS);
+         break;         
+
+      // Dump Debug
+      case IOCTL_Dump_Debug:
+
+        if (pgpDevice->debug > 0) {
+          printk(KERN_DEBUG "%s IOCTL_Dump_Debug\n", MOD_NAME);
+
+          // Pools can be freed at run time
+          down_read(&(pgpDevice->poolSem));
+          if ( ! pgpDevice->poolReady ) {
+            up_read(&(pgpDevice->poolSem));
+            printk(KERN_DEBUG"%s: Ioctl: DMA pools are not allocated. Maj=%i.\n",MOD_NAME,pgpDevice->major);
+            return(SUCCESS);
+          }
+
+          // Rx Buffers
+          bcnt = PgpCard_RxDepth(pgpDevice);
+          printk(KERN_DEBUG"%s: Ioctl: Rx Queue contains %i out of %i buffers. Maj=%i.\n",MOD_NAME,bcnt,pgpDevice->rxBuffCnt,pgpDevice->major);
+
+         // Rx Fifo 
+         bcnt = 0;
+         for (x=0; x < 8; x++) { 
+            // Get the register
+            tmp = pgpDevice->reg->rxFreeStat[x];
+            // Check for FWFT valid
+            if( ((tmp >> 30) & 0x1) == 0x1) bcnt++;
+            // Check the FIFO fill count
+            bcnt += ((tmp >> 0) & 0x3FF);       
+         }           
+         printk(KERN_DEBUG"%s: Ioctl: Rx Fifo contains %i out of %i buffers. Maj=%i.\n",MOD_NAME,bcnt,pgpDevice->rxBuffCnt,pgpDevice->major);
+
+          // Tx Buffers
+          if ( pgpDevice->txRead > pgpDevice->txWrite )
+            bcnt = (__u32)((int)(pgpDevice->txWrite - pgpDevice->txRead) + pgpDevice->txBuffCnt + 2);
+          else bcnt = (pgpDevice->txWrite - pgpDevice->txRead);
+          printk(KERN_DEBUG"%s: Ioctl: Tx Queue contains %i out of %i buffers. Maj=%i.\n",MOD_NAME,bcnt,pgpDevice->txBuffCnt,pgpDevice->major);
+
+          // Tx lane usage
+          for (x=0; x < 8; x++) {
+            printk(KERN_DEBUG"%s: Ioctl: Tx Lane %i holds %i buffers, quota %i, weight %i, pending %i. Maj=%i.\n",MOD_NAME,x,
+                pgpDevice->txLaneCnt[x],pgpDevice->txLaneQuota,pgpDevice->txLaneWeight[x],
+                (pgpDevice->txPendWrite[x] + pgpDevice->txBuffCnt + 1 - pgpDevice->txPendRead[x]) % (pgpDevice->txBuffCnt+1),
+                pgpDevice->major);
+          }
+
+          // Rx free lists
+          for (x=0; x < 8; x++) {
+            printk(KERN_DEBUG"%s: Ioctl: Rx Lane %i free list holds %i buffers, %i pending return. Maj=%i.\n",MOD_NAME,x,
+                pgpDevice->rxLaneFree[x],pgpDevice->rxRetCnt[x],pgpDevice->major);
+          }
+
+          // Attempt to find missing tx buffers
+          for (x=0; x < pgpDevice->txBuffCnt; x++) {
+            found = 0;
+            read  = pgpDevice->txRead;
+            for (y=0; y < bcnt && read != pgpDevice->txWrite; y++) {
+              if ( pgpDevice->txQueue[read] == pgpDevice->txBuffer[x] ) {
+                found = 1;
+                break;
+              }
+              read = (read+1)%(pgpDevice->txBuffCnt+2);
+            }
+            if ( ! found ) 
+              printk(KERN_DEBUG"%s: Ioctl: Tx Buffer %p is missing! Lane=%i, Vc=%i, Length=%i, Maj=%i\n",MOD_NAME,
+                  pgpDevice->txBuffer[x]->buffer, pgpDevice->txBuffer[x]->lane, pgpDevice->txBuffer[x]->vc,
+                  pgpDevice->txBuffer[x]->length, pgpDevice->major);
+            else
+              printk(KERN_DEBUG"%s: Ioctl: Tx Buffer %p found. Maj=%i\n",MOD_NAME,pgpDevice->txBuffer[x]->buffer,pgpDevice->major);
+          }
+
+          // Queue dump
+          read  = pgpDevice->txRead;
+          for (y=0; y < bcnt && read != pgpDevice->txWrite; y++) {
+            printk(KERN_DEBUG"%s: Ioctl: Tx Queue Entry %p. Maj=%i\n",MOD_NAME, pgpDevice->txQueue[y]->buffer,pgpDevice->major);
+            read = (read+1)%(pgpDevice->txBuffCnt+2);
+          }
+          up_read(&(pgpDevice->poolSem));
+        } else {
+          printk(KERN_WARNING "%s: attempt to dump debug with debug level of zero\n", MOD_NAME);
+        }
+        return(SUCCESS);
+         break;
+
+      default:
+         return(ERROR);
+         break;
+   }
+}
+
+// Write the selected sections of a card configuration, regLock must be held
+// The EVR is held disabled while its mask, codes and delays are changed, the previous
+// enable is restored afterwards unless the control section is applied as well.
+static void PgpCard_CfgApply(struct PgpDevice *pgpDevice, PgpCardConfig *config) {
+   __u32 x;
+   __u32 tmp;
+   __u32 evrEnable;
+
+   evrEnable = pgpDevice->reg->evrCardStat[1] & 0x1;
+   if ( config->apply & (PGP_CFG_EVR_CTRL | PGP_CFG_EVR_MASK | PGP_CFG_EVR_CODES | PGP_CFG_EVR_DELAYS) ) {
+      pgpDevice->reg->evrCardStat[1] &= 0xFFFFFFFE;
+      asm("nop");
+   }
+   if ( config->apply & PGP_CFG_EVR_MASK ) {
+      pgpDevice->reg->evrCardStat[2] = config->evrMask;
+      asm("nop");
+   }
+   if ( config->apply & PGP_CFG_EVR_CODES ) {
+      for (x=0; x < 8; x++) {
+         pgpDevice->reg->runCode[x]    = config->runCode[x];
+         pgpDevice->reg->acceptCode[x] = config->acceptCode[x];
+      }
+      asm("nop");
+   }
+   if ( config->apply & PGP_CFG_EVR_DELAYS ) {
+      for (x=0; x < 8; x++) {
+         pgpDevice->reg->runDelay[x]    = config->runDelay[x];
+         pgpDevice->reg->acceptDelay[x] = config->acceptDelay[x];
+      }
+      asm("nop");
+   }
+   if ( config->apply & PGP_CFG_EVR_CTRL ) {
+      tmp = pgpDevice->reg->evrCardStat[1] & 0xFFFFFFF8;
+      pgpDevice->reg->evrCardStat[1] = tmp | (config->evrCtrl & 0x7);
+      asm("nop");
+   }
+   else if ( (config->apply & (PGP_CFG_EVR_MASK | PGP_CFG_EVR_CODES | PGP_CFG_EVR_DELAYS)) && evrEnable ) {
+      pgpDevice->reg->evrCardStat[1] |= 0x1;
+      asm("nop");
+   }
+
+   // Loopback bits 7:0, RX reset bits 15:8, TX reset bits 23:16
+   if ( config->apply & (PGP_CFG_LOOP | PGP_CFG_RESET) ) {
+      tmp = pgpDevice->reg->pgpCardStat[0];
+      if ( config->apply & PGP_CFG_LOOP ) tmp = (tmp & 0xFFFFFF00) | (config->loopMask & 0xFF);
+      if ( config->apply & PGP_CFG_RESET ) {
+         tmp = (tmp & 0xFF0000FF) | ((config->rxResetMask & 0xFF) << 8) | ((config->txResetMask & 0xFF) << 16);
+      }
+      pgpDevice->reg->pgpCardStat[0] = tmp;
+      asm("nop");
+   }
+}
+
+// Read back the card configuration, regLock must be held
+static void PgpCard_CfgRead(struct PgpDevice *pgpDevice, PgpCardConfig *config) {
+   __u32 x;
+   __u32 tmp;
+
+   config->evrCtrl = pgpDevice->reg->evrCardStat[1] & 0x7;
+   config->evrMask = pgpDevice->reg->evrCardStat[2];
+   for (x=0; x < 8; x++) {
+      config->runCode[x]     = pgpDevice->reg->runCode[x];
+      config->acceptCode[x]  = pgpDevice->reg->acceptCode[x];
+      config->runDelay[x]    = pgpDevice->reg->runDelay[x];
+      config->acceptDelay[x] = pgpDevice->reg->acceptDelay[x];
+   }
+   tmp = pgpDevice->reg->pgpCardStat[0];
+   config->loopMask    = (tmp >> 0)  & 0xFF;
+   config->rxResetMask = (tmp >> 8)  & 0xFF;
+   config->txResetMask = (tmp >> 16) & 0xFF;
+}
+
+// Queue a link monitor event, the oldest event is dropped when the ring is full, regLock must be held
+static void PgpCard_MonEvent(struct PgpDevice *pgpDevice, __u32 lane, __u32 type, __u32 duration) {
+   PgpCardLinkEvent *event;
+
+   if ( (pgpDevice->monEventWrite - pgpDevice->monEventRead) == MON_EVENT_CNT ) pgpDevice->monEventRead++;
+   event = &(pgpDevice->monEvent[pgpDevice->monEventWrite % MON_EVENT_CNT]);
+   event->lane      = lane;
+   event->type      = type;
+   event->time      = jiffies_to_msecs(jiffies);
+   event->duration  = duration;
+   event->downCount = (pgpDevice->reg->pgpLaneStat[lane] >> 24) & 0xF;
+   pgpDevice->monEventWrite++;
+}
+
+// Release lane resets pulsed by the monitor, regLock must be held
+static void PgpCard_MonRelease(struct PgpDevice *pgpDevice) {
+   if ( pgpDevice->monResetting == 0 ) return;
+   pgpDevice->reg->pgpCardStat[0] &= ~((pgpDevice->monResetting << 8) | (pgpDevice->monResetting << 16));
+   asm("nop");
+   pgpDevice->monResetting = 0;
+}
+
+// Link monitor check, run by the link sampler every monPeriod milliseconds, regLock must be held
+// Pulses RX/TX reset on lanes that stay down longer than monDownLimit, resets are held until the next check.
+static void PgpCard_MonCheck(struct PgpDevice *pgpDevice, __u32 linkUp) {
+   __u32 lane;
+   __u32 reset = 0;
+
+   PgpCard_MonRelease(pgpDevice);
+
+   for (lane=0; lane < 8; lane++) {
+      if ( ((pgpDevice->monMask >> lane) & 0x1) == 0 ) continue;
+
+      if ( (linkUp >> lane) & 0x1 ) {
+         if ( (pgpDevice->monDown >> lane) & 0x1 ) {
+            pgpDevice->monDown &= ~(1 << lane);
+            pgpDevice->monLastDown[lane] = jiffies_to_msecs(jiffies - pgpDevice->monDownStart[lane]);
+            pgpDevice->monRecovered[lane]++;
+            PgpCard_MonEvent(pgpDevice,lane,PGP_LINK_UP,pgpDevice->monLastDown[lane]);
+            printk(KERN_INFO"%s: Link: lane %i up after %u ms. Maj=%i\n",MOD_NAME,lane,pgpDevice->monLastDown[lane],pgpDevice->major);
+         }
+      }
+      else if ( ((pgpDevice->monDown >> lane) & 0x1) == 0 ) {
+         pgpDevice->monDown |= (1 << lane);
+         pgpDevice->monDownStart[lane] = jiffies;
+         pgpDevice->monResetAt[lane]   = jiffies;
+         PgpCard_MonEvent(pgpDevice,lane,PGP_LINK_DOWN,0);
+      }
+      else if ( time_after_eq(jiffies,pgpDevice->monResetAt[lane] + msecs_to_jiffies(pgpDevice->monDownLimit)) ) {
+         reset |= (1 << lane);
+         pgpDevice->monResetAt[lane] = jiffies;
+         pgpDevice->monResets[lane]++;
+         PgpCard_MonEvent(pgpDevice,lane,PGP_LINK_RESET,jiffies_to_msecs(jiffies - pgpDevice->monDownStart[lane]));
+      }
+   }
+
+   if ( reset ) {
+      pgpDevice->reg->pgpCardStat[0] |= ((reset << 8) | (reset << 16));
+      asm("nop");
+      pgpDevice->monResetting = reset;
+   }
+}
+
+// Trigger generator timer, sends the next op-code of the pattern and records how late it went out
+static enum hrtimer_restart PgpCard_TrigTimer(struct hrtimer *timer) {
+   unsigned long flags;
+   ktime_t       now;
+   __u64         late;
+   unsigned long overrun;
+
+   struct PgpDevice *pgpDevice = container_of(timer, struct PgpDevice, trigTimer);
+
+   spin_lock_irqsave(&(pgpDevice->regLock),flags);
+   now = ktime_get();
+   iowrite32(pgpDevice->trigCode[pgpDevice->trigSent % pgpDevice->trigCodeCnt],&(pgpDevice->reg->pgpOpCode));
+   asm("nop");
+
+   late = ktime_to_ns(ktime_sub(now,pgpDevice->trigNext));
+   pgpDevice->trigSent++;
+   pgpDevice->trigLateSum += late;
+   if ( late > pgpDevice->trigLateMax ) pgpDevice->trigLateMax = late;
+
+   // Stop after the requested count
+   if ( pgpDevice->trigCount != 0 && pgpDevice->trigSent >= pgpDevice->trigCount ) {
+      pgpDevice->trigRunning = 0;
+      pgpDevice->trigStop    = now;
+      spin_unlock_irqrestore(&(pgpDevice->regLock),flags);
+      return(HRTIMER_NORESTART);
+   }
+
+   // Periods that passed while the timer was held off are skipped and counted
+   overrun = hrtimer_forward(timer,now,ns_to_ktime(pgpDevice->trigPeriod));
+   pgpDevice->trigMissed += overrun - 1;
+   pgpDevice->trigNext    = ktime_add_ns(pgpDevice->trigNext,(__u64)overrun * pgpDevice->trigPeriod);
+   spin_unlock_irqrestore(&(pgpDevice->regLock),flags);
+   return(HRTIMER_RESTART);
+}
+
+// Start the trigger generator with the period and op-code pattern in trigger
+static int PgpCard_TrigStart(struct PgpDevice *pgpDevice, PgpCardTrigger *trigger) {
+   unsigned long flags;
+   __u32         x;
+
+   if ( trigger->period < TRIG_MIN_PERIOD || trigger->codeCnt == 0 || trigger->codeCnt > PGP_TRIG_CODES ) {
+      printk(KERN_WARNING "%s: Trig Gen: invalid period %u ns or pattern length %u. Maj=%i\n",
+         MOD_NAME, trigger->period, trigger->codeCnt, pgpDevice->major);
+      return(-EINVAL);
+   }
+   hrtimer_cancel(&(pgpDevice->trigTimer));
+
+   spin_lock_irqsave(&(pgpDevice->regLock),flags);
+   pgpDevice->trigPeriod  = trigger->period;
+   pgpDevice->trigCount   = trigger->count;
+   pgpDevice->trigCodeCnt = trigger->codeCnt;
+   for (x=0; x < trigger->codeCnt; x++) pgpDevice->trigCode[x] = trigger->opCode[x] & 0xFF;
+   pgpDevice->trigSent    = 0;
+   pgpDevice->trigMissed  = 0;
+   pgpDevice->trigLateSum = 0;
+   pgpDevice->trigLateMax = 0;
+   pgpDevice->trigStart   = ktime_get();
+   pgpDevice->trigNext    = ktime_add_ns(pgpDevice->trigStart,pgpDevice->trigPeriod);
+   pgpDevice->trigRunning = 1;
+   spin_unlock_irqrestore(&(pgpDevice->regLock),flags);
+
+   hrtimer_start(&(pgpDevice->trigTimer),pgpDevice->trigNext,HRTIMER_MODE_ABS);
+   return(SUCCESS);
+}
+
+// Read back the trigger generator settings and statistics
+static void PgpCard_TrigRead(struct PgpDevice *pgpDevice, PgpCardTrigger *trigger) {
+   unsigned long flags;
+   __u64         avg;
+   __u32         x;
+
+   spin_lock_irqsave(&(pgpDevice->regLock),flags);
+   trigger->running = pgpDevice->trigRunning;
+   trigger->period  = pgpDevice->trigPeriod;
+   trigger->count   = pgpDevice->trigCount;
+   trigger->codeCnt = pgpDevice->trigCodeCnt;
+   for (x=0; x < PGP_TRIG_CODES; x++) trigger->opCode[x] = (x < pgpDevice->trigCodeCnt) ? pgpDevice->trigCode[x] : 0;
+   trigger->sent    = pgpDevice->trigSent;
+   trigger->missed  = pgpDevice->trigMissed;
+   trigger->lateMax = pgpDevice->trigLateMax;
+   avg = pgpDevice->trigLateSum;
+   if ( pgpDevice->trigSent > 0 ) do_div(avg,pgpDevice->trigSent);
+   trigger->lateAvg = avg;
+   if ( pgpDevice->trigSent == 0 ) trigger->elapsed = 0;
+   else trigger->elapsed = ktime_to_ns(ktime_sub(pgpDevice->trigRunning ? ktime_get() : pgpDevice->trigStop,pgpDevice->trigStart));
+   spin_unlock_irqrestore(&(pgpDevice->regLock),flags);
+}
+
+// Take the current counter registers as the reference for the next sample, regLock must be held
+static void PgpCard_CntSync(struct PgpDevice *pgpDevice) {
+   __u32 lane;
+
+   for (lane=0; lane < 8; lane++) pgpDevice->cntLaneLast[lane] = pgpDevice->reg->pgpLaneStat[lane];
+   pgpDevice->cntRxLast = pgpDevice->reg->rxCount;
+   pgpDevice->cntTxLast = pgpDevice->reg->txCount;
+   pgpDevice->cntTime   = ktime_get();
+}
+
+// Add the counter increments since the previous sample to the totals, regLock must be held
+// A 4 bit field that advanced by 16 or more between samples is undercounted.
+static void PgpCard_CntSample(struct PgpDevice *pgpDevice, ktime_t now) {
+   PgpCardCounters *cnt = &(pgpDevice->cnt);
+   PgpCardCntSnap  *snap;
+   __u32           lane;
+   __u32           vc;
+   __u32           last;
+   __u32           tmp;
+
+   for (lane=0; lane < 8; lane++) {
+      tmp  = pgpDevice->reg->pgpLaneStat[lane];
+      last = pgpDevice->cntLaneLast[lane];
+      pgpDevice->cntLaneLast[lane] = tmp;
+      if ( tmp == last ) continue;
+
+      cnt->linkErr[lane]  += ((tmp >> 28) - (last >> 28)) & 0xF;
+      cnt->linkDown[lane] += ((tmp >> 24) - (last >> 24)) & 0xF;
+      cnt->cellErr[lane]  += ((tmp >> 20) - (last >> 20)) & 0xF;
+      cnt->fifoErr[lane]  += ((tmp >> 16) - (last >> 16)) & 0xF;
+      for (vc=0; vc < 4; vc++) cnt->rxCount[lane][vc] += ((tmp >> (vc*4)) - (last >> (vc*4))) & 0xF;
+   }
+
+   tmp = pgpDevice->reg->rxCount;
+   cnt->rxDma += (__u32)(tmp - pgpDevice->cntRxLast);
+   pgpDevice->cntRxLast = tmp;
+
+   tmp = pgpDevice->reg->txCount;
+   cnt->txDma += (__u32)(tmp - pgpDevice->cntTxLast);
+   pgpDevice->cntTxLast = tmp;
+
+   pgpDevice->cntTime = now;
+   pgpDevice->cntSamples++;
+
+   // Queue a snapshot, the oldest is dropped when the reader falls behind
+   if ( pgpDevice->cntSnapEvery != 0 && (pgpDevice->cntSamples % pgpDevice->cntSnapEvery) == 0 ) {
+      if ( (pgpDevice->cntSnapWrite - pgpDevice->cntSnapRead) == CNT_SNAP_CNT ) pgpDevice->cntSnapRead++;
+      snap = &(pgpDevice->cntSnap[pgpDevice->cntSnapWrite % CNT_SNAP_CNT]);
+      snap->next   = 0;
+      snap->sample = pgpDevice->cntSamples;
+      snap->time   = ktime_to_ns(now);
+      snap->cnt    = *cnt;
+      pgpDevice->cntSnapWrite++;
+   }
+}
+
+// Counter sampling timer
+static enum hrtimer_restart PgpCard_CntTimer(struct hrtimer *timer) {
+   unsigned long flags;
+   unsigned long overrun;
+   ktime_t       now;
+
+   struct PgpDevice *pgpDevice = container_of(timer, struct PgpDevice, cntTimer);
+
+   spin_lock_irqsave(&(pgpDevice->regLock),flags);
+   if ( ! pgpDevice->cntRunning ) {
+      spin_unlock_irqrestore(&(pgpDevice->regLock),flags);
+      return(HRTIMER_NORESTART);
+   }
+   now = ktime_get();
+   PgpCard_CntSample(pgpDevice,now);
+
+   // A late sample may have missed a counter wrap
+   overrun = hrtimer_forward(timer,now,ns_to_ktime((__u64)pgpDevice->cntPeriod * 1000));
+   if ( overrun > 1 ) pgpDevice->cntLate++;
+   spin_unlock_irqrestore(&(pgpDevice->regLock),flags);
+   return(HRTIMER_RESTART);
+}
+
+// Start counter sampling with the period and snapshot interval in cfg
+// Counts that occur while sampling is stopped are not added to the totals.
+static int PgpCard_CntStart(struct PgpDevice *pgpDevice, PgpCardCntConfig *cfg) {
+   unsigned long flags;
+
+   if ( cfg->period < CNT_MIN_PERIOD ) {
+      printk(KERN_WARNING "%s: Cnt Config: invalid period %u us. Maj=%i\n", MOD_NAME, cfg->period, pgpDevice->major);
+      return(-EINVAL);
+   }
+   hrtimer_cancel(&(pgpDevice->cntTimer));
+
+   spin_lock_irqsave(&(pgpDevice->regLock),flags);
+   pgpDevice->cntPeriod    = cfg->period;
+   pgpDevice->cntSnapEvery = cfg->snapEvery;
+   PgpCard_CntSync(pgpDevice);
+   pgpDevice->cntRunning   = 1;
+   spin_unlock_irqrestore(&(pgpDevice->regLock),flags);
+
+   hrtimer_start(&(pgpDevice->cntTimer),ns_to_ktime((__u64)cfg->period * 1000),HRTIMER_MODE_REL);
+   return(SUCCESS);
+}
+
+// Current link ready and EVR ready bits, regLock must be held
+static void PgpCard_StateRead(struct PgpDevice *pgpDevice, __u32 *loc, __u32 *rem, __u32 *evr) {
+   __u32 tmp;
+
+   tmp  = pgpDevice->reg->pgpCardStat[1];
+   *loc = (tmp >> 0) & 0xFF;
+   *rem = (tmp >> 8) & 0xFF;
+   *evr = (pgpDevice->reg->evrCardStat[0] >> 4) & 0x1;
+}
+
+// Link sampler period in nanoseconds, the shorter of the monitor and state watch periods in use, regLock must be held
+static __u64 PgpCard_LinkPeriod(struct PgpDevice *pgpDevice) {
+   __u64 period = (__u64)pgpDevice->monPeriod * 1000;
+
+   if ( pgpDevice->monMask == 0 || (pgpDevice->stateWatchers > 0 && pgpDevice->statePeriod < period) ) period = pgpDevice->statePeriod;
+   return(period * 1000);
+}
+
+// Start the link sampler, or apply a new period, when the monitor or a state watcher needs it, regLock must be held
+// A sampler starting from idle takes the current link state as the reference for the first event.
+static void PgpCard_LinkUpdate(struct PgpDevice *pgpDevice) {
+   if ( pgpDevice->monMask == 0 && pgpDevice->stateWatchers == 0 ) return;
+
+   if ( ! pgpDevice->linkRunning ) {
+      PgpCard_StateRead(pgpDevice,&(pgpDevice->stateLoc),&(pgpDevice->stateRem),&(pgpDevice->stateEvr));
+      pgpDevice->linkRunning = 1;
+   }
+   hrtimer_start(&(pgpDevice->linkTimer),ns_to_ktime(PgpCard_LinkPeriod(pgpDevice)),HRTIMER_MODE_REL);
+}
+
+// Add or remove a file from the link state watchers
+static void PgpCard_StateWatch(struct PgpDevice *pgpDevice, struct PgpFile *pgpFile, __u32 watch) {
+   unsigned long flags;
+
+   spin_lock_irqsave(&(pgpDevice->regLock),flags);
+   if ( watch && ! pgpFile->stateWatch ) pgpDevice->stateWatchers++;
+   if ( ! watch && pgpFile->stateWatch ) pgpDevice->stateWatchers--;
+   pgpFile->stateWatch = watch;
+   PgpCard_LinkUpdate(pgpDevice);
+   spin_unlock_irqrestore(&(pgpDevice->regLock),flags);
+}
+
+// Link sampler, reads the link ready bits once per tick for both the link state watch and the link monitor
+// A change of a link ready or EVR ready bit is queued as a state event, the oldest event is overwritten
+// when the queue is full. The monitor check runs every monPeriod milliseconds on the same sample.
+static enum hrtimer_restart PgpCard_LinkTimer(struct hrtimer *timer) {
+   PgpCardStateEvent *event;
+   unsigned long     flags;
+   ktime_t           now;
+   __u32             loc;
+   __u32             rem;
+   __u32             evr;
+   __u32             changed;
+
+   struct PgpDevice *pgpDevice = container_of(timer, struct PgpDevice, linkTimer);
+
+   spin_lock_irqsave(&(pgpDevice->regLock),flags);
+   if ( pgpDevice->monMask == 0 && pgpDevice->stateWatchers == 0 ) {
+      pgpDevice->linkRunning = 0;
+      spin_unlock_irqrestore(&(pgpDevice->regLock),flags);
+      return(HRTIMER_NORESTART);
+   }
+   now = ktime_get();
+   PgpCard_StateRead(pgpDevice,&loc,&rem,&evr);
+   changed = (loc != pgpDevice->stateLoc || rem != pgpDevice->stateRem || evr != pgpDevice->stateEvr);
+
+   if ( changed ) {
+      if ( (pgpDevice->stateEventWrite - pgpDevice->stateEventRead) == STATE_EVENT_CNT ) pgpDevice->stateEventRead++;
+      event = &(pgpDevice->stateEvent[pgpDevice->stateEventWrite % STATE_EVENT_CNT]);
+      event->time       = ktime_to_ns(now);
+      event->seq        = pgpDevice->stateEventWrite;
+      event->locLink    = loc;
+      event->remLink    = rem;
+      event->evrReady   = evr;
+      event->locChanged = loc ^ pgpDevice->stateLoc;
+      event->remChanged = rem ^ pgpDevice->stateRem;
+      event->evrChanged = evr ^ pgpDevice->stateEvr;
+      event->pad        = 0;
+      pgpDevice->stateEventWrite++;
+      pgpDevice->stateLoc = loc;
+      pgpDevice->stateRem = rem;
+      pgpDevice->stateEvr = evr;
+   }
+
+   // Link is up when both the local and remote ends are ready
+   if ( pgpDevice->monMask && time_after_eq(jiffies,pgpDevice->monNext) ) {
+      PgpCard_MonCheck(pgpDevice,loc & rem);
+      pgpDevice->monNext = jiffies + msecs_to_jiffies(pgpDevice->monPeriod);
+   }
+
+   hrtimer_forward(timer,now,ns_to_ktime(PgpCard_LinkPeriod(pgpDevice)));
+   spin_unlock_irqrestore(&(pgpDevice->regLock),flags);
+
+   // Wake pollers waiting for POLLPRI
+   if ( changed ) {
+      if ( pgpDevice->debug > 0 ) printk(KERN_DEBUG"%s: Link state: Loc=0x%.2x, Rem=0x%.2x, Evr=%i. Maj=%i\n",MOD_NAME,loc,rem,evr,pgpDevice->major);
+      wake_up_interruptible(&(pgpDevice->inq));
+      if ( pgpDevice->async_queue ) kill_fasync(&(pgpDevice->async_queue),SIGIO,POLL_PRI);
+   }
+   return(HRTIMER_RESTART);
+}
+
+// Read back the counter sampling settings and statistics
+static void PgpCard_CntRead(struct PgpDevice *pgpDevice, PgpCardCntConfig *cfg) {
+   unsigned long flags;
+
+   spin_lock_irqsave(&(pgpDevice->regLock),flags);
+   cfg->running   = pgpDevice->cntRunning;
+   cfg->period    = pgpDevice->cntPeriod;
+   cfg->snapEvery = pgpDevice->cntSnapEvery;
+   cfg->samples   = pgpDevice->cntSamples;
+   cfg->late      = pgpDevice->cntLate;
+   spin_unlock_irqrestore(&(pgpDevice->regLock),flags);
+}
+
+// Age the buffers held by the card, poolSem must be held
+// A TX buffer held longer than dogTxAge is stuck. A lane whose free list holds fewer buffers than
+// the driver posted, and which has received nothing for dogRxAge, has lost the difference.
+// Returns non zero if stuck or lost buffers were found.
+static __u32 PgpCard_DogCheck(struct PgpDevice *pgpDevice) {
+   struct TxBuffer *txBuffer;
+   unsigned long   flags;
+   unsigned long   limit;
+   __u32           age;
+   __u32           stat;
+   __u32           hwFree;
+   __u32           found = 0;
+   __u32           lane;
+   __u32           x;
+
+   // TX buffers, driver pool and zero copy slots
+   spin_lock_irqsave(&(pgpDevice->txLock),flags);
+   for (lane=0; lane < 8; lane++) {
+      pgpDevice->dogTxStuck[lane]  = 0;
+      pgpDevice->dogTxOldest[lane] = 0;
+   }
+   for (x=0; x < pgpDevice->txBuffCnt + TX_ZC_SLOTS; x++) {
+      if ( x < pgpDevice->txBuffCnt ) txBuffer = pgpDevice->txBuffer[x];
+      else txBuffer = &(pgpDevice->txZc[x - pgpDevice->txBuffCnt]);
+      if ( ! txBuffer->posted ) continue;
+
+      age = jiffies_to_msecs(jiffies - txBuffer->postTime);
+      if ( age > pgpDevice->dogTxOldest[txBuffer->lane] ) pgpDevice->dogTxOldest[txBuffer->lane] = age;
+      if ( age > pgpDevice->dogTxAge ) {
+         pgpDevice->dogTxStuck[txBuffer->lane]++;
+         found = 1;
+      }
+   }
+   spin_unlock_irqrestore(&(pgpDevice->txLock),flags);
+
+   // RX free lists, fill count plus the first word fall through entry
+   limit = msecs_to_jiffies(pgpDevice->dogRxAge);
+   spin_lock_irqsave(&(pgpDevice->rxLock),flags);
+   for (lane=0; lane < 8; lane++) {
+      stat   = ioread32(&(pgpDevice->reg->rxFreeStat[lane]));
+      hwFree = (stat & 0x3FF) + ((stat >> 30) & 0x1);
+      pgpDevice->dogRxLost[lane] = 0;
+
+      if ( hwFree >= pgpDevice->rxLaneFree[lane] ) {
+         pgpDevice->dogRxMask &= ~(1 << lane);
+         continue;
+      }
+      if ( ((pgpDevice->dogRxMask >> lane) & 0x1) == 0 ) {
+         pgpDevice->dogRxMask |= (1 << lane);
+         pgpDevice->dogRxShort[lane] = jiffies;
+      }
+      if ( time_after(jiffies,pgpDevice->dogRxShort[lane] + limit) &&
+           time_after(jiffies,pgpDevice->rxLaneLast[lane] + limit) ) {
+         pgpDevice->dogRxLost[lane] = pgpDevice->rxLaneFree[lane] - hwFree;
+         found = 1;
+      }
+   }
+   spin_unlock_irqrestore(&(pgpDevice->rxLock),flags);
+   return(found);
+}
+
+// Take back stuck TX buffers and rebuild the RX free lists, poolSem must be held for writing
+// Lanes with stuck TX buffers have their RX/TX resets pulsed first. Once a lane's TX fifo is empty
+// its TX buffers held past dogTxAge go back to the free queue, a lane that keeps its descriptors
+// past DOG_DRAIN_TIMEOUT keeps its buffers until a later pass, as the card may still read them.
+// The card free lists can only be cleared together, so every RX buffer the driver does not hold
+// is posted again to the free list of its lane. Frames arriving during the pass are lost.
+static void PgpCard_DogReclaim(struct PgpDevice *pgpDevice) {
+   struct TxBuffer  *txBuffer;
+   struct RxBuffer  *rxBuffer;
+   struct PgpReader *reader;
+   unsigned long    flags;
+   unsigned long    limit;
+   __u32            reset = 0;
+   __u32            drained = 0;
+   __u32            txCnt = 0;
+   __u32            rxCnt = 0;
+   __u32            posted[8];
+   __u32            lane;
+   __u32            idx;
+   __u32            x;
+
+   if ( ! pgpDevice->poolReady || pgpDevice->bypass ) return;
+   memset(posted,0,sizeof(posted));
+
+   // Keep the interrupt handler and return timer away from the pools
+   iowrite32(0,&(pgpDevice->reg->irq));
+   asm("nop");
+   synchronize_irq(pgpDevice->irq);
+   del_timer_sync(&(pgpDevice->rxRetTimer));
+   // Returns held by paused lanes are found again below with the buffers in the card
+   spin_lock_irqsave(&(pgpDevice->rxLock),flags);
+   PgpCard_RxFlush(pgpDevice);
+   for (lane=0; lane < 8; lane++) pgpDevice->rxRetCnt[lane] = 0;
+   spin_unlock_irqrestore(&(pgpDevice->rxLock),flags);
+
+   // Completions still in the fifo, then current ages and losses
+   PgpCard_TxReap(pgpDevice);
+   PgpCard_DogCheck(pgpDevice);
+
+   // Pulse the resets of lanes holding stuck TX buffers, the reset may flush their completions
+   for (lane=0; lane < 8; lane++) {
+      if ( pgpDevice->dogTxStuck[lane] ) reset |= (1 << lane);
+   }
+   if ( reset ) {
+      spin_lock_irqsave(&(pgpDevice->regLock),flags);
+      pgpDevice->reg->pgpCardStat[0] |= ((reset << 8) | (reset << 16));
+      asm("nop");
+      spin_unlock_irqrestore(&(pgpDevice->regLock),flags);
+      msleep(1);
+      spin_lock_irqsave(&(pgpDevice->regLock),flags);
+      pgpDevice->reg->pgpCardStat[0] &= ~((reset << 8) | (reset << 16));
+      asm("nop");
+      spin_unlock_irqrestore(&(pgpDevice->regLock),flags);
+
+      // Wait for the reset lanes to drop their descriptors
+      limit = jiffies + msecs_to_jiffies(DOG_DRAIN_TIMEOUT);
+      while (1) {
+         for (lane=0; lane < 8; lane++) {
+            if ( ((reset >> lane) & 0x1) && ioread32(&(pgpDevice->reg->txFifoCnt[lane])) == 0 ) drained |= (1 << lane);
+         }
+         if ( (reset & ~drained) == 0 || time_after(jiffies,limit) ) break;
+         msleep(1);
+      }
+      if ( reset & ~drained )
+         printk(KERN_WARNING"%s: Watchdog: lanes 0x%x still hold descriptors, their tx buffers are kept. Maj=%i\n",
+            MOD_NAME,reset & ~drained,pgpDevice->major);
+      PgpCard_TxReap(pgpDevice);
+   }
+
+   // Stuck TX buffers of drained lanes back to the free queue
+   spin_lock_irqsave(&(pgpDevice->txLock),flags);
+   for (x=0; x < pgpDevice->txBuffCnt + TX_ZC_SLOTS; x++) {
+      if ( x < pgpDevice->txBuffCnt ) txBuffer = pgpDevice->txBuffer[x];
+      else txBuffer = &(pgpDevice->txZc[x - pgpDevice->txBuffCnt]);
+      if ( ! txBuffer->posted || jiffies_to_msecs(jiffies - txBuffer->postTime) <= pgpDevice->dogTxAge ) continue;
+      if ( ((drained >> txBuffer->lane) & 0x1) == 0 ) continue;
+      pgpDevice->dogTxReclaimed[txBuffer->lane]++;
+      PgpCard_TxRelease(pgpDevice,txBuffer);
+      txCnt++;
+   }
+   PgpCard_TxSchedule(pgpDevice);
+   spin_unlock_irqrestore(&(pgpDevice->txLock),flags);
+
+   // Clear the card free lists and discard completions, their buffers are posted again below
+   iowrite32(0,&(pgpDevice->reg->rxMaxFrame));
+   asm("nop");
+   for (x=0; x < MAX_RX_BUF_CNT && (ioread32(&(pgpDevice->reg->rxStatus)) & 0x80000000); x++) {
+      ioread32(&(pgpDevice->reg->rxRead[0]));
+      ioread32(&(pgpDevice->reg->rxRead[1]));
+   }
+
+   // RX buffers held by the driver, in queues, by the user or by pipes, everything else is reclaimed.
+   // Pending returns are reclaimed with them. Pipe releases return buffers under rxLock, so the
+   // buffers are collected under it, and returns made after this point go through rxRet as usual.
+   spin_lock_irqsave(&(pgpDevice->rxLock),flags);
+   for (idx=0; idx < pgpDevice->rxBuffCnt; idx++) {
+      rxBuffer = pgpDevice->rxBuffer[idx];
+      rxBuffer->owned = ! ( rxBuffer->userHeld || atomic_read(&(rxBuffer->spliceRef)) > 0 );
+   }
+   for (x=pgpDevice->rxRead; x != pgpDevice->rxWrite; x = (x+1) % (pgpDevice->rxBuffCnt+2)) pgpDevice->rxQueue[x]->owned = 0;
+   for (x=pgpDevice->rxPrioRead; x != pgpDevice->rxPrioWrite; x = (x+1) % (pgpDevice->rxBuffCnt+2)) pgpDevice->rxPrioQueue[x]->owned = 0;
+   for (idx=0; idx < PGP_GROUP_MAX; idx++) {
+      reader = &(pgpDevice->reader[idx]);
+      if ( reader->filp == NULL ) continue;
+      for (x=reader->read; x != reader->write; x = (x+1) % reader->depth) reader->queue[x]->owned = 0;
+      for (x=reader->prioRead; x != reader->prioWrite; x = (x+1) % reader->depth) reader->prioQueue[x]->owned = 0;
+   }
+   for (lane=0; lane < 8; lane++) {
+      pgpDevice->dogRxReclaimed[lane] += pgpDevice->dogRxLost[lane];
+      pgpDevice->dogRxLost[lane]   = 0;
+      pgpDevice->rxLaneFree[lane]  = 0;
+      pgpDevice->rxRetCnt[lane]    = 0;
+   }
+   pgpDevice->rxRetTotal = 0;
+   pgpDevice->dogRxMask  = 0;
+   pgpDevice->reg->rxMaxFrame = pgpDevice->rxBuffSize | 0x80000000;
+
+   // Buffers of paused lanes wait in the lane's returns until it resumes
+   for (idx=0; idx < pgpDevice->rxBuffCnt; idx++) {
+      rxBuffer = pgpDevice->rxBuffer[idx];
+      if ( ! rxBuffer->owned || (((pgpDevice->rxPauseUser | pgpDevice->rxPauseAuto) >> rxBuffer->lane) & 0x1) == 0 ) continue;
+      rxBuffer->owned = 0;
+      PgpCard_RxSyncDev(pgpDevice,rxBuffer);
+      pgpDevice->rxRet[rxBuffer->lane][pgpDevice->rxRetCnt[rxBuffer->lane]++] = rxBuffer->dma;
+      rxCnt++;
+   }
+   spin_unlock_irqrestore(&(pgpDevice->rxLock),flags);
+
+   // Post the rest to the free list of the lane they came from, as PoolPost does
+   for (idx=0; idx < pgpDevice->rxBuffCnt; idx++) {
+      rxBuffer = pgpDevice->rxBuffer[idx];
+      if ( ! rxBuffer->owned ) continue;
+      PgpCard_RxSyncDev(pgpDevice,rxBuffer);
+      iowrite32(rxBuffer->dma,&(pgpDevice->reg->rxFree[rxBuffer->lane]));
+      asm("nop");
+      posted[rxBuffer->lane]++;
+      rxCnt++;
+   }
+
+   spin_lock_irqsave(&(pgpDevice->rxLock),flags);
+   for (lane=0; lane < 8; lane++) pgpDevice->rxLaneFree[lane] += posted[lane];
+   spin_unlock_irqrestore(&(pgpDevice->rxLock),flags);
+
+   pgpDevice->dogReclaims++;
+
+   // Enable interrupts
+   iowrite32(1,&(pgpDevice->reg->irq));
+   asm("nop");
+   wake_up_interruptible(&(pgpDevice->outq));
+   printk(KERN_INFO"%s: Watchdog: reset lanes 0x%x, reclaimed %i tx buffers, reposted %i rx buffers. Maj=%i\n",
+      MOD_NAME,reset,txCnt,rxCnt,pgpDevice->major);
+}
+
+// Watchdog work, checks buffer ages and reclaims if enabled, runs every dogPeriod while it is set
+static void PgpCard_DogWork(struct work_struct *work) {
+   __u32 found = 0;
+
+   struct PgpDevice *pgpDevice = container_of(work, struct PgpDevice, dogWork.work);
+
+   down_read(&(pgpDevice->poolSem));
+   if ( pgpDevice->poolReady && ! pgpDevice->bypass ) found = PgpCard_DogCheck(pgpDevice);
+   up_read(&(pgpDevice->poolSem));
+
+   if ( found && pgpDevice->dogAuto ) {
+      down_write(&(pgpDevice->poolSem));
+      PgpCard_DogReclaim(pgpDevice);
+      up_write(&(pgpDevice->poolSem));
+   }
+
+   if ( pgpDevice->dogPeriod ) schedule_delayed_work(&(pgpDevice->dogWork),msecs_to_jiffies(pgpDevice->dogPeriod));
+}
+
+// Copy the watchdog settings and report
+static void PgpCard_DogRead(struct PgpDevice *pgpDevice, PgpCardWatchdog *dog) {
+   __u32 x;
+
+   dog->period      = pgpDevice->dogPeriod;
+   dog->txAge       = pgpDevice->dogTxAge;
+   dog->rxAge       = pgpDevice->dogRxAge;
+   dog->autoReclaim = pgpDevice->dogAuto;
+   for (x=0; x < 8; x++) {
+      dog->txStuck[x]     = pgpDevice->dogTxStuck[x];
+      dog->txOldest[x]    = pgpDevice->dogTxOldest[x];
+      dog->rxLost[x]      = pgpDevice->dogRxLost[x];
+      dog->txReclaimed[x] = pgpDevice->dogTxReclaimed[x];
+      dog->rxReclaimed[x] = pgpDevice->dogRxReclaimed[x];
+   }
+   dog->reclaims = pgpDevice->dogReclaims;
+   dog->lateDone = pgpDevice->dogLateDone;
+}
+
+// Returns non zero if every TX buffer is back in the free queue
+static __u32 PgpCard_TxIdle(struct PgpDevice *pgpDevice) {
+   return(((pgpDevice->txWrite + pgpDevice->txBuffCnt + 2 - pgpDevice->txRead) % (pgpDevice->txBuffCnt+2)) == pgpDevice->txBuffCnt &&
+          pgpDevice->txZcFree == TX_ZC_ALL);
+}
+
+// Allocate the DMA pools and hand the RX buffers to the card, poolSem must be held for writing
+// Sizing comes from pool, or from the module parameters when pool is NULL.
+static int PgpCard_PoolAlloc(struct PgpDevice *pgpDevice, PgpCardPool *pool) {
+   __u32 idx;
+   __u32 x;
+
+   if ( pgpDevice->poolReady ) return(SUCCESS);
+
+   // Pick sizing
+   if ( pool != NULL ) {
+      pgpDevice->txBuffCnt   = pool->txCount;
+      pgpDevice->txBuffSize  = pool->txSize;
+      pgpDevice->rxBuffCnt   = pool->rxCount;
+      pgpDevice->rxBuffSize  = pool->rxSize;
+      pgpDevice->freeOnClose = pool->freeOnClose;
+      pgpDevice->rxStreaming = pool->rxStreaming;
+   } else {
+      pgpDevice->txBuffCnt   = cfgTxCount;
+      pgpDevice->txBuffSize  = cfgTxSize;
+      pgpDevice->rxBuffCnt   = cfgRxCount;
+      pgpDevice->rxBuffSize  = cfgRxSize;
+      pgpDevice->freeOnClose = cfgFreeOnClose;
+      pgpDevice->rxStreaming = cfgRxStreaming;
+   }
+   if ( pgpDevice->txBuffCnt == 0 || pgpDevice->txBuffCnt > MAX_TX_BUF_CNT ||
+        pgpDevice->rxBuffCnt == 0 || pgpDevice->rxBuffCnt > MAX_RX_BUF_CNT ||
+        pgpDevice->txBuffSize < 4 || pgpDevice->txBuffSize > MAX_BUF_SIZE  ||
+        pgpDevice->rxBuffSize < 4 || pgpDevice->rxBuffSize > MAX_BUF_SIZE ) {
+      printk(KERN_WARNING"%s: Pool: invalid sizing Tx=%ix%i, Rx=%ix%i. Maj=%i\n",MOD_NAME,
+         pgpDevice->txBuffCnt,pgpDevice->txBuffSize,pgpDevice->rxBuffCnt,pgpDevice->rxBuffSize,pgpDevice->major);
+      pgpDevice->txBuffCnt = 0;
+      pgpDevice->rxBuffCnt = 0;
+      return(-EINVAL);
+   }
+   if ( pgpDevice->rxStreaming && pgpDevice->rxBuffSize > MAX_STREAM_BUF_SIZE ) {
+      printk(KERN_WARNING"%s: Pool: streaming rx buffer size %i above %lu. Maj=%i\n",MOD_NAME,
+         pgpDevice->rxBuffSize,MAX_STREAM_BUF_SIZE,pgpDevice->major);
+      pgpDevice->txBuffCnt = 0;
+      pgpDevice->rxBuffCnt = 0;
+      return(-EINVAL);
+   }
+
+   // Init TX Buffers
+   pgpDevice->txBuffer = (struct TxBuffer **)kzalloc(pgpDevice->txBuffCnt * sizeof(struct TxBuffer *),GFP_KERNEL);
+   pgpDevice->txQueue  = (struct TxBuffer **)kmalloc((pgpDevice->txBuffCnt+2) * sizeof(struct TxBuffer *),GFP_KERNEL);
+   if ( pgpDevice->txBuffer == NULL || pgpDevice->txQueue == NULL ) goto nomem;
+
+   for ( idx=0; idx < pgpDevice->txBuffCnt; idx++ ) {
+      if ((pgpDevice->txBuffer[idx] = (struct TxBuffer *)kzalloc(sizeof(struct TxBuffer ),GFP_KERNEL)) == NULL ) goto nomem;
+      if ((pgpDevice->txBuffer[idx]->buffer = pci_alloc_consistent(pgpDevice->pcidev,pgpDevice->txBuffSize,&(pgpDevice->txBuffer[idx]->dma))) == NULL ) {
+         printk(KERN_WARNING"%s: Pool: unable to allocate tx buffer. Maj=%i\n",MOD_NAME,pgpDevice->major);
+         goto nomem;
+      }
+   }
+
+   // Init per lane pending queues
+   if ( pgpDevice->txLaneQuota == 0 || pgpDevice->txLaneQuota > pgpDevice->txBuffCnt )
+      pgpDevice->txLaneQuota = (DEF_TX_LANE_QUOTA < pgpDevice->txBuffCnt) ? DEF_TX_LANE_QUOTA : pgpDevice->txBuffCnt;
+   for (x=0; x < 8; x++) {
+      if ((pgpDevice->txPend[x] = (struct TxBuffer **)kmalloc((pgpDevice->txBuffCnt+1) * sizeof(struct TxBuffer *),GFP_KERNEL)) == NULL ) goto nomem;
+   }
+
+   // Init RX Buffers
+   pgpDevice->rxBuffer = (struct RxBuffer **)kzalloc(pgpDevice->rxBuffCnt * sizeof(struct RxBuffer *),GFP_KERNEL);
+   pgpDevice->rxQueue  = (struct RxBuffer **)kmalloc((pgpDevice->rxBuffCnt+2) * sizeof(struct RxBuffer *),GFP_KERNEL);
+   pgpDevice->rxPrioQueue = (struct RxBuffer **)kmalloc((pgpDevice->rxBuffCnt+2) * sizeof(struct RxBuffer *),GFP_KERNEL);
+   if ( pgpDevice->rxBuffer == NULL || pgpDevice->rxQueue == NULL || pgpDevice->rxPrioQueue == NULL ) goto nomem;
+
+   for (x=0; x < 8; x++) {
+      if ((pgpDevice->rxRet[x] = (__u32 *)kmalloc(pgpDevice->rxBuffCnt * sizeof(__u32),GFP_KERNEL)) == NULL ) goto nomem;
+   }
+
+   for ( idx=0; idx < pgpDevice->rxBuffCnt; idx++ ) {
+      if ((pgpDevice->rxBuffer[idx] = (struct RxBuffer *)kzalloc(sizeof(struct RxBuffer ),GFP_KERNEL)) == NULL ) goto nomem;
+      pgpDevice->rxBuffer[idx]->pgpDevice = pgpDevice;
+      if ( PgpCard_RxBufAlloc(pgpDevice,pgpDevice->rxBuffer[idx]) != SUCCESS ) {
+         printk(KERN_WARNING"%s: Pool: unable to allocate rx buffer. Maj=%i\n",MOD_NAME,pgpDevice->major);
+         goto nomem;
+      }
+   }
+   PgpCard_PoolPost(pgpDevice);
+
+   pgpDevice->poolReady = 1;
+   printk(KERN_INFO"%s: Pool: allocated Tx=%ix%i, Rx=%ix%i%s. Maj=%i\n",MOD_NAME,
+      pgpDevice->txBuffCnt,pgpDevice->txBuffSize,pgpDevice->rxBuffCnt,pgpDevice->rxBuffSize,
+      pgpDevice->rxStreaming ? " streaming" : "",pgpDevice->major);
+   return(SUCCESS);
+
+nomem:
+   PgpCard_PoolFree(pgpDevice);
+   return(-ENOMEM);
+}
+
+// Allocate one RX buffer, consistent memory or cached pages with a streaming mapping
+static int PgpCard_RxBufAlloc(struct PgpDevice *pgpDevice, struct RxBuffer *rxBuffer) {
+   unchar     *buffer;
+   dma_addr_t dma;
+
+   if ( ! pgpDevice->rxStreaming ) {
+      rxBuffer->buffer = pci_alloc_consistent(pgpDevice->pcidev,pgpDevice->rxBuffSize,&(rxBuffer->dma));
+      return((rxBuffer->buffer == NULL) ? ERROR : SUCCESS);
+   }
+
+   // Card addresses are 32 bits, keep the pages low so the mapping does not bounce
+   buffer = (unchar *)__get_free_pages(GFP_KERNEL | GFP_DMA32,get_order(pgpDevice->rxBuffSize));
+   if ( buffer == NULL ) return(ERROR);
+   dma = pci_map_single(pgpDevice->pcidev,buffer,pgpDevice->rxBuffSize,PCI_DMA_FROMDEVICE);
+   if ( pci_dma_mapping_error(pgpDevice->pcidev,dma) ) {
+      free_pages((unsigned long)buffer,get_order(pgpDevice->rxBuffSize));
+      return(ERROR);
+   }
+   rxBuffer->buffer    = buffer;
+   rxBuffer->dma       = dma;
+   rxBuffer->streaming = 1;
+   return(SUCCESS);
+}
+
+// Free one RX buffer allocated by PgpCard_RxBufAlloc
+static void PgpCard_RxBufFree(struct PgpDevice *pgpDevice, struct RxBuffer *rxBuffer) {
+   if ( rxBuffer->buffer == NULL ) return;
+   if ( rxBuffer->streaming ) {
+      pci_unmap_single(pgpDevice->pcidev,rxBuffer->dma,pgpDevice->rxBuffSize,PCI_DMA_FROMDEVICE);
+      free_pages((unsigned long)rxBuffer->buffer,get_order(pgpDevice->rxBuffSize));
+   }
+   else pci_free_consistent(pgpDevice->pcidev,pgpDevice->rxBuffSize,rxBuffer->buffer,rxBuffer->dma);
+   rxBuffer->buffer = NULL;
+}
+
+// Give a received frame to the CPU, length in bytes
+static void PgpCard_RxSyncCpu(struct PgpDevice *pgpDevice, struct RxBuffer *rxBuffer, __u32 length) {
+   if ( rxBuffer->streaming ) pci_dma_sync_single_for_cpu(pgpDevice->pcidev,rxBuffer->dma,length,PCI_DMA_FROMDEVICE);
+}
+
+// Give an RX buffer back to the card before it is posted to a free list
+static void PgpCard_RxSyncDev(struct PgpDevice *pgpDevice, struct RxBuffer *rxBuffer) {
+   if ( rxBuffer->streaming ) pci_dma_sync_single_for_device(pgpDevice->pcidev,rxBuffer->dma,pgpDevice->rxBuffSize,PCI_DMA_FROMDEVICE);
+}
+
+// Time loops copies of size bytes from the RX pool buffers to user space, poolSem must be held
+// The buffers are read in turn while the card owns them, their contents are meaningless.
+// Each copy includes the syncs a received frame costs, so streaming pools pay for their cache maintenance.
+static int PgpCard_CopyBench(struct PgpDevice *pgpDevice, PgpCardBench *bench) {
+   struct RxBuffer *rxBuffer;
+   ktime_t         start;
+   __u32           x;
+
+   if ( ! pgpDevice->poolReady ) return(ERROR);
+   if ( pgpDevice->bypass || pgpDevice->rxUserCnt ) return(-EBUSY);
+   if ( bench->size == 0 || bench->size > pgpDevice->rxBuffSize || bench->loops == 0 ) return(-EINVAL);
+
+   start = ktime_get();
+   for (x=0; x < bench->loops; x++) {
+      rxBuffer = pgpDevice->rxBuffer[x % pgpDevice->rxBuffCnt];
+      PgpCard_RxSyncCpu(pgpDevice,rxBuffer,bench->size);
+      if ( copy_to_user((void __user *)(unsigned long)bench->data,rxBuffer->buffer,bench->size) ) {
+         PgpCard_RxSyncDev(pgpDevice,rxBuffer);
+         return(ERROR);
+      }
+      PgpCard_RxSyncDev(pgpDevice,rxBuffer);
+   }
+   bench->nsec      = ktime_to_ns(ktime_sub(ktime_get(),start));
+   bench->streaming = pgpDevice->rxStreaming;
+   return(SUCCESS);
+}
+
+// Mask interrupts, stop RX DMA and discard pending completions, poolSem must be held for writing
+// Interrupts are left disabled for the caller.
+static void PgpCard_PoolFlush(struct PgpDevice *pgpDevice) {
+   __u32 x;
+
+   // Keep the interrupt handler and return timer away from the pools
+   iowrite32(0,&(pgpDevice->reg->irq));
+   asm("nop");
+   synchronize_irq(pgpDevice->irq);
+   del_timer_sync(&(pgpDevice->rxRetTimer));
+
+   // Clear RX buffer, drops entries held in the free lists
+   iowrite32(0,&(pgpDevice->reg->rxMaxFrame));
+   asm("nop");
+
+   // Discard pending completions
+   for (x=0; x < MAX_RX_BUF_CNT && (ioread32(&(pgpDevice->reg->rxStatus)) & 0x80000000); x++) {
+      ioread32(&(pgpDevice->reg->rxRead[0]));
+      ioread32(&(pgpDevice->reg->rxRead[1]));
+   }
+   for (x=0; x < MAX_TX_BUF_CNT && (ioread32(&(pgpDevice->reg->txRead)) & 0x1); x++);
+
+   // Queued frames are gone with the card free lists
+   PgpCard_SeqDropQueued(pgpDevice);
+   for (x=0; x < PGP_GROUP_MAX; x++) {
+      pgpDevice->reader[x].read      = 0;
+      pgpDevice->reader[x].write     = 0;
+      pgpDevice->reader[x].prioRead  = 0;
+      pgpDevice->reader[x].prioWrite = 0;
+   }
+}
+
+// Mark every TX buffer free and hand every RX buffer to the card, poolSem must be held for writing
+static void PgpCard_PoolPost(struct PgpDevice *pgpDevice) {
+   __u32 idx;
+   __u32 x;
+
+   for ( idx=0; idx < pgpDevice->txBuffCnt; idx++ ) {
+      pgpDevice->txBuffer[idx]->posted = 0;
+      pgpDevice->txQueue[idx] = pgpDevice->txBuffer[idx];
+   }
+   pgpDevice->txWrite = pgpDevice->txBuffCnt;
+   pgpDevice->txRead  = 0;
+
+   for (x=0; x < 8; x++) {
+      pgpDevice->txPendRead[x]    = 0;
+      pgpDevice->txPendWrite[x]   = 0;
+      pgpDevice->txLaneCnt[x]     = 0;
+      pgpDevice->txLaneDeficit[x] = 0;
+   }
+
+   pgpDevice->rxRead      = 0;
+   pgpDevice->rxWrite     = 0;
+   pgpDevice->rxPrioRead  = 0;
+   pgpDevice->rxPrioWrite = 0;
+
+   for (x=0; x < 8; x++) {
+      pgpDevice->rxLaneFree[x] = 0;
+      pgpDevice->rxRetCnt[x]   = 0;
+      pgpDevice->rxLaneHeld[x] = 0;
+   }
+   pgpDevice->rxRetTotal  = 0;
+   pgpDevice->rxSpliceOff = 0;
+   pgpDevice->rxPauseAuto = 0;
+
+   // Set max frame size, clear rx buffer reset
+   pgpDevice->reg->rxMaxFrame = pgpDevice->rxBuffSize | 0x80000000;
+
+   // Add to RX queue (evenly distributed to all free list RX FIFOs)
+   for ( idx=0; idx < pgpDevice->rxBuffCnt; idx++ ) {
+      pgpDevice->rxBuffer[idx]->lane = idx % 8;
+      PgpCard_RxSyncDev(pgpDevice,pgpDevice->rxBuffer[idx]);
+      iowrite32(pgpDevice->rxBuffer[idx]->dma,&(pgpDevice->reg->rxFree[idx % 8]));
+      asm("nop");
+      pgpDevice->rxLaneFree[idx % 8]++;
+   }
+}
+
+// Stop RX DMA, flush the completion fifos and free the pools, poolSem must be held for writing
+// Callers are expected to have waited for the card to return its TX buffers.
+static void PgpCard_PoolFree(struct PgpDevice *pgpDevice) {
+   __u32 idx;
+   __u32 x;
+
+   // An orphaned pool was flushed by Remove, the card is gone
+   if ( ! pgpDevice->rxOrphan ) PgpCard_PoolFlush(pgpDevice);
+   PgpCard_RxUserFree(pgpDevice);
+
+   // Free TX Buffers
+   if ( pgpDevice->txBuffer != NULL ) {
+      for ( idx=0; idx < pgpDevice->txBuffCnt; idx++ ) {
+         if ( pgpDevice->txBuffer[idx] == NULL ) continue;
+         if ( pgpDevice->txBuffer[idx]->buffer != NULL )
+            pci_free_consistent(pgpDevice->pcidev,pgpDevice->txBuffSize,pgpDevice->txBuffer[idx]->buffer,pgpDevice->txBuffer[idx]->dma);
+         kfree(pgpDevice->txBuffer[idx]);
+      }
+   }
+   kfree(pgpDevice->txBuffer);
+   kfree(pgpDevice->txQueue);
+   pgpDevice->txBuffer = NULL;
+   pgpDevice->txQueue  = NULL;
+   for (x=0; x < 8; x++) {
+      kfree(pgpDevice->txPend[x]);
+      pgpDevice->txPend[x]      = NULL;
+      pgpDevice->txPendRead[x]  = 0;
+      pgpDevice->txPendWrite[x] = 0;
+      pgpDevice->txLaneCnt[x]   = 0;
+   }
+
+   // Free RX Buffers
+   if ( pgpDevice->rxBuffer != NULL ) {
+      for ( idx=0; idx < pgpDevice->rxBuffCnt; idx++ ) {
+         if ( pgpDevice->rxBuffer[idx] == NULL ) continue;
+         PgpCard_RxBufFree(pgpDevice,pgpDevice->rxBuffer[idx]);
+         kfree(pgpDevice->rxBuffer[idx]);
+      }
+   }
+   kfree(pgpDevice->rxBuffer);
+   kfree(pgpDevice->rxQueue);
+   kfree(pgpDevice->rxPrioQueue);
+   pgpDevice->rxBuffer = NULL;
+   pgpDevice->rxQueue  = NULL;
+   pgpDevice->rxPrioQueue = NULL;
+   for (x=0; x < 8; x++) {
+      kfree(pgpDevice->rxRet[x]);
+      pgpDevice->rxRet[x]    = NULL;
+      pgpDevice->rxRetCnt[x] = 0;
+   }
+   pgpDevice->rxRetTotal = 0;
+
+   pgpDevice->txBuffCnt = 0;
+   pgpDevice->txRead    = 0;
+   pgpDevice->txWrite   = 0;
+   pgpDevice->rxBuffCnt = 0;
+   pgpDevice->rxRead    = 0;
+   pgpDevice->rxWrite   = 0;
+   pgpDevice->rxPrioRead  = 0;
+   pgpDevice->rxPrioWrite = 0;
+   pgpDevice->poolReady = 0;
+
+   // Enable interrupts
+   if ( ! pgpDevice->rxOrphan ) {
+      iowrite32(1,&(pgpDevice->reg->irq));
+      asm("nop");
+   }
+}
+
+// Wait for the card to return all TX buffers then free the pools, poolSem must be held for writing
+// Returns -EBUSY and keeps the pools if TX buffers are still outstanding after the timeout.
+static int PgpCard_PoolRelease(struct PgpDevice *pgpDevice) {
+   if ( ! pgpDevice->poolReady ) return(SUCCESS);
+
+   // User space still drives or maps the buffers
+   if ( pgpDevice->bypass || atomic_read(&(pgpDevice->poolMaps)) > 0 ) {
+      printk(KERN_WARNING"%s: Pool: pools are in use by bypass mode, pools kept. Maj=%i\n",MOD_NAME,pgpDevice->major);
+      return(-EBUSY);
+   }
+
+   // Pipes still reference RX buffers
+   if ( atomic_read(&(pgpDevice->rxSpliced)) > 0 ) {
+      printk(KERN_WARNING"%s: Pool: RX buffers are held by pipes, pools kept. Maj=%i\n",MOD_NAME,pgpDevice->major);
+      return(-EBUSY);
+   }
+
+   // Receiving into a user region
+   if ( pgpDevice->rxUserCnt ) {
+      printk(KERN_WARNING"%s: Pool: user RX region is registered, pools kept. Maj=%i\n",MOD_NAME,pgpDevice->major);
+      return(-EBUSY);
+   }
+
+   if ( wait_event_timeout(pgpDevice->outq,PgpCard_TxIdle(pgpDevice),POOL_DRAIN_TIMEOUT) == 0 ) {
+      printk(KERN_WARNING"%s: Pool: TX buffers still owned by card, pools kept. Maj=%i\n",MOD_NAME,pgpDevice->major);
+      return(-EBUSY);
+   }
+   PgpCard_PoolFree(pgpDevice);
+   printk(KERN_INFO"%s: Pool: released. Maj=%i\n",MOD_NAME,pgpDevice->major);
+   return(SUCCESS);
+}
+
+// Quiesce the card and reallocate the pools with new sizing, poolSem must be held for writing
+// Frames still waiting in the RX queue are dropped. The previous sizing is restored if allocation fails.
+static int PgpCard_PoolResize(struct PgpDevice *pgpDevice, PgpCardPool *pool) {
+   PgpCardPool old;
+   __u32       drop;
+   int         ret;
+
+   old.txCount     = pgpDevice->txBuffCnt;
+   old.txSize      = pgpDevice->txBuffSize;
+   old.rxCount     = pgpDevice->rxBuffCnt;
+   old.rxSize      = pgpDevice->rxBuffSize;
+   old.freeOnClose = pgpDevice->freeOnClose;
+   old.rxStreaming = pgpDevice->rxStreaming;
+   drop = PgpCard_RxDepth(pgpDevice);
+
+   // Waits for TX to finish, stops RX and flushes completions
+   if ( (ret = PgpCard_PoolRelease(pgpDevice)) != SUCCESS ) return(ret);
+   if ( drop > 0 ) printk(KERN_WARNING"%s: Pool: resize dropped %i queued rx frames. Maj=%i\n",MOD_NAME,drop,pgpDevice->major);
+
+   if ( (ret = PgpCard_PoolAlloc(pgpDevice,pool)) != SUCCESS ) {
+      printk(KERN_WARNING"%s: Pool: resize failed, restoring previous sizing. Maj=%i\n",MOD_NAME,pgpDevice->major);
+      if ( PgpCard_PoolAlloc(pgpDevice,&old) != SUCCESS )
+         printk(KERN_WARNING"%s: Pool: unable to restore pools. Maj=%i\n",MOD_NAME,pgpDevice->major);
+   }
+   return(ret);
+}
+
+// Give the descriptor fifos to user space, poolSem must be held for writing
+// Every TX buffer must be free and filp must be the only open file. Frames waiting in the RX
+// queue are handed back to the card so that user space starts out owning nothing but the free TX pool.
+static int PgpCard_BypassEnter(struct PgpDevice *pgpDevice, struct file *filp) {
+   struct RxBuffer *rxBuffer;
+   __u32           drop = 0;
+   __u32           prio;
+
+   if ( pgpDevice->isOpen > 1 ) {
+      printk(KERN_WARNING"%s: Bypass: other files have the device open. Maj=%i\n",MOD_NAME,pgpDevice->major);
+      return(-EBUSY);
+   }
+
+   // Owner closed without the fifos draining, the sole opener takes bypass over
+   if ( pgpDevice->bypass ) {
+      pgpDevice->bypassOwner = filp;
+      return(SUCCESS);
+   }
+   if ( ! pgpDevice->poolReady ) {
+      printk(KERN_WARNING"%s: Bypass: DMA pools are not allocated. Maj=%i\n",MOD_NAME,pgpDevice->major);
+      return(ERROR);
+   }
+   if ( pgpDevice->rxStreaming ) {
+      printk(KERN_WARNING"%s: Bypass: not supported with streaming RX buffers. Maj=%i\n",MOD_NAME,pgpDevice->major);
+      return(-EINVAL);
+   }
+   if ( wait_event_timeout(pgpDevice->outq,PgpCard_TxIdle(pgpDevice),POOL_DRAIN_TIMEOUT) == 0 ) {
+      printk(KERN_WARNING"%s: Bypass: TX buffers still owned by card. Maj=%i\n",MOD_NAME,pgpDevice->major);
+      return(-EBUSY);
+   }
+   if ( atomic_read(&(pgpDevice->rxSpliced)) > 0 || pgpDevice->rxUserCnt || pgpDevice->rxGroupMask || pgpDevice->rxRing != NULL ) {
+      printk(KERN_WARNING"%s: Bypass: RX buffers are held by pipes, a user region, a consumer group or the shared ring. Maj=%i\n",MOD_NAME,pgpDevice->major);
+      return(-EBUSY);
+   }
+
+   // Mask interrupts, completions are polled from user space
+   pgpDevice->bypass      = 1;
+   pgpDevice->bypassOwner = filp;
+   iowrite32(0,&(pgpDevice->reg->irq));
+   asm("nop");
+   synchronize_irq(pgpDevice->irq);
+   del_timer_sync(&(pgpDevice->rxRetTimer));
+   PgpCard_RxFlush(pgpDevice);
+
+   while ( (rxBuffer = PgpCard_RxHead(pgpDevice,&prio)) != NULL ) {
+      iowrite32(rxBuffer->dma,&(pgpDevice->reg->rxFree[rxBuffer->lane]));
+      asm("nop");
+      PgpCard_RxPop(pgpDevice,prio);
+      PgpCard_SeqDrop(pgpDevice,rxBuffer);
+      drop++;
+   }
+   memset(pgpDevice->rxLaneHeld,0,sizeof(pgpDevice->rxLaneHeld));
+   if ( drop > 0 ) printk(KERN_WARNING"%s: Bypass: dropped %i queued rx frames. Maj=%i\n",MOD_NAME,drop,pgpDevice->major);
+   printk(KERN_INFO"%s: Bypass: enabled. Maj=%i\n",MOD_NAME,pgpDevice->major);
+   return(SUCCESS);
+}
+
+// Take the descriptor fifos back from user space, poolSem must be held for writing
+// Waits for the lane fifos to empty, then resets the card free lists and the driver queues.
+// Buffers user space had harvested but not re-posted are reclaimed.
+static int PgpCard_BypassExit(struct PgpDevice *pgpDevice) {
+   unsigned long timeout;
+   __u32         busy;
+   __u32         x;
+
+   if ( ! pgpDevice->bypass ) return(SUCCESS);
+
+   timeout = jiffies + POOL_DRAIN_TIMEOUT;
+   do {
+      for (busy=0, x=0; x < 8; x++) busy |= ioread32(&(pgpDevice->reg->txFifoCnt[x]));
+      if ( busy == 0 ) break;
+      schedule_timeout_uninterruptible(1);
+   } while ( time_before(jiffies,timeout) );
+
+   if ( busy != 0 ) {
+      printk(KERN_WARNING"%s: Bypass: TX fifos did not drain, bypass kept. Maj=%i\n",MOD_NAME,pgpDevice->major);
+      return(-EBUSY);
+   }
+
+   PgpCard_PoolFlush(pgpDevice);
+   PgpCard_PoolPost(pgpDevice);
+   pgpDevice->bypass      = 0;
+   pgpDevice->bypassOwner = NULL;
+
+   // Enable interrupts
+   iowrite32(1,&(pgpDevice->reg->irq));
+   asm("nop");
+   printk(KERN_INFO"%s: Bypass: disabled. Maj=%i\n",MOD_NAME,pgpDevice->major);
+   return(SUCCESS);
+}
+
+// Fill in count, size, bus address and map offset of a pool buffer, poolSem must be held
+static int PgpCard_BufInfo(struct PgpDevice *pgpDevice, PgpCardBufInfo *bufInfo) {
+   if ( ! pgpDevice->poolReady ) return(ERROR);
+
+   if ( bufInfo->isTx ) {
+      bufInfo->count     = pgpDevice->txBuffCnt;
+      bufInfo->size      = pgpDevice->txBuffSize;
+      bufInfo->stride    = PAGE_ALIGN(pgpDevice->txBuffSize);
+      bufInfo->mapOffset = PGP_MAP_TX_POOL;
+   } else {
+      bufInfo->count     = pgpDevice->rxBuffCnt;
+      bufInfo->size      = pgpDevice->rxBuffSize;
+      bufInfo->stride    = PAGE_ALIGN(pgpDevice->rxBuffSize);
+      bufInfo->mapOffset = PGP_MAP_RX_POOL;
+   }
+   if ( bufInfo->index >= bufInfo->count ) return(ERROR);
+
+   bufInfo->mapOffset += bufInfo->index * bufInfo->stride;
+   bufInfo->dma = bufInfo->isTx ? pgpDevice->txBuffer[bufInfo->index]->dma : pgpDevice->rxBuffer[bufInfo->index]->dma;
+   return(SUCCESS);
+}
+
+// Map pool buffers into user space, buffers are placed stride bytes apart starting at the offset index
+// Only the bypass owner may map the pools.
+static int PgpCard_PoolMmap(struct PgpDevice *pgpDevice, struct file *filp, struct vm_area_struct *vma) {
+   unsigned long offset = vma->vm_pgoff << PAGE_SHIFT;
+   unsigned long addr;
+   unsigned long stride;
+   unsigned long len;
+   unchar        *buffer;
+   __u32         isTx;
+   __u32         count;
+   __u32         idx;
+   int           ret = 0;
+
+   down_read(&(pgpDevice->poolSem));
+   if ( ! pgpDevice->bypass || pgpDevice->bypassOwner != filp ) {
+      printk(KERN_WARNING"%s: Mmap: pools can only be mapped by the bypass owner. Maj=%i\n",MOD_NAME,pgpDevice->major);
+      ret = -EPERM;
+      goto done;
+   }
+
+   isTx   = (offset < PGP_MAP_RX_POOL);
+   offset = offset - (isTx ? PGP_MAP_TX_POOL : PGP_MAP_RX_POOL);
+   stride = PAGE_ALIGN(isTx ? pgpDevice->txBuffSize : pgpDevice->rxBuffSize);
+   count  = isTx ? pgpDevice->txBuffCnt : pgpDevice->rxBuffCnt;
+   idx    = offset / stride;
+
+   if ( (offset % stride) != 0 || idx >= count || (vma->vm_end - vma->vm_start) > (count - idx) * stride ||
+        (isTx && (PGP_MAP_TX_POOL + count * stride) > PGP_MAP_RX_POOL) ) {
+      printk(KERN_WARNING"%s: Mmap: invalid pool mapping offset %08lx. Maj=%i\n",MOD_NAME,vma->vm_pgoff << PAGE_SHIFT,pgpDevice->major);
+      ret = -EINVAL;
+      goto done;
+   }
+
+   for ( addr = vma->vm_start; addr < vma->vm_end; addr += stride, idx++ ) {
+      buffer = isTx ? pgpDevice->txBuffer[idx]->buffer : pgpDevice->rxBuffer[idx]->buffer;
+      len    = ((vma->vm_end - addr) < stride) ? (vma->vm_end - addr) : stride;
+      if ( remap_pfn_range(vma, addr, virt_to_phys(buffer) >> PAGE_SHIFT, len, vma->vm_page_prot) ) {
+         ret = -EAGAIN;
+         goto done;
+      }
+   }
+
+   vma->vm_flags        |= VM_RESERVED;
+   vma->vm_private_data = pgpDevice;
+   vma->vm_ops          = &PgpCard_VmOps;
+   PgpCard_VmOpen(vma);
+
+done:
+   up_read(&(pgpDevice->poolSem));
+   return(ret);
+}
+
+// Recompute the card state derived from the open files, poolSem must be held for writing
+// The card accepts a lane/VC when any open file accepts it and drops errored frames in the
+// interrupt handler only when every open file drops them.
+static void PgpCard_FileMasks(struct PgpDevice *pgpDevice) {
+   struct PgpFile *pgpFile;
+   __u32           filter;
+   __u32           errDrop;
+
+   filter  = 0;
+   errDrop = (pgpDevice->isOpen > 0);
+   list_for_each_entry(pgpFile,&(pgpDevice->files),list) {
+      filter |= pgpFile->rxFilter;
+      if ( pgpFile->rxErrMode != PGP_RX_ERR_DROP ) errDrop = 0;
+   }
+   pgpDevice->rxFilter  = filter;
+   pgpDevice->rxErrDrop = errDrop;
+}
+
+// Consumer group slot of a file, NULL when the file has not joined, rxLock must be held
+static struct PgpReader *PgpCard_GroupFind(struct PgpDevice *pgpDevice, struct file *filp) {
+   __u32 x;
+
+   if ( pgpDevice->rxGroupMask == 0 ) return(NULL);
+   for (x=0; x < PGP_GROUP_MAX; x++) {
+      if ( pgpDevice->reader[x].filp == filp ) return(&(pgpDevice->reader[x]));
+   }
+   return(NULL);
+}
+
+// Returns non zero if the file is a consumer group member
+static __u32 PgpCard_GroupMember(struct PgpDevice *pgpDevice, struct file *filp) {
+   unsigned long flags;
+   __u32         ret;
+
+   spin_lock_irqsave(&(pgpDevice->rxLock),flags);
+   ret = (PgpCard_GroupFind(pgpDevice,filp) != NULL);
+   spin_unlock_irqrestore(&(pgpDevice->rxLock),flags);
+   return(ret);
+}
+
+// Returns non zero if a frame is waiting for the file
+static __u32 PgpCard_RxReady(struct PgpDevice *pgpDevice, struct file *filp) {
+   struct PgpReader *reader;
+   unsigned long    flags;
+   __u32            ret;
+
+   spin_lock_irqsave(&(pgpDevice->rxLock),flags);
+   if ( (reader = PgpCard_GroupFind(pgpDevice,filp)) != NULL )
+      ret = (reader->read != reader->write || reader->prioRead != reader->prioWrite);
+   else ret = (PgpCard_RxDepth(pgpDevice) > 0);
+   spin_unlock_irqrestore(&(pgpDevice->rxLock),flags);
+   return(ret);
+}
+
+// Head frame of the shared queue, priority frames first, NULL when nothing is queued
+// A frame partly spliced into a pipe stays at the head until it is complete.
+static struct RxBuffer *PgpCard_RxHead(struct PgpDevice *pgpDevice, __u32 *prio) {
+   if ( pgpDevice->rxSpliceOff != 0 ) *prio = pgpDevice->rxSplicePrio;
+   else *prio = (pgpDevice->rxPrioRead != pgpDevice->rxPrioWrite);
+
+   if ( *prio ) {
+      if ( pgpDevice->rxPrioRead == pgpDevice->rxPrioWrite ) return(NULL);
+      return(pgpDevice->rxPrioQueue[pgpDevice->rxPrioRead]);
+   }
+   if ( pgpDevice->rxRead == pgpDevice->rxWrite ) return(NULL);
+   return(pgpDevice->rxQueue[pgpDevice->rxRead]);
+}
+
+// Remove the head frame returned by PgpCard_RxHead
+static void PgpCard_RxPop(struct PgpDevice *pgpDevice, __u32 prio) {
+   if ( prio ) pgpDevice->rxPrioRead = (pgpDevice->rxPrioRead + 1) % (pgpDevice->rxBuffCnt+2);
+   else pgpDevice->rxRead = (pgpDevice->rxRead + 1) % (pgpDevice->rxBuffCnt+2);
+}
+
+// Frames waiting in the shared and priority queues
+static __u32 PgpCard_RxDepth(struct PgpDevice *pgpDevice) {
+   __u32 size = pgpDevice->rxBuffCnt + 2;
+
+   return(((pgpDevice->rxWrite + size - pgpDevice->rxRead) % size) +
+          ((pgpDevice->rxPrioWrite + size - pgpDevice->rxPrioRead) % size));
+}
+
+// Recompute the lane/VC mask served by the consumer group, rxLock must be held
+static void PgpCard_GroupMask(struct PgpDevice *pgpDevice) {
+   __u32 x;
+
+   pgpDevice->rxGroupMask = 0;
+   for (x=0; x < PGP_GROUP_MAX; x++) {
+      if ( pgpDevice->reader[x].filp != NULL ) pgpDevice->rxGroupMask |= pgpDevice->reader[x].mask;
+   }
+}
+
+// Hand a received frame to the least loaded group member accepting its lane/VC, rxLock must be held
+// Ties go to the first member after the last one served. Returns zero if no member takes the frame.
+static __u32 PgpCard_GroupPush(struct PgpDevice *pgpDevice, struct RxBuffer *rxBuffer) {
+   struct PgpReader *reader;
+   __u32            bit = (rxBuffer->lane * 4) + rxBuffer->vc;
+   __u32            best = PGP_GROUP_MAX;
+   __u32            bestDepth = 0;
+   __u32            depth;
+   __u32            x, y;
+
+   if ( ((pgpDevice->rxGroupMask >> bit) & 0x1) == 0 ) return(0);
+
+   for (y=0; y < PGP_GROUP_MAX; y++) {
+      x = (pgpDevice->rxGroupNext + y) % PGP_GROUP_MAX;
+      reader = &(pgpDevice->reader[x]);
+      if ( reader->filp == NULL || ((reader->mask >> bit) & 0x1) == 0 ) continue;
+      depth = ((reader->write + reader->depth - reader->read) % reader->depth) +
+              ((reader->prioWrite + reader->depth - reader->prioRead) % reader->depth);
+
+      // Pools grown after the member joined can hold more frames than its queues
+      if ( depth >= (reader->depth - 1) ) continue;
+      if ( best == PGP_GROUP_MAX || depth < bestDepth ) {
+         best      = x;
+         bestDepth = depth;
+      }
+   }
+   if ( best == PGP_GROUP_MAX ) return(0);
+
+   reader = &(pgpDevice->reader[best]);
+   if ( (pgpDevice->rxPrioMask >> bit) & 0x1 ) {
+      reader->prioQueue[reader->prioWrite] = rxBuffer;
+      reader->prioWrite = (reader->prioWrite + 1) % reader->depth;
+      pgpDevice->rxPrioFrames++;
+   }
+   else {
+      reader->queue[reader->write] = rxBuffer;
+      reader->write = (reader->write + 1) % reader->depth;
+   }
+   reader->frames++;
+   pgpDevice->rxGroupNext = (best + 1) % PGP_GROUP_MAX;
+   return(1);
+}
+
+// Take the next frame queued for a group member, priority frames first, rxLock must be held
+static struct RxBuffer *PgpCard_GroupPop(struct PgpDevice *pgpDevice, struct PgpReader *reader, struct file *filp) {
+   struct RxBuffer *rxBuffer;
+
+   if ( reader->filp != filp ) return(NULL);
+   if ( reader->prioRead != reader->prioWrite ) {
+      rxBuffer = reader->prioQueue[reader->prioRead];
+      reader->prioRead = (reader->prioRead + 1) % reader->depth;
+      return(rxBuffer);
+   }
+   if ( reader->read == reader->write ) return(NULL);
+   rxBuffer = reader->queue[reader->read];
+   reader->read = (reader->read + 1) % reader->depth;
+   return(rxBuffer);
+}
+
+// Add a file to the consumer group for a lane/VC mask, poolSem must be held
+// A member joining again only changes its mask.
+static int PgpCard_GroupJoin(struct PgpDevice *pgpDevice, struct file *filp, __u32 mask) {
+   struct RxBuffer  **queue;
+   struct PgpReader *reader;
+   unsigned long    flags;
+   __u32            free = PGP_GROUP_MAX;
+   __u32            x;
+   __u32            depth;
+   int              ret = SUCCESS;
+
+   if ( mask == 0 ) return(-EINVAL);
+   if ( ! pgpDevice->poolReady ) return(ERROR);
+   if ( pgpDevice->bypass || pgpDevice->rxUserCnt ) return(-EBUSY);
+
+   // Each queue holds every RX buffer of the current pools
+   depth = pgpDevice->rxBuffCnt + 1;
+   if ( (queue = (struct RxBuffer **)vmalloc(2 * depth * sizeof(struct RxBuffer *))) == NULL ) return(-ENOMEM);
+
+   spin_lock_irqsave(&(pgpDevice->rxLock),flags);
+   for (x=0; x < PGP_GROUP_MAX; x++) {
+      if ( pgpDevice->reader[x].filp == filp ) break;
+      if ( pgpDevice->reader[x].filp == NULL && free == PGP_GROUP_MAX ) free = x;
+   }
+   if ( x < PGP_GROUP_MAX ) pgpDevice->reader[x].mask = mask;
+   else if ( free < PGP_GROUP_MAX ) {
+      reader = &(pgpDevice->reader[free]);
+      reader->queue     = queue;
+      reader->read      = 0;
+      reader->write     = 0;
+      reader->prioQueue = queue + depth;
+      reader->depth     = depth;
+      reader->prioRead  = 0;
+      reader->prioWrite = 0;
+      reader->frames = 0;
+      reader->mask   = mask;
+      reader->filp   = filp;
+      queue = NULL;
+   }
+   else ret = -EBUSY;
+   PgpCard_GroupMask(pgpDevice);
+   spin_unlock_irqrestore(&(pgpDevice->rxLock),flags);
+
+   if ( queue != NULL ) vfree(queue);
+   return(ret);
+}
+
+// Remove a file from the consumer group, frames still queued for it go back to the card, poolSem must be held
+static void PgpCard_GroupLeave(struct PgpDevice *pgpDevice, struct file *filp) {
+   struct PgpReader *reader;
+   struct RxBuffer  **queue;
+   unsigned long    flags;
+
+   spin_lock_irqsave(&(pgpDevice->rxLock),flags);
+   if ( (reader = PgpCard_GroupFind(pgpDevice,filp)) == NULL ) {
+      spin_unlock_irqrestore(&(pgpDevice->rxLock),flags);
+      return;
+   }
+   while ( reader->read != reader->write ) {
+      PgpCard_SeqDrop(pgpDevice,reader->queue[reader->read]);
+      PgpCard_RxReturn(pgpDevice,reader->queue[reader->read]);
+      reader->read = (reader->read + 1) % reader->depth;
+   }
+   while ( reader->prioRead != reader->prioWrite ) {
+      PgpCard_SeqDrop(pgpDevice,reader->prioQueue[reader->prioRead]);
+      PgpCard_RxReturn(pgpDevice,reader->prioQueue[reader->prioRead]);
+      reader->prioRead = (reader->prioRead + 1) % reader->depth;
+   }
+   queue = reader->queue;
+   reader->queue     = NULL;
+   reader->prioQueue = NULL;
+   reader->filp  = NULL;
+   reader->mask  = 0;
+   PgpCard_GroupMask(pgpDevice);
+   spin_unlock_irqrestore(&(pgpDevice->rxLock),flags);
+
+   vfree(queue);
+}
+
+// Count a numbered frame that the driver drops
+static void PgpCard_SeqDrop(struct PgpDevice *pgpDevice, struct RxBuffer *rxBuffer) {
+   pgpDevice->rxSeqDrops[(rxBuffer->lane << 2) | rxBuffer->vc]++;
+}
+
+// Drop an errored frame taken under the PGP_RX_ERR_DROP policy, rxLock must be held
+// Returns non zero when the frame was counted and returned to the card, the caller still pops it.
+static __u32 PgpCard_RxErrDrop(struct PgpDevice *pgpDevice, struct RxBuffer *rxBuffer, __u32 mode) {
+   if ( mode != PGP_RX_ERR_DROP || (rxBuffer->eofe | rxBuffer->fifoError | rxBuffer->lengthError) == 0 ) return(0);
+
+   pgpDevice->rxErrDropped[rxBuffer->lane]++;
+   PgpCard_SeqDrop(pgpDevice,rxBuffer);
+   PgpCard_RxReturn(pgpDevice,rxBuffer);
+   return(1);
+}
+
+// Count the frames waiting on the shared, priority and consumer group queues as dropped
+// Interrupts must be masked so that the queues do not change.
+static void PgpCard_SeqDropQueued(struct PgpDevice *pgpDevice) {
+   struct PgpReader *reader;
+   __u32            size = pgpDevice->rxBuffCnt + 2;
+   __u32            idx;
+   __u32            x;
+
+   if ( pgpDevice->rxQueue != NULL && pgpDevice->rxPrioQueue != NULL ) {
+      for (idx=pgpDevice->rxRead; idx != pgpDevice->rxWrite; idx = (idx + 1) % size)
+         PgpCard_SeqDrop(pgpDevice,pgpDevice->rxQueue[idx]);
+      for (idx=pgpDevice->rxPrioRead; idx != pgpDevice->rxPrioWrite; idx = (idx + 1) % size)
+         PgpCard_SeqDrop(pgpDevice,pgpDevice->rxPrioQueue[idx]);
+   }
+   for (x=0; x < PGP_GROUP_MAX; x++) {
+      reader = &(pgpDevice->reader[x]);
+      if ( reader->queue == NULL ) continue;
+      for (idx=reader->read; idx != reader->write; idx = (idx + 1) % reader->depth)
+         PgpCard_SeqDrop(pgpDevice,reader->queue[idx]);
+      for (idx=reader->prioRead; idx != reader->prioWrite; idx = (idx + 1) % reader->depth)
+         PgpCard_SeqDrop(pgpDevice,reader->prioQueue[idx]);
+   }
+}
+
+// Queue an RX buffer for return to its lane free list, rxLock must be held
+// The pending returns are written out together once rxRetBatch are queued, when the
+// lane free list runs below rxRetThresh, or when the return timer expires.
+static void PgpCard_RxReturn(struct PgpDevice *pgpDevice, struct RxBuffer *rxBuffer) {
+   __u32 lane = rxBuffer->lane;
+
+   PgpCard_RxSyncDev(pgpDevice,rxBuffer);
+   pgpDevice->rxRet[lane][pgpDevice->rxRetCnt[lane]++] = rxBuffer->dma;
+   if ( pgpDevice->rxLaneHeld[lane] > 0 ) pgpDevice->rxLaneHeld[lane]--;
+
+   // Paused lane, the return waits for a resume, automatic pauses end at half the high water mark
+   if ( ((pgpDevice->rxPauseUser | pgpDevice->rxPauseAuto) >> lane) & 0x1 ) {
+      if ( ((pgpDevice->rxPauseAuto >> lane) & 0x1) && pgpDevice->rxLaneHeld[lane] <= (pgpDevice->rxHighWater / 2) )
+         PgpCard_RxPauseSet(pgpDevice,pgpDevice->rxPauseUser,pgpDevice->rxPauseAuto & ~(1 << lane));
+      return;
+   }
+   pgpDevice->rxRetTotal++;
+
+   if ( pgpDevice->rxRetTotal >= pgpDevice->rxRetBatch || pgpDevice->rxLaneFree[lane] < pgpDevice->rxRetThresh )
+      PgpCard_RxFlush(pgpDevice);
+   else if ( pgpDevice->rxRetTotal == 1 )
+      mod_timer(&(pgpDevice->rxRetTimer),jiffies + usecs_to_jiffies(pgpDevice->rxRetDelay));
+}
+
+// Write all pending RX returns to the card free lists, paused lanes excepted, rxLock must be held
+static void PgpCard_RxFlush(struct PgpDevice *pgpDevice) {
+   __u32 lane;
+   __u32 x;
+
+   if ( pgpDevice->rxRetTotal == 0 ) return;
+
+   for (lane=0; lane < 8; lane++) {
+      if ( ((pgpDevice->rxPauseUser | pgpDevice->rxPauseAuto) >> lane) & 0x1 ) continue;
+      for (x=0; x < pgpDevice->rxRetCnt[lane]; x++) {
+         iowrite32(pgpDevice->rxRet[lane][x],&(pgpDevice->reg->rxFree[lane]));
+         asm("nop");
+      }
+      pgpDevice->rxLaneFree[lane] += pgpDevice->rxRetCnt[lane];
+      pgpDevice->rxRetCnt[lane] = 0;
+   }
+   pgpDevice->rxRetTotal = 0;
+}
+
+// Change the paused lane masks, rxLock must be held
+// rxRetTotal only counts returns of running lanes, returns held by a lane that pauses leave the
+// count and come back into it when the lane resumes.
+static void PgpCard_RxPauseSet(struct PgpDevice *pgpDevice, __u32 user, __u32 autoMask) {
+   __u32 oldMask = pgpDevice->rxPauseUser | pgpDevice->rxPauseAuto;
+   __u32 newMask = user | autoMask;
+   __u32 lane;
+
+   for (lane=0; lane < 8; lane++) {
+      if ( ((newMask >> lane) & 0x1) && ((oldMask >> lane) & 0x1) == 0 ) {
+         pgpDevice->rxRetTotal -= pgpDevice->rxRetCnt[lane];
+         pgpDevice->rxPauses[lane]++;
+      }
+      else if ( ((newMask >> lane) & 0x1) == 0 && ((oldMask >> lane) & 0x1) )
+         pgpDevice->rxRetTotal += pgpDevice->rxRetCnt[lane];
+   }
+   pgpDevice->rxPauseUser = user;
+   pgpDevice->rxPauseAuto = autoMask;
+
+   // Refill resumed lanes
+   if ( oldMask & ~newMask ) PgpCard_RxFlush(pgpDevice);
+}
+
+// RX return timer, flushes returns left behind when reads stop
+static void PgpCard_RxRetTimer(unsigned long data) {
+   unsigned long flags;
+
+   struct PgpDevice *pgpDevice = (struct PgpDevice *)data;
+
+   spin_lock_irqsave(&(pgpDevice->rxLock),flags);
+   PgpCard_RxFlush(pgpDevice);
+   spin_unlock_irqrestore(&(pgpDevice->rxLock),flags);
+}
+
+// Fill in metadata and up to peekSize leading words of the head frame, poolSem must be held
+// Returns -EAGAIN when no frame is queued, the frame stays at the head of the queue.
+static int PgpCard_RxPeek(struct PgpDevice *pgpDevice, PgpCardPeek *peek) {
+   struct RxBuffer *rxBuffer;
+   __u32           prio;
+
+   if ( ! pgpDevice->poolReady ) return(ERROR);
+   if ( pgpDevice->bypass || pgpDevice->rxUserCnt || pgpDevice->rxRing != NULL ) return(-EBUSY);
+   if ( (rxBuffer = PgpCard_RxHead(pgpDevice,&prio)) == NULL ) return(-EAGAIN);
+
+   peek->pgpLane   = rxBuffer->lane;
+   peek->pgpVc     = rxBuffer->vc;
+   peek->rxSize    = rxBuffer->length;
+   peek->eofe      = rxBuffer->eofe;
+   peek->fifoErr   = rxBuffer->fifoError;
+   peek->lengthErr = rxBuffer->lengthError;
+   peek->seq       = rxBuffer->seq;
+   peek->gseq      = rxBuffer->gseq;
+
+   if ( peek->peekSize > PGP_PEEK_MAX ) peek->peekSize = PGP_PEEK_MAX;
+   if ( peek->peekSize > rxBuffer->length ) peek->peekSize = rxBuffer->length;
+   memcpy(peek->data,rxBuffer->buffer,peek->peekSize*4);
+   return(SUCCESS);
+}
+
+// Return the head frame buffer to the card without copying it, poolSem must be held
+static int PgpCard_RxDiscard(struct PgpDevice *pgpDevice) {
+   struct RxBuffer *rxBuffer;
+   unsigned long   flags;
+   __u32           prio;
+
+   if ( ! pgpDevice->poolReady ) return(ERROR);
+   if ( pgpDevice->bypass || pgpDevice->rxRing != NULL ) return(-EBUSY);
+   if ( (rxBuffer = PgpCard_RxHead(pgpDevice,&prio)) == NULL ) return(-EAGAIN);
+   if ( pgpDevice->rxSpliceOff != 0 ) return(-EBUSY);
+
+   spin_lock_irqsave(&(pgpDevice->rxLock),flags);
+   PgpCard_RxReturn(pgpDevice,rxBuffer);
+   spin_unlock_irqrestore(&(pgpDevice->rxLock),flags);
+
+   PgpCard_RxPop(pgpDevice,prio);
+   return(SUCCESS);
+}
+
+// Start or stop the shared RX ring, poolSem must be held for writing
+// size is rounded up to whole pages, 0 stops the ring. A running ring is replaced only while unmapped.
+static int PgpCard_RingSetup(struct PgpDevice *pgpDevice, __u32 size) {
+   void *ring;
+
+   // The work item sees rxRing cleared once poolSem is released
+   if ( pgpDevice->rxRing != NULL ) {
+      if ( atomic_read(&(pgpDevice->rxRingMaps)) > 0 ) return(-EBUSY);
+      ring = pgpDevice->rxRing;
+      pgpDevice->rxRing     = NULL;
+      pgpDevice->rxRingHdr  = NULL;
+      pgpDevice->rxRingData = NULL;
+      pgpDevice->rxRingSize = 0;
+      vfree(ring);
+   }
+   if ( size == 0 ) return(SUCCESS);
+
+   if ( ! pgpDevice->poolReady ) return(ERROR);
+   if ( pgpDevice->bypass || pgpDevice->rxUserCnt || pgpDevice->rxSpliceOff != 0 ) return(-EBUSY);
+   size = PAGE_ALIGN(size);
+   if ( size < 2 * (pgpDevice->rxBuffSize + sizeof(PgpCardRingRec)) || size > MAX_RX_RING_SIZE ) {
+      printk(KERN_WARNING"%s: Rx Ring: invalid ring size %i. Maj=%i\n",MOD_NAME,size,pgpDevice->major);
+      return(-EINVAL);
+   }
+
+   // Header page followed by the records, zeroed so that head and tail start at 0
+   if ( (ring = vmalloc_user(PAGE_SIZE + size)) == NULL ) return(-ENOMEM);
+   pgpDevice->rxRingHdr          = (PgpCardRingHdr *)ring;
+   pgpDevice->rxRingHdr->size    = size;
+   pgpDevice->rxRingHdr->dataOff = PAGE_SIZE;
+   pgpDevice->rxRingData         = (unchar *)ring + PAGE_SIZE;
+   pgpDevice->rxRingSize         = size;
+   pgpDevice->rxRingHead         = 0;
+   pgpDevice->rxRing             = ring;
+
+   // Frames already queued go to the ring
+   schedule_delayed_work(&(pgpDevice->rxRingWork),0);
+   return(SUCCESS);
+}
+
+// Append a frame to the shared RX ring, rxReadLock must be held
+// Returns ERROR when the application has not freed enough room. Frames that do not fit in half
+// of the ring are truncated and flagged with a length error, as a short read() buffer would be.
+static int PgpCard_RingPut(struct PgpDevice *pgpDevice, struct RxBuffer *rxBuffer) {
+   PgpCardRingRec *rec;
+   __u32          size = pgpDevice->rxRingSize;
+   __u32          head = pgpDevice->rxRingHead;
+   __u32          tail = ACCESS_ONCE(pgpDevice->rxRingHdr->tail);
+   __u32          words;
+   __u32          recLen;
+   __u32          start;
+   __u32          trunc = 0;
+
+   // Tail is written by the application, a bad value stalls the ring
+   if ( tail >= size || (tail % 8) != 0 ) return(ERROR);
+
+   if ( (rxBuffer->eofe | rxBuffer->fifoError | rxBuffer->lengthError) && pgpDevice->rxRingErrMode == PGP_RX_ERR_META ) words = 0;
+   else words = rxBuffer->length;
+   if ( sizeof(PgpCardRingRec) + words*4 > size/2 ) {
+      words = (size/2 - sizeof(PgpCardRingRec)) / 4;
+      trunc = 1;
+   }
+   recLen = (sizeof(PgpCardRingRec) + words*4 + 7) & ~7;
+
+   // Head never catches up with tail, equal offsets mean the ring is empty
+   if ( head < tail ) {
+      if ( recLen >= tail - head ) return(ERROR);
+      start = head;
+   }
+   else if ( recLen < size - head || (recLen == size - head && tail != 0) ) start = head;
+   else if ( recLen < tail ) {
+      rec = (PgpCardRingRec *)(pgpDevice->rxRingData + head);
+      rec->recSize = size - head;
+      rec->pgpLane = PGP_RING_WRAP;
+      start = 0;
+   }
+   else return(ERROR);
+
+   rec = (PgpCardRingRec *)(pgpDevice->rxRingData + start);
+   rec->recSize   = recLen;
+   rec->pgpLane   = rxBuffer->lane;
+   rec->pgpVc     = rxBuffer->vc;
+   rec->rxSize    = rxBuffer->length;
+   rec->dataSize  = words;
+   rec->eofe      = rxBuffer->eofe;
+   rec->fifoErr   = rxBuffer->fifoError;
+   rec->lengthErr = rxBuffer->lengthError | trunc;
+   rec->seq       = rxBuffer->seq;
+   rec->gseq      = rxBuffer->gseq;
+   if ( words > 0 ) memcpy(rec+1,rxBuffer->buffer,words*4);
+
+   // Record must be visible before the new head
+   smp_wmb();
+   pgpDevice->rxRingHead = (start + recLen) % size;
+   pgpDevice->rxRingHdr->head = pgpDevice->rxRingHead;
+   pgpDevice->rxRingHdr->frames++;
+   pgpDevice->rxRingFrames++;
+   return(SUCCESS);
+}
+
+// Copy queued frames into the shared RX ring and give their buffers back to the card
+// Frames stay queued while the ring is full, so that lane backpressure still applies, and the
+// copy is retried on the next tick.
+static void PgpCard_RingWork(struct work_struct *work) {
+   struct PgpDevice *pgpDevice = container_of(work,struct PgpDevice,rxRingWork.work);
+   struct RxBuffer  *rxBuffer;
+   unsigned long    flags;
+   __u32            prio;
+   __u32            copied = 0;
+   __u32            full   = 0;
+   __u32            drop;
+
+   down_read(&(pgpDevice->poolSem));
+   if ( ! pgpDevice->poolReady || pgpDevice->rxRing == NULL ) {
+      up_read(&(pgpDevice->poolSem));
+      return;
+   }
+
+   mutex_lock(&(pgpDevice->rxReadLock));
+   while ( (rxBuffer = PgpCard_RxHead(pgpDevice,&prio)) != NULL ) {
+
+      // Errored frame the ring owner does not want
+      spin_lock_irqsave(&(pgpDevice->rxLock),flags);
+      drop = PgpCard_RxErrDrop(pgpDevice,rxBuffer,pgpDevice->rxRingErrMode);
+      spin_unlock_irqrestore(&(pgpDevice->rxLock),flags);
+      if ( drop ) {
+         PgpCard_RxPop(pgpDevice,prio);
+         continue;
+      }
+
+      if ( PgpCard_RingPut(pgpDevice,rxBuffer) != SUCCESS ) {
+         pgpDevice->rxRingFull++;
+         pgpDevice->rxRingHdr->full++;
+         full = 1;
+         break;
+      }
+      PgpCard_RxPop(pgpDevice,prio);
+      spin_lock_irqsave(&(pgpDevice->rxLock),flags);
+      PgpCard_RxReturn(pgpDevice,rxBuffer);
+      spin_unlock_irqrestore(&(pgpDevice->rxLock),flags);
+      copied++;
+   }
+   mutex_unlock(&(pgpDevice->rxReadLock));
+   up_read(&(pgpDevice->poolSem));
+
+   if ( copied > 0 ) wake_up_interruptible(&(pgpDevice->inq));
+   if ( full ) schedule_delayed_work(&(pgpDevice->rxRingWork),1);
+}
+
+// Map the shared RX ring, header page first
+static int PgpCard_RingMmap(struct PgpDevice *pgpDevice, struct vm_area_struct *vma) {
+   int ret = 0;
+
+   down_read(&(pgpDevice->poolSem));
+   if ( pgpDevice->rxRing == NULL ) {
+      printk(KERN_WARNING"%s: Mmap: shared rx ring is not running. Maj=%i\n",MOD_NAME,pgpDevice->major);
+      ret = -EINVAL;
+   }
+   else if ( (vma->vm_end - vma->vm_start) > PAGE_SIZE + pgpDevice->rxRingSize ) {
+      printk(KERN_WARNING"%s: Mmap: ring mapping larger than the ring. Maj=%i\n",MOD_NAME,pgpDevice->major);
+      ret = -EINVAL;
+   }
+   else if ( remap_vmalloc_range(vma,pgpDevice->rxRing,0) ) ret = -EAGAIN;
+   else {
+      vma->vm_private_data = pgpDevice;
+      vma->vm_ops          = &PgpCard_RingVmOps;
+      PgpCard_RingVmOpen(vma);
+   }
+   up_read(&(pgpDevice->poolSem));
+   return(ret);
+}
+
+// Pin a user region and receive into it in place of the driver RX buffers, poolSem must be held for writing
+// The region is cut into bufSize buffers. Buffers that are not physically contiguous or not
+// reachable by the 32 bit descriptors are skipped, hugepage backed regions avoid both.
+static int PgpCard_RxRegister(struct PgpDevice *pgpDevice, PgpCardRegion *region) {
+   struct RxBuffer **rxUser  = NULL;
+   struct RxBuffer **rxQueue = NULL;
+   struct RxBuffer **rxPrioQueue = NULL;
+   __u32           *rxRet[8];
+   struct page     **pages;
+   unsigned long   ppb;
+   unsigned long   npages;
+   dma_addr_t      dma;
+   __u32           slots;
+   __u32           cnt;
+   __u32           x;
+   __u32           y;
+   int             got;
+   int             ret;
+
+   if ( ! pgpDevice->poolReady ) return(ERROR);
+   if ( pgpDevice->bypass || pgpDevice->rxUserCnt || pgpDevice->rxGroupMask || pgpDevice->rxRing != NULL ||
+        atomic_read(&(pgpDevice->rxSpliced)) > 0 ) return(-EBUSY);
+   if ( region->bufSize < PAGE_SIZE || (region->bufSize % PAGE_SIZE) != 0 || region->bufSize > MAX_BUF_SIZE ||
+        (region->addr % PAGE_SIZE) != 0 || region->size < region->bufSize ) {
+      printk(KERN_WARNING"%s: Rx Region: invalid region or buffer size. Maj=%i\n",MOD_NAME,pgpDevice->major);
+      return(-EINVAL);
+   }
+
+   // Completions are discarded below, the card must not own TX buffers
+   if ( wait_event_timeout(pgpDevice->outq,PgpCard_TxIdle(pgpDevice),POOL_DRAIN_TIMEOUT) == 0 ) return(-EBUSY);
+
+   slots  = ((region->size / region->bufSize) > MAX_RX_BUF_CNT) ? MAX_RX_BUF_CNT : (region->size / region->bufSize);
+   ppb    = region->bufSize / PAGE_SIZE;
+   npages = slots * ppb;
+   for (x=0; x < 8; x++) rxRet[x] = NULL;
+
+   // Pin the region
+   if ( (pages = (struct page **)vmalloc(npages * sizeof(struct page *))) == NULL ) return(-ENOMEM);
+   down_read(&(current->mm->mmap_sem));
+   got = get_user_pages(current,current->mm,(unsigned long)region->addr,npages,1,0,pages,NULL);
+   up_read(&(current->mm->mmap_sem));
+   if ( got < (int)npages ) {
+      for (x=0; got > 0 && x < got; x++) put_page(pages[x]);
+      vfree(pages);
+      return(-EFAULT);
+   }
+
+   // Cut into buffers
+   if ( (rxUser = (struct RxBuffer **)kzalloc(slots * sizeof(struct RxBuffer *),GFP_KERNEL)) == NULL ) {
+      ret = -ENOMEM;
+      goto cleanup;
+   }
+   for ( cnt=0, x=0; x < slots; x++ ) {
+      for ( y=1; y < ppb && page_to_pfn(pages[x*ppb+y]) == page_to_pfn(pages[x*ppb])+y; y++ );
+      if ( y < ppb ) continue;
+
+      dma = pci_map_page(pgpDevice->pcidev,pages[x*ppb],0,region->bufSize,PCI_DMA_FROMDEVICE);
+      if ( ((__u64)dma + region->bufSize) > 0x100000000ULL ) {
+         pci_unmap_page(pgpDevice->pcidev,dma,region->bufSize,PCI_DMA_FROMDEVICE);
+         continue;
+      }
+      if ( (rxUser[cnt] = (struct RxBuffer *)kzalloc(sizeof(struct RxBuffer),GFP_KERNEL)) == NULL ) {
+         pci_unmap_page(pgpDevice->pcidev,dma,region->bufSize,PCI_DMA_FROMDEVICE);
+         ret = -ENOMEM;
+         goto cleanup;
+      }
+      rxUser[cnt]->dma        = dma;
+      rxUser[cnt]->streaming  = 1;
+      rxUser[cnt]->pgpDevice  = pgpDevice;
+      rxUser[cnt]->index      = cnt;
+      rxUser[cnt]->userOffset = (__u64)x * region->bufSize;
+      cnt++;
+   }
+   if ( cnt == 0 ) {
+      printk(KERN_WARNING"%s: Rx Region: no usable buffers in region. Maj=%i\n",MOD_NAME,pgpDevice->major);
+      ret = -EINVAL;
+      goto cleanup;
+   }
+
+   // Queue and return arrays must hold the larger of the two buffer sets
+   if ( cnt > pgpDevice->rxBuffCnt ) {
+      rxQueue = (struct RxBuffer **)kmalloc((cnt+2) * sizeof(struct RxBuffer *),GFP_KERNEL);
+      rxPrioQueue = (struct RxBuffer **)kmalloc((cnt+2) * sizeof(struct RxBuffer *),GFP_KERNEL);
+      for (x=0; x < 8; x++) rxRet[x] = (__u32 *)kmalloc(cnt * sizeof(__u32),GFP_KERNEL);
+      for (x=0; x < 8 && rxRet[x] != NULL; x++);
+      if ( rxQueue == NULL || rxPrioQueue == NULL || x < 8 ) {
+         ret = -ENOMEM;
+         goto cleanup;
+      }
+   }
+
+   // Swap buffer sets
+   PgpCard_PoolFlush(pgpDevice);
+   if ( rxQueue != NULL ) {
+      kfree(pgpDevice->rxQueue);
+      kfree(pgpDevice->rxPrioQueue);
+      pgpDevice->rxQueue     = rxQueue;
+      pgpDevice->rxPrioQueue = rxPrioQueue;
+      for (x=0; x < 8; x++) {
+         kfree(pgpDevice->rxRet[x]);
+         pgpDevice->rxRet[x] = rxRet[x];
+      }
+   }
+   pgpDevice->rxDrvBuffer   = pgpDevice->rxBuffer;
+   pgpDevice->rxDrvCnt      = pgpDevice->rxBuffCnt;
+   pgpDevice->rxDrvSize     = pgpDevice->rxBuffSize;
+   pgpDevice->rxBuffer      = rxUser;
+   pgpDevice->rxBuffCnt     = cnt;
+   pgpDevice->rxBuffSize    = region->bufSize;
+   pgpDevice->rxUserCnt     = cnt;
+   pgpDevice->rxUserPages   = pages;
+   pgpDevice->rxUserPageCnt = npages;
+   PgpCard_PoolPost(pgpDevice);
+
+   // Enable interrupts
+   iowrite32(1,&(pgpDevice->reg->irq));
+   asm("nop");
+
+   region->count = cnt;
+   printk(KERN_INFO"%s: Rx Region: receiving into %i user buffers of %i bytes. Maj=%i\n",MOD_NAME,cnt,region->bufSize,pgpDevice->major);
+   return(SUCCESS);
+
+cleanup:
+   if ( rxUser != NULL ) {
+      for (x=0; x < slots && rxUser[x] != NULL; x++) {
+         pci_unmap_page(pgpDevice->pcidev,rxUser[x]->dma,region->bufSize,PCI_DMA_FROMDEVICE);
+         kfree(rxUser[x]);
+      }
+      kfree(rxUser);
+   }
+   kfree(rxQueue);
+   kfree(rxPrioQueue);
+   for (x=0; x < 8; x++) kfree(rxRet[x]);
+   for (x=0; x < npages; x++) put_page(pages[x]);
+   vfree(pages);
+   return(ret);
+}
+
+// Unmap and unpin the user region and restore the driver RX buffers, poolSem must be held for writing
+// The card must already be stopped.
+static void PgpCard_RxUserFree(struct PgpDevice *pgpDevice) {
+   __u32 idx;
+
+   if ( pgpDevice->rxUserCnt == 0 ) return;
+
+   for ( idx=0; idx < pgpDevice->rxBuffCnt; idx++ ) {
+      pci_unmap_page(pgpDevice->pcidev,pgpDevice->rxBuffer[idx]->dma,pgpDevice->rxBuffSize,PCI_DMA_FROMDEVICE);
+      kfree(pgpDevice->rxBuffer[idx]);
+   }
+   kfree(pgpDevice->rxBuffer);
+
+   for ( idx=0; idx < pgpDevice->rxUserPageCnt; idx++ ) {
+      set_page_dirty_lock(pgpDevice->rxUserPages[idx]);
+      put_page(pgpDevice->rxUserPages[idx]);
+   }
+   vfree(pgpDevice->rxUserPages);
+
+   pgpDevice->rxBuffer      = pgpDevice->rxDrvBuffer;
+   pgpDevice->rxBuffCnt     = pgpDevice->rxDrvCnt;
+   pgpDevice->rxBuffSize    = pgpDevice->rxDrvSize;
+   pgpDevice->rxDrvBuffer   = NULL;
+   pgpDevice->rxUserCnt     = 0;
+   pgpDevice->rxUserPages   = NULL;
+   pgpDevice->rxUserPageCnt = 0;
+}
+
+// Stop receiving into the user region, poolSem must be held for writing
+// Frames not yet taken and buffers still held by the application are dropped.
+static int PgpCard_RxUnregister(struct PgpDevice *pgpDevice) {
+   if ( pgpDevice->rxUserCnt == 0 ) return(SUCCESS);
+   if ( wait_event_timeout(pgpDevice->outq,PgpCard_TxIdle(pgpDevice),POOL_DRAIN_TIMEOUT) == 0 ) return(-EBUSY);
+
+   PgpCard_PoolFlush(pgpDevice);
+   PgpCard_RxUserFree(pgpDevice);
+   PgpCard_PoolPost(pgpDevice);
+
+   // Enable interrupts
+   iowrite32(1,&(pgpDevice->reg->irq));
+   asm("nop");
+   printk(KERN_INFO"%s: Rx Region: released. Maj=%i\n",MOD_NAME,pgpDevice->major);
+   return(SUCCESS);
+}
+
+// Hand the head frame of the user region to the application, poolSem must be held
+static int PgpCard_RxUserRecv(struct PgpDevice *pgpDevice, PgpCardRxDesc *rxDesc) {
+   struct RxBuffer *rxBuffer;
+   __u32           prio;
+
+   if ( pgpDevice->rxUserCnt == 0 ) return(ERROR);
+   if ( (rxBuffer = PgpCard_RxHead(pgpDevice,&prio)) == NULL ) return(-EAGAIN);
+
+   pci_dma_sync_single_for_cpu(pgpDevice->pcidev,rxBuffer->dma,pgpDevice->rxBuffSize,PCI_DMA_FROMDEVICE);
+   rxBuffer->userHeld = 1;
+
+   rxDesc->index     = rxBuffer->index;
+   rxDesc->pad       = 0;
+   rxDesc->offset    = rxBuffer->userOffset;
+   rxDesc->pgpLane   = rxBuffer->lane;
+   rxDesc->pgpVc     = rxBuffer->vc;
+   rxDesc->rxSize    = rxBuffer->length;
+   rxDesc->eofe      = rxBuffer->eofe;
+   rxDesc->fifoErr   = rxBuffer->fifoError;
+   rxDesc->lengthErr = rxBuffer->lengthError;
+   rxDesc->seq       = rxBuffer->seq;
+   rxDesc->gseq      = rxBuffer->gseq;
+
+   PgpCard_RxPop(pgpDevice,prio);
+   return(SUCCESS);
+}
+
+// Give a user region buffer back to the card, poolSem must be held
+static int PgpCard_RxUserReturn(struct PgpDevice *pgpDevice, __u32 index) {
+   unsigned long flags;
+
+   if ( pgpDevice->rxUserCnt == 0 || index >= pgpDevice->rxBuffCnt || ! pgpDevice->rxBuffer[index]->userHeld ) return(ERROR);
+
+   pgpDevice->rxBuffer[index]->userHeld = 0;
+   pci_dma_sync_single_for_device(pgpDevice->pcidev,pgpDevice->rxBuffer[index]->dma,pgpDevice->rxBuffSize,PCI_DMA_FROMDEVICE);
+
+   spin_lock_irqsave(&(pgpDevice->rxLock),flags);
+   PgpCard_RxReturn(pgpDevice,pgpDevice->rxBuffer[index]);
+   spin_unlock_irqrestore(&(pgpDevice->rxLock),flags);
+   return(SUCCESS);
+}
+
+// Take the pipe reference for an RX buffer, the module stays loaded while pipes hold its buffers
+static void PgpCard_SpliceHold(struct PgpDevice *pgpDevice) {
+   __module_get(THIS_MODULE);
+   atomic_inc(&(pgpDevice->rxSpliced));
+}
+
+// Drop a splice reference, the buffer goes back to the card when the last pipe releases it
+// If the device was removed in the meantime the last buffer released frees the orphaned pools.
+static void PgpCard_SpliceUnref(struct RxBuffer *rxBuffer) {
+   unsigned long flags;
+   __u32         orphan;
+
+   struct PgpDevice *pgpDevice = rxBuffer->pgpDevice;
+
+   // The last reference is dropped under rxLock so that a watchdog reclaim sees the buffer either
+   // held by the pipe or in the returns
+   spin_lock_irqsave(&(pgpDevice->rxLock),flags);
+   if ( ! atomic_dec_and_test(&(rxBuffer->spliceRef)) ) {
+      spin_unlock_irqrestore(&(pgpDevice->rxLock),flags);
+      return;
+   }
+   if ( ! pgpDevice->rxOrphan ) PgpCard_RxReturn(pgpDevice,rxBuffer);
+   orphan = atomic_dec_and_test(&(pgpDevice->rxSpliced)) && pgpDevice->rxOrphan;
+   spin_unlock_irqrestore(&(pgpDevice->rxLock),flags);
+
+   if ( orphan ) {
+      PgpCard_PoolFree(pgpDevice);
+      pci_dev_put(pgpDevice->pcidev);
+      printk(KERN_INFO"%s: Pool: orphaned pools released. Maj=%i\n",MOD_NAME,pgpDevice->major);
+      pgpDevice->rxOrphan = 0;
+   }
+   module_put(THIS_MODULE);
+}
+
+// Pipe buffer release, header pages are owned by the pipe buffer
+static void PgpCard_PipeRelease(struct pipe_inode_info *pipe, struct pipe_buffer *buf) {
+   if ( buf->private != 0 ) PgpCard_SpliceUnref((struct RxBuffer *)buf->private);
+   else put_page(buf->page);
+}
+
+// Pipe buffer duplicate, used by tee()
+static void PgpCard_PipeGet(struct pipe_inode_info *pipe, struct pipe_buffer *buf) {
+   if ( buf->private != 0 ) atomic_inc(&(((struct RxBuffer *)buf->private)->spliceRef));
+   else get_page(buf->page);
+}
+
+// DMA buffer pages can not be stolen
+static int PgpCard_PipeSteal(struct pipe_inode_info *pipe, struct pipe_buffer *buf) {
+   return(1);
+}
+
+// Release pages that did not make it into the pipe
+static void PgpCard_SpliceRelease(struct splice_pipe_desc *spd, unsigned int i) {
+   if ( spd->partial[i].private != 0 ) PgpCard_SpliceUnref((struct RxBuffer *)spd->partial[i].private);
+   else put_page(spd->pages[i]);
+}
+
+// Splice the head frame into a pipe, preceded by a PgpCardSpliceHdr
+// Pages of the RX buffer are handed to the pipe directly. A frame larger than the pipe
+// is continued by the next call, the buffer is returned to the card once every pipe
+// buffer referencing it has been released.
+static ssize_t PgpCard_SpliceRead(struct file *filp, loff_t *ppos, struct pipe_inode_info *pipe, size_t len, unsigned int flags) {
+   struct page             *pages[PIPE_BUFFERS];
+   struct partial_page     partial[PIPE_BUFFERS];
+   struct splice_pipe_desc spd;
+   struct RxBuffer         *rxBuffer;
+   PgpCardSpliceHdr        *hdr;
+   __u32                   prio;
+   __u32                   dataLen;
+   __u32                   off;
+   __u32                   chunk;
+   __u32                   total;
+   __u32                   drop;
+   unsigned long           irqFlags;
+   ssize_t                 ret;
+
+   struct PgpFile   *pgpFile   = (struct PgpFile *)filp->private_data;
+   struct PgpDevice *pgpDevice = pgpFile->pgpDevice;
+
+   down_read(&(pgpDevice->poolSem));
+   if ( ! pgpDevice->poolReady || pgpDevice->bypass || pgpDevice->rxUserCnt || pgpDevice->rxRing != NULL ) {
+      up_read(&(pgpDevice->poolSem));
+      return(pgpDevice->poolReady ? -EBUSY : ERROR);
+   }
+
+   // No data is ready
+   mutex_lock(&(pgpDevice->rxReadLock));
+next:
+   while ( (rxBuffer = PgpCard_RxHead(pgpDevice,&prio)) == NULL ) {
+      mutex_unlock(&(pgpDevice->rxReadLock));
+      up_read(&(pgpDevice->poolSem));
+      if ( (filp->f_flags & O_NONBLOCK) || (flags & SPLICE_F_NONBLOCK) ) return(-EAGAIN);
+      if (wait_event_interruptible(pgpDevice->inq,(PgpCard_RxDepth(pgpDevice) > 0))) return (-ERESTARTSYS);
+      down_read(&(pgpDevice->poolSem));
+      if ( ! pgpDevice->poolReady || pgpDevice->bypass || pgpDevice->rxUserCnt || pgpDevice->rxRing != NULL ) {
+         up_read(&(pgpDevice->poolSem));
+         return(pgpDevice->poolReady ? -EBUSY : ERROR);
+      }
+      mutex_lock(&(pgpDevice->rxReadLock));
+   }
+
+   // Errored frame this file does not want, a frame already partly in a pipe is finished as started
+   if ( pgpDevice->rxSpliceOff == 0 ) {
+      spin_lock_irqsave(&(pgpDevice->rxLock),irqFlags);
+      drop = PgpCard_RxErrDrop(pgpDevice,rxBuffer,pgpFile->rxErrMode);
+      spin_unlock_irqrestore(&(pgpDevice->rxLock),irqFlags);
+      if ( drop ) {
+         PgpCard_RxPop(pgpDevice,prio);
+         goto next;
+      }
+   }
+
+   if ( pgpDevice->rxSpliceOff == 0 && (rxBuffer->eofe | rxBuffer->fifoError | rxBuffer->lengthError) &&
+        pgpFile->rxErrMode == PGP_RX_ERR_META ) dataLen = 0;
+   else dataLen = rxBuffer->length * 4;
+
+   spd.pages       = pages;
+   spd.partial     = partial;
+   spd.nr_pages    = 0;
+   spd.flags       = flags;
+   spd.ops         = &PgpCard_PipeOps;
+   spd.spd_release = PgpCard_SpliceRelease;
+
+   // Start of frame, the queue holds a reference until the whole frame is spliced
+   if ( pgpDevice->rxSpliceOff == 0 ) {
+      if ( (pages[0] = alloc_page(GFP_KERNEL)) == NULL ) {
+         mutex_unlock(&(pgpDevice->rxReadLock));
+         up_read(&(pgpDevice->poolSem));
+         return(-ENOMEM);
+      }
+      hdr = (PgpCardSpliceHdr *)page_address(pages[0]);
+      hdr->pgpLane   = rxBuffer->lane;
+      hdr->pgpVc     = rxBuffer->vc;
+      hdr->rxSize    = rxBuffer->length;
+      hdr->dataSize  = dataLen / 4;
+      hdr->eofe      = rxBuffer->eofe;
+      hdr->fifoErr   = rxBuffer->fifoError;
+      hdr->lengthErr = rxBuffer->lengthError;
+
+      partial[0].offset  = 0;
+      partial[0].len     = sizeof(PgpCardSpliceHdr);
+      partial[0].private = 0;
+      spd.nr_pages = 1;
+      total        = sizeof(PgpCardSpliceHdr);
+      off          = 0;
+
+      atomic_set(&(rxBuffer->spliceRef),1);
+      PgpCard_SpliceHold(pgpDevice);
+      pgpDevice->rxSplicePrio = prio;
+   }
+   else {
+      total = 0;
+      off   = pgpDevice->rxSpliceOff - sizeof(PgpCardSpliceHdr);
+   }
+
+   // Payload pages
+   while ( off < dataLen && spd.nr_pages < PIPE_BUFFERS && total < len ) {
+      chunk = PAGE_SIZE - (off % PAGE_SIZE);
+      if ( chunk > (dataLen - off) ) chunk = dataLen - off;
+      if ( chunk > (len - total) ) chunk = len - total;
+
+      pages[spd.nr_pages]           = virt_to_page(rxBuffer->buffer + off);
+      partial[spd.nr_pages].offset  = off % PAGE_SIZE;
+      partial[spd.nr_pages].len     = chunk;
+      partial[spd.nr_pages].private = (unsigned long)rxBuffer;
+      atomic_inc(&(rxBuffer->spliceRef));
+      spd.nr_pages++;
+      off   += chunk;
+      total += chunk;
+   }
+
+   ret = splice_to_pipe(pipe,&spd);
+   if ( ret > 0 ) pgpDevice->rxSpliceOff += ret;
+
+   // Nothing of a new frame went out, drop the queue reference again
+   if ( pgpDevice->rxSpliceOff == 0 ) {
+      atomic_set(&(rxBuffer->spliceRef),0);
+      atomic_dec(&(pgpDevice->rxSpliced));
+      module_put(THIS_MODULE);
+   }
+
+   // Whole frame is in the pipe
+   else if ( pgpDevice->rxSpliceOff == (sizeof(PgpCardSpliceHdr) + dataLen) ) {
+      pgpDevice->rxSpliceOff = 0;
+      PgpCard_RxPop(pgpDevice,prio);
+      PgpCard_SpliceUnref(rxBuffer);
+   }
+
+   mutex_unlock(&(pgpDevice->rxReadLock));
+   up_read(&(pgpDevice->poolSem));
+   return(ret);
+}
+
+// Take a free TX buffer for a lane
+// Returns NULL when no buffers are free or the lane is at its quota
+static struct TxBuffer *PgpCard_TxAcquire(struct PgpDevice *pgpDevice, __u32 lane) {
+   unsigned long    flags;
+   struct TxBuffer *txBuffer = NULL;
+
+   spin_lock_irqsave(&(pgpDevice->txLock),flags);
+   if ( pgpDevice->txRead != pgpDevice->txWrite && pgpDevice->txLaneCnt[lane] < pgpDevice->txLaneQuota ) {
+      txBuffer = pgpDevice->txQueue[pgpDevice->txRead];
+      txBuffer->lane = lane;
+      pgpDevice->txLaneCnt[lane]++;
+      pgpDevice->txRead = (pgpDevice->txRead + 1) % (pgpDevice->txBuffCnt+2);
+   }
+   spin_unlock_irqrestore(&(pgpDevice->txLock),flags);
+   return(txBuffer);
+}
+
+// Returns non zero if any lane in laneMask could acquire a TX buffer
+static __u32 PgpCard_TxAvail(struct PgpDevice *pgpDevice, __u32 laneMask) {
+   __u32 x;
+
+   if ( pgpDevice->txRead == pgpDevice->txWrite ) return(0);
+   for (x=0; x < 8; x++) {
+      if ( ((laneMask >> x) & 0x1) && pgpDevice->txLaneCnt[x] < pgpDevice->txLaneQuota ) return(1);
+   }
+   return(0);
+}
+
+// Return a TX buffer to the free queue, txLock must be held
+static void PgpCard_TxRelease(struct PgpDevice *pgpDevice, struct TxBuffer *txBuffer) {
+   __u32 next;
+   __u32 x;
+
+   txBuffer->posted = 0;
+
+   // Zero copy frame, unpin the user pages and report the address
+   if ( txBuffer->zeroCopy ) {
+      pci_unmap_page(pgpDevice->pcidev,txBuffer->dma,txBuffer->length*4,PCI_DMA_TODEVICE);
+      for (x=0; x < txBuffer->npages; x++) put_page(txBuffer->pages[x]);
+      kfree(txBuffer->pages);
+      txBuffer->pages = NULL;
+      PgpCard_TxZcDone(pgpDevice,txBuffer->userAddr);
+      PgpCard_TxZcCancel(pgpDevice,txBuffer);
+      return;
+   }
+
+   next = (pgpDevice->txWrite+1) % (pgpDevice->txBuffCnt+2);
+   if ( next == pgpDevice->txRead ) printk(KERN_WARNING"%s: Tx queue pointer collision. Maj=%i\n",MOD_NAME,pgpDevice->major);
+   pgpDevice->txQueue[pgpDevice->txWrite] = txBuffer;
+   pgpDevice->txWrite = next;
+   if ( pgpDevice->txLaneCnt[txBuffer->lane] > 0 ) pgpDevice->txLaneCnt[txBuffer->lane]--;
+}
+
+// Take a zero copy slot for a lane and reserve a done ring entry
+// full is set when the done ring has no entry left, the user must collect completions first.
+static struct TxBuffer *PgpCard_TxZcAcquire(struct PgpDevice *pgpDevice, __u32 lane, __u32 *full) {
+   struct TxBuffer *txBuffer = NULL;
+   unsigned long   flags;
+   __u32           x;
+
+   spin_lock_irqsave(&(pgpDevice->txLock),flags);
+   *full = (pgpDevice->txZcUsed >= TX_ZC_DONE_CNT);
+   if ( pgpDevice->txZcFree != 0 && pgpDevice->txLaneCnt[lane] < pgpDevice->txLaneQuota && pgpDevice->txZcUsed < TX_ZC_DONE_CNT ) {
+      for (x=0; ((pgpDevice->txZcFree >> x) & 0x1) == 0; x++);
+      pgpDevice->txZcFree &= ~(1 << x);
+      txBuffer = &(pgpDevice->txZc[x]);
+      txBuffer->zeroCopy = 1;
+      txBuffer->lane     = lane;
+      pgpDevice->txLaneCnt[lane]++;
+      pgpDevice->txZcUsed++;
+   }
+   spin_unlock_irqrestore(&(pgpDevice->txLock),flags);
+   return(txBuffer);
+}
+
+// Returns non zero if a zero copy slot could be taken for the lane
+static __u32 PgpCard_TxZcAvail(struct PgpDevice *pgpDevice, __u32 lane) {
+   return(pgpDevice->txZcFree != 0 && pgpDevice->txLaneCnt[lane] < pgpDevice->txLaneQuota);
+}
+
+// Pin and map the user frame, returns ERROR when the card can not reach it in one descriptor
+// The frame must be dword aligned, physically contiguous and below 4GB.
+static int PgpCard_TxZcMap(struct PgpDevice *pgpDevice, struct TxBuffer *txBuffer, PgpCardTx *pgpCardTx) {
+   unsigned long addr = (unsigned long)pgpCardTx->data;
+   unsigned long len  = pgpCardTx->size * 4;
+   struct page   **pages;
+   dma_addr_t    dma;
+   __u32         npages;
+   __u32         x;
+   int           got;
+
+   npages = ((addr & ~PAGE_MASK) + len + PAGE_SIZE - 1) >> PAGE_SHIFT;
+   if ( (addr & 0x3) != 0 || len == 0 ) return(ERROR);
+   if ( (pages = (struct page **)kmalloc(npages * sizeof(struct page *),GFP_KERNEL)) == NULL ) return(ERROR);
+
+   down_read(&(current->mm->mmap_sem));
+   got = get_user_pages(current,current->mm,addr & PAGE_MASK,npages,0,0,pages,NULL);
+   up_read(&(current->mm->mmap_sem));
+   if ( got < (int)npages ) goto unpin;
+
+   for (x=1; x < npages && page_to_pfn(pages[x]) == page_to_pfn(pages[0])+x; x++);
+   if ( x < npages ) goto unpin;
+
+   dma = pci_map_page(pgpDevice->pcidev,pages[0],addr & ~PAGE_MASK,len,PCI_DMA_TODEVICE);
+   if ( ((__u64)dma + len) > 0x100000000ULL ) {
+      pci_unmap_page(pgpDevice->pcidev,dma,len,PCI_DMA_TODEVICE);
+      goto unpin;
+   }
+
+   txBuffer->dma      = dma;
+   txBuffer->buffer   = NULL;
+   txBuffer->pages    = pages;
+   txBuffer->npages   = npages;
+   txBuffer->userAddr = addr;
+   txBuffer->vc       = pgpCardTx->pgpVc;
+   txBuffer->length   = pgpCardTx->size;
+   return(SUCCESS);
+
+unpin:
+   for (x=0; got > 0 && x < got; x++) put_page(pages[x]);
+   kfree(pages);
+   return(ERROR);
+}
+
+// Free a zero copy slot, txLock must be held. The done ring reservation is kept.
+static void PgpCard_TxZcCancel(struct PgpDevice *pgpDevice, struct TxBuffer *txBuffer) {
+   pgpDevice->txZcFree |= (1 << (txBuffer - pgpDevice->txZc));
+   if ( pgpDevice->txLaneCnt[txBuffer->lane] > 0 ) pgpDevice->txLaneCnt[txBuffer->lane]--;
+}
+
+// Report a zero copy user buffer as free, txLock must be held
+static void PgpCard_TxZcDone(struct PgpDevice *pgpDevice, __u64 userAddr) {
+   pgpDevice->txZcDone[pgpDevice->txZcDoneWrite % TX_ZC_DONE_CNT] = userAddr;
+   pgpDevice->txZcDoneWrite++;
+}
+
+// Drop a done ring reservation that will not be used
+static void PgpCard_TxZcUnreserve(struct PgpDevice *pgpDevice) {
+   unsigned long flags;
+
+   spin_lock_irqsave(&(pgpDevice->txLock),flags);
+   if ( pgpDevice->txZcUsed > 0 ) pgpDevice->txZcUsed--;
+   spin_unlock_irqrestore(&(pgpDevice->txLock),flags);
+}
+
+// Find an in flight zero copy frame by bus address, txLock must be held
+static struct TxBuffer *PgpCard_TxZcFind(struct PgpDevice *pgpDevice, __u32 dma) {
+   __u32 x;
+
+   for (x=0; x < TX_ZC_SLOTS; x++) {
+      if ( ((pgpDevice->txZcFree >> x) & 0x1) == 0 && pgpDevice->txZc[x].dma == dma ) return(&(pgpDevice->txZc[x]));
+   }
+   return(NULL);
+}
+
+// Add a filled TX buffer to its lane's pending queue and run the scheduler
+static void PgpCard_TxPost(struct PgpDevice *pgpDevice, struct TxBuffer *txBuffer) {
+   unsigned long flags;
+   __u32         lane = txBuffer->lane;
+
+   spin_lock_irqsave(&(pgpDevice->txLock),flags);
+   pgpDevice->txPend[lane][pgpDevice->txPendWrite[lane]] = txBuffer;
+   pgpDevice->txPendWrite[lane] = (pgpDevice->txPendWrite[lane] + 1) % (pgpDevice->txBuffCnt+1);
+   PgpCard_TxSchedule(pgpDevice);
+   spin_unlock_irqrestore(&(pgpDevice->txLock),flags);
+}
+
+// Deficit round robin over the lane pending queues, txLock must be held
+// Lanes whose hardware fifo is almost full or holds txFifoThresh descriptors are
+// skipped so that one backlogged lane does not delay descriptors for the others.
+static void PgpCard_TxSchedule(struct PgpDevice *pgpDevice) {
+   struct TxBuffer *txBuffer;
+   __u32 room[8];
+   __u32 aFull;
+   __u32 fifoCnt;
+   __u32 descA;
+   __u32 active;
+   __u32 lane;
+   __u32 x;
+
+   // Room in each lane's hardware fifo, only lanes with pending buffers are checked
+   aFull  = ioread32(&(pgpDevice->reg->txStat[0]));
+   active = 0;
+   for (x=0; x < 8; x++) {
+      room[x] = 0;
+      if ( pgpDevice->txPendRead[x] == pgpDevice->txPendWrite[x] ) {
+         pgpDevice->txLaneDeficit[x] = 0;
+         continue;
+      }
+      if ( (aFull >> x) & 0x1 ) continue;
+      if ( pgpDevice->txFifoThresh == 0 ) room[x] = pgpDevice->txBuffCnt;
+      else {
+         fifoCnt = ioread32(&(pgpDevice->reg->txFifoCnt[x]));
+         if ( fifoCnt < pgpDevice->txFifoThresh ) room[x] = pgpDevice->txFifoThresh - fifoCnt;
+      }
+      if ( room[x] > 0 ) active++;
+   }
+
+   // Each round adds a quantum to every active lane and posts while the deficit covers the head frame
+   while ( active > 0 ) {
+      active = 0;
+      for (x=0; x < 8; x++) {
+         lane = (pgpDevice->txSched + x) % 8;
+         if ( room[lane] == 0 || pgpDevice->txPendRead[lane] == pgpDevice->txPendWrite[lane] ) continue;
+
+         pgpDevice->txLaneDeficit[lane] += TX_SCHED_QUANTUM * pgpDevice->txLaneWeight[lane];
+         if ( pgpDevice->txLaneDeficit[lane] > TX_SCHED_DEF_MAX ) pgpDevice->txLaneDeficit[lane] = TX_SCHED_DEF_MAX;
+
+         while ( room[lane] > 0 && pgpDevice->txPendRead[lane] != pgpDevice->txPendWrite[lane] ) {
+            txBuffer = pgpDevice->txPend[lane][pgpDevice->txPendRead[lane]];
+            if ( txBuffer->length > pgpDevice->txLaneDeficit[lane] ) break;
+
+            pgpDevice->txLaneDeficit[lane] -= txBuffer->length;
+            pgpDevice->txPendRead[lane] = (pgpDevice->txPendRead[lane] + 1) % (pgpDevice->txBuffCnt+1);
+            room[lane]--;
+
+            // Generate Tx descriptor
+            descA  = (lane         << 27) & 0xF8000000; // Bits 31:27 = Lane
+            descA += (txBuffer->vc << 24) & 0x07000000; // Bits 26:24 = VC
+            descA += (txBuffer->length  ) & 0x00FFFFFF; // Bits 23:00 = Length
+
+            // Write descriptor
+            iowrite32(descA,&(pgpDevice->reg->txWrA[lane]));
+            asm("nop");
+            iowrite32(txBuffer->dma,&(pgpDevice->reg->txWrB[lane]));
+            asm("nop");
+            txBuffer->posted   = 1;
+            txBuffer->postTime = jiffies;
+         }
+
+         if ( pgpDevice->txPendRead[lane] == pgpDevice->txPendWrite[lane] ) pgpDevice->txLaneDeficit[lane] = 0;
+         else if ( room[lane] > 0 ) active++;
+      }
+   }
+   pgpDevice->txSched = (pgpDevice->txSched + 1) % 8;
+}
+
+// Return TX buffers the card has finished with to the free queue
+// Called by the interrupt handler and by writers that find no free buffer, so that a delayed
+// interrupt does not hold up TX. txLock keeps the two from interleaving the completion fifo.
+// Returns the number of buffers released.
+static __u32 PgpCard_TxReap(struct PgpDevice *pgpDevice) {
+   unsigned long    flags;
+   struct TxBuffer *txBuffer;
+   __u32            stat;
+   __u32            idx;
+   __u32            cnt = 0;
+
+   spin_lock_irqsave(&(pgpDevice->txLock),flags);
+
+   // Read Tx completion status
+   stat = ioread32(&(pgpDevice->reg->txStat[1]));
+   asm("nop");
+
+   // Tx Data is ready
+   if ( (stat & 0x80000000) != 0 ) {
+
+      do {
+
+         // Read dma value
+         stat = ioread32(&(pgpDevice->reg->txRead));
+         asm("nop");
+
+         if( (stat & 0x1) == 0x1 ) {
+
+            if ( pgpDevice->debug > 0 ) printk(KERN_DEBUG"%s: Irq: Return TX Status Value %.8x. Maj=%i\n",MOD_NAME,stat,pgpDevice->major);
+
+            // Find TX buffer entry
+            for ( idx=0; idx < pgpDevice->txBuffCnt; idx++ ) {
+               if ( pgpDevice->txBuffer[idx]->dma == (stat & 0xFFFFFFFC) ) break;
+            }
+
+            // Entry was found, return to queue
+            if ( idx < pgpDevice->txBuffCnt ) txBuffer = pgpDevice->txBuffer[idx];
+            else txBuffer = PgpCard_TxZcFind(pgpDevice,(stat & 0xFFFFFFFC));
+            if ( txBuffer != NULL && ! txBuffer->posted ) pgpDevice->dogLateDone++;
+            else if ( txBuffer != NULL ) {
+               PgpCard_TxRelease(pgpDevice,txBuffer);
+               cnt++;
+            }
+            else printk(KERN_WARNING"%s: Irq: Failed to locate TX descriptor %.8x. Maj=%i\n",MOD_NAME,(__u32)(stat&0xFFFFFFFC),pgpDevice->major);
+         }
+
+      // Repeat while next valid flag is set
+      } while ( (stat & 0x1) == 0x1 );
+
+      // Lane fifos have drained, post held back descriptors
+      if ( cnt > 0 ) PgpCard_TxSchedule(pgpDevice);
+   }
+
+   // Not called from the interrupt handler
+   if ( cnt > 0 && ! in_irq() ) pgpDevice->txReaped += cnt;
+   spin_unlock_irqrestore(&(pgpDevice->txLock),flags);
+
+   // Wake up any writers
+   if ( cnt > 0 ) wake_up_interruptible(&(pgpDevice->outq));
+   return(cnt);
+}
+
+// IRQ Handler
+static irqreturn_t PgpCard_IRQHandler(int irq, void *dev_id, struct pt_regs *regs) {
+   __u32        stat;
+   __u32        descA;
+   __u32        descB;
+   __u32        idx;
+   __u32        next;
+   __u32        drop;
+   __u32        grouped;
+   __u32        lane;
+   __u32        seq  = 0;
+   __u32        gseq = 0;
+   irqreturn_t ret;
+
+   struct PgpDevice *pgpDevice = (struct PgpDevice *)dev_id;
+
+   // Completions are polled from user space
+   if ( pgpDevice->bypass ) return(IRQ_NONE);
+
+   // Read IRQ Status
+   stat = ioread32(&(pgpDevice->reg->irq));
+   asm("nop");   
+
+   // Is this the source
+   if ( (stat & 0x2) != 0 ) {
+
+      if ( pgpDevice->debug > 0 ) printk(KERN_DEBUG"%s: Irq: IRQ Called. Maj=%i\n", MOD_NAME,pgpDevice->major);
+
+      // Disable interrupts
+      iowrite32(0,&(pgpDevice->reg->irq));
+      asm("nop");
+
+      // Tx completions
+      PgpCard_TxReap(pgpDevice);
+
+      // Read Rx completion status
+      stat = ioread32(&(pgpDevice->reg->rxStatus));
+      asm("nop");
+
+      // Data is ready
+      if ( (stat & 0x80000000) != 0 ) {
+
+         do {
+            
+            // Read descriptor
+            descA = ioread32(&(pgpDevice->reg->rxRead[0]));
+            asm("nop");
+            descB = ioread32(&(pgpDevice->reg->rxRead[1]));
+            asm("nop");
+            
             if( (descB & 0x1) == 0x1 ) {            
             
                // Find RX buffer entry
@@ -991,8 +4490,36 @@ static irqreturn_t PgpCard_IRQHandler(int irq, void *dev_id, struct pt_regs *reg
                // Entry was found
                if ( idx < pgpDevice->rxBuffCnt ) {
 
-                  // Drop data if device is not open
-                  if ( pgpDevice->isOpen ) {
+                  // Buffer has left the lane free list
+                  spin_lock(&(pgpDevice->rxLock));
+                  pgpDevice->rxLaneFree[(descA >> 26) & 0x7]--;
+                  pgpDevice->rxLaneLast[(descA >> 26) & 0x7] = jiffies;
+                  spin_unlock(&(pgpDevice->rxLock));
+
+                  // Drop data if device is not open or the lane/VC is filtered out
+                  drop = ! pgpDevice->isOpen;
+                  if ( ! drop && ((pgpDevice->rxFilter >> ((descA >> 24) & 0x1F)) & 0x1) == 0 ) {
+                     pgpDevice->rxFiltered[(descA >> 24) & 0x1F]++;
+                     drop = 1;
+                  }
+
+                  // Number the frame, a frame dropped from here on leaves a gap in its lane/VC sequence
+                  if ( ! drop ) {
+                     seq  = pgpDevice->rxSeq[(descA >> 24) & 0x1F]++;
+                     gseq = pgpDevice->rxGlobalSeq++;
+                  }
+
+                  // Errored frame, dropped here when every open file drops them
+                  if ( ! drop && ((descA & 0xC0000000) != 0 || (descB & 0x2) != 0) ) {
+                     pgpDevice->rxErrors[(descA >> 26) & 0x7]++;
+                     if ( pgpDevice->rxErrDrop ) {
+                        pgpDevice->rxErrDropped[(descA >> 26) & 0x7]++;
+                        pgpDevice->rxSeqDrops[(descA >> 24) & 0x1F]++;
+                        drop = 1;
+                     }
+                  }
+
+                  if ( ! drop ) {
 
                      // Setup descriptor
                      pgpDevice->rxBuffer[idx]->fifoError   = (descA & 0x80000000) >> 31;// Bits 31    = fifoError
@@ -1001,6 +4528,9 @@ static irqreturn_t PgpCard_IRQHandler(int irq, void *dev_id, struct pt_regs *reg
                      pgpDevice->rxBuffer[idx]->vc          = (descA & 0x03000000) >> 24;// Bits 25:24 = VC
                      pgpDevice->rxBuffer[idx]->length      = (descA & 0x00FFFFFF) >> 0; // Bits 23:00 = Length
                      pgpDevice->rxBuffer[idx]->lengthError = (descB & 0x00000002) >> 1; // Legacy Unused bit
+                     pgpDevice->rxBuffer[idx]->seq         = seq;
+                     pgpDevice->rxBuffer[idx]->gseq        = gseq;
+                     PgpCard_RxSyncCpu(pgpDevice,pgpDevice->rxBuffer[idx],pgpDevice->rxBuffer[idx]->length*4);
                      
                      if ( pgpDevice->debug > 0 ) {
                         printk(KERN_DEBUG "%s: Irq: Rx Words=%i, Lane=%i, VC=%i, Eofe=%i, FifoErr=%i, LengthErr=%i, Addr=%p, Map=%p\n",
@@ -1009,20 +4539,46 @@ static irqreturn_t PgpCard_IRQHandler(int irq, void *dev_id, struct pt_regs *reg
                            (pgpDevice->rxBuffer[idx]->buffer), (void*)(pgpDevice->rxBuffer[idx]->dma));
                      }
 
-                     // Return to Queue
-                     next = (pgpDevice->rxWrite+1) % (pgpDevice->rxBuffCnt+2);
-                     if ( next == pgpDevice->rxRead ) printk(KERN_WARNING"%s: Irq: Rx queue pointer collision. Maj=%i\n",MOD_NAME,pgpDevice->major);
-                     pgpDevice->rxQueue[pgpDevice->rxWrite] = pgpDevice->rxBuffer[idx];
-                     pgpDevice->rxWrite = next;
+                     // Consumer group member for the lane/VC, otherwise the shared queue
+                     // The lane pauses once it holds rxHighWater undelivered or unreturned frames
+                     spin_lock(&(pgpDevice->rxLock));
+                     grouped = PgpCard_GroupPush(pgpDevice,pgpDevice->rxBuffer[idx]);
+                     lane    = pgpDevice->rxBuffer[idx]->lane;
+                     pgpDevice->rxLaneHeld[lane]++;
+                     if ( pgpDevice->rxHighWater != 0 && pgpDevice->rxLaneHeld[lane] >= pgpDevice->rxHighWater &&
+                          ((pgpDevice->rxPauseAuto >> lane) & 0x1) == 0 )
+                        PgpCard_RxPauseSet(pgpDevice,pgpDevice->rxPauseUser,pgpDevice->rxPauseAuto | (1 << lane));
+                     spin_unlock(&(pgpDevice->rxLock));
+
+                     // Return to Queue, priority lanes/VCs to their own queue
+                     if ( ! grouped && ((pgpDevice->rxPrioMask >> ((descA >> 24) & 0x1F)) & 0x1) ) {
+                        next = (pgpDevice->rxPrioWrite+1) % (pgpDevice->rxBuffCnt+2);
+                        if ( next == pgpDevice->rxPrioRead ) printk(KERN_WARNING"%s: Irq: Rx priority queue pointer collision. Maj=%i\n",MOD_NAME,pgpDevice->major);
+                        pgpDevice->rxPrioQueue[pgpDevice->rxPrioWrite] = pgpDevice->rxBuffer[idx];
+                        pgpDevice->rxPrioWrite = next;
+                        pgpDevice->rxPrioFrames++;
+                     }
+                     else if ( ! grouped ) {
+                        next = (pgpDevice->rxWrite+1) % (pgpDevice->rxBuffCnt+2);
+                        if ( next == pgpDevice->rxRead ) printk(KERN_WARNING"%s: Irq: Rx queue pointer collision. Maj=%i\n",MOD_NAME,pgpDevice->major);
+                        pgpDevice->rxQueue[pgpDevice->rxWrite] = pgpDevice->rxBuffer[idx];
+                        pgpDevice->rxWrite = next;
+                     }
+
+                     // Shared ring copies the frame out of line
+                     if ( ! grouped && pgpDevice->rxRing != NULL ) schedule_delayed_work(&(pgpDevice->rxRingWork),0);
 
                      // Wake up any readers
                      wake_up_interruptible(&(pgpDevice->inq));
                   }
                   
-                  // Return entry to FPGA if device is not open
+                  // Return entry to FPGA
                   else {
+                     spin_lock(&(pgpDevice->rxLock));
                      iowrite32((descB & 0xFFFFFFFC), &(pgpDevice->reg->rxFree[(descA >> 26) & 0x7]));
                      asm("nop");
+                     pgpDevice->rxLaneFree[(descA >> 26) & 0x7]++;
+                     spin_unlock(&(pgpDevice->rxLock));
                   }
 
                } else printk(KERN_WARNING "%s: Irq: Failed to locate RX descriptor %.8x. Maj=%i\n",MOD_NAME,(__u32)(descA&0xFFFFFFFC),pgpDevice->major);
@@ -1047,16 +4603,32 @@ static __u32 PgpCard_Poll(struct file *filp, poll_table *wait ) {
    __u32 readOk  = 0;
    __u32 writeOk = 0;
 
-   struct PgpDevice *pgpDevice = (struct PgpDevice *)filp->private_data;
+   struct PgpFile   *pgpFile   = (struct PgpFile *)filp->private_data;
+   struct PgpDevice *pgpDevice = pgpFile->pgpDevice;
+
+   // A polling file is told about link state changes
+   if ( ! pgpFile->stateWatch ) PgpCard_StateWatch(pgpDevice,pgpFile,1);
 
    poll_wait(filp,&(pgpDevice->inq),wait);
    poll_wait(filp,&(pgpDevice->outq),wait);
 
-   if ( pgpDevice->rxWrite != pgpDevice->rxRead ) {
+   // Link state changes are reported in every mode
+   if ( pgpDevice->stateEventRead != pgpDevice->stateEventWrite ) mask |= POLLPRI;
+
+   if ( pgpDevice->bypass ) return(mask);
+
+   // Shared ring is readable while the application has records left to consume
+   down_read(&(pgpDevice->poolSem));
+   if ( pgpDevice->rxRing != NULL && ! PgpCard_GroupMember(pgpDevice,filp) )
+      readOk = (pgpDevice->rxRingHead != ACCESS_ONCE(pgpDevice->rxRingHdr->tail));
+   else readOk = PgpCard_RxReady(pgpDevice,filp);
+   up_read(&(pgpDevice->poolSem));
+
+   if ( readOk ) {
       mask |= POLLIN | POLLRDNORM; // Readable
       readOk = 1;
    }
-   if ( pgpDevice->txWrite != pgpDevice->txRead ) {
+   if ( PgpCard_TxAvail(pgpDevice,pgpDevice->txPollMask) ) {
       mask |= POLLOUT | POLLWRNORM; // Writable
       writeOk = 1;
    }
@@ -1067,7 +4639,7 @@ static __u32 PgpCard_Poll(struct file *filp, poll_table *wait ) {
 
 // Probe device
 static int PgpCard_Probe(struct pci_dev *pcidev, const struct pci_device_id *dev_id) {
-   int i, res, idx;
+   int i, res;
    dev_t chrdev = 0;
    struct PgpDevice *pgpDevice;
    struct pci_device_id *id = (struct pci_device_id *) dev_id;
@@ -1077,7 +4649,7 @@ static int PgpCard_Probe(struct pci_dev *pcidev, const struct pci_device_id *dev
 
    // Find empty structure
    for (i = 0; i < MAX_PCI_DEVICES; i++) {
-      if (gPgpDevices[i].baseHdwr == 0) {
+      if (gPgpDevices[i].baseHdwr == 0 && gPgpDevices[i].rxOrphan == 0) {
          id->driver_data = i;
          break;
       }
@@ -1106,6 +4678,150 @@ static int PgpCard_Probe(struct pci_dev *pcidev, const struct pci_device_id *dev
    pgpDevice->cdev.ops      = &PgpCard_Intf;
    pgpDevice->debug         = 0;
    pgpDevice->isOpen        = 0;
+   pgpDevice->pcidev        = pcidev;
+   init_rwsem(&pgpDevice->poolSem);
+   INIT_LIST_HEAD(&pgpDevice->files);
+
+   // Accept all lanes and VCs
+   pgpDevice->rxFilter = 0xFFFFFFFF;
+   memset(pgpDevice->rxFiltered,0,sizeof(pgpDevice->rxFiltered));
+
+   // Frame sequences start at zero
+   memset(pgpDevice->rxSeq,0,sizeof(pgpDevice->rxSeq));
+   memset(pgpDevice->rxSeqDrops,0,sizeof(pgpDevice->rxSeqDrops));
+   pgpDevice->rxGlobalSeq  = 0;
+
+   // No strict priority lanes/VCs
+   pgpDevice->rxPrioMask   = 0;
+   pgpDevice->rxPrioFrames = 0;
+
+   // No lanes paused
+   pgpDevice->rxPauseUser  = 0;
+   pgpDevice->rxPauseAuto  = 0;
+   pgpDevice->rxHighWater  = 0;
+   memset(pgpDevice->rxLaneHeld,0,sizeof(pgpDevice->rxLaneHeld));
+   memset(pgpDevice->rxPauses,0,sizeof(pgpDevice->rxPauses));
+
+   // Deliver errored frames
+   pgpDevice->rxErrDrop     = 0;
+   pgpDevice->rxRingErrMode = PGP_RX_ERR_DELIVER;
+   memset(pgpDevice->rxErrors,0,sizeof(pgpDevice->rxErrors));
+   memset(pgpDevice->rxErrDropped,0,sizeof(pgpDevice->rxErrDropped));
+
+   // Driver RX buffers in use
+   pgpDevice->rxUserCnt   = 0;
+   pgpDevice->rxUserPages = NULL;
+
+   // Splice state
+   pgpDevice->rxSpliceOff = 0;
+   atomic_set(&(pgpDevice->rxSpliced),0);
+   pgpDevice->rxOrphan = 0;
+
+   // Shared queue readers and consumer group
+   mutex_init(&pgpDevice->rxReadLock);
+   memset(pgpDevice->reader,0,sizeof(pgpDevice->reader));
+   pgpDevice->rxGroupMask = 0;
+   pgpDevice->rxGroupNext = 0;
+
+   // Deferred RX returns
+   spin_lock_init(&pgpDevice->rxLock);
+   setup_timer(&pgpDevice->rxRetTimer,PgpCard_RxRetTimer,(unsigned long)pgpDevice);
+   pgpDevice->rxRetBatch    = DEF_RX_RET_BATCH;
+   pgpDevice->rxRetThresh   = DEF_RX_RET_THRESH;
+   pgpDevice->rxRetDelay    = DEF_RX_RET_DELAY;
+
+   // Zero copy TX slots
+   memset(pgpDevice->txZc,0,sizeof(pgpDevice->txZc));
+   pgpDevice->txZcFree      = TX_ZC_ALL;
+   pgpDevice->txZcUsed      = 0;
+   pgpDevice->txZcDoneRead  = 0;
+   pgpDevice->txZcDoneWrite = 0;
+
+   // Shared control registers
+   spin_lock_init(&pgpDevice->regLock);
+
+   // Trigger generator, idle until started
+   hrtimer_init(&pgpDevice->trigTimer,CLOCK_MONOTONIC,HRTIMER_MODE_ABS);
+   pgpDevice->trigTimer.function = PgpCard_TrigTimer;
+   pgpDevice->trigRunning = 0;
+   pgpDevice->trigPeriod  = 0;
+   pgpDevice->trigCodeCnt = 0;
+   pgpDevice->trigSent    = 0;
+
+   // Link sampler, idle until the link monitor is enabled or a file watches the link state
+   hrtimer_init(&pgpDevice->linkTimer,CLOCK_MONOTONIC,HRTIMER_MODE_REL);
+   pgpDevice->linkTimer.function = PgpCard_LinkTimer;
+   pgpDevice->linkRunning     = 0;
+   pgpDevice->stateWatchers   = 0;
+   pgpDevice->statePeriod     = DEF_STATE_PERIOD;
+   pgpDevice->stateLoc        = 0;
+   pgpDevice->stateRem        = 0;
+   pgpDevice->stateEvr        = 0;
+   pgpDevice->stateEventRead  = 0;
+   pgpDevice->stateEventWrite = 0;
+
+   // Counter sampling, stopped until requested
+   hrtimer_init(&pgpDevice->cntTimer,CLOCK_MONOTONIC,HRTIMER_MODE_REL);
+   pgpDevice->cntTimer.function = PgpCard_CntTimer;
+   pgpDevice->cntRunning   = 0;
+   pgpDevice->cntPeriod    = 0;
+   pgpDevice->cntSnapEvery = 0;
+   pgpDevice->cntSamples   = 0;
+   pgpDevice->cntLate      = 0;
+   pgpDevice->cntSnapRead  = 0;
+   pgpDevice->cntSnapWrite = 0;
+   memset(&(pgpDevice->cnt),0,sizeof(PgpCardCounters));
+
+   // Shared RX ring, stopped until requested
+   INIT_DELAYED_WORK(&pgpDevice->rxRingWork,PgpCard_RingWork);
+   pgpDevice->rxRing       = NULL;
+   pgpDevice->rxRingHdr    = NULL;
+   pgpDevice->rxRingData   = NULL;
+   pgpDevice->rxRingSize   = 0;
+   pgpDevice->rxRingHead   = 0;
+   pgpDevice->rxRingFrames = 0;
+   pgpDevice->rxRingFull   = 0;
+   atomic_set(&(pgpDevice->rxRingMaps),0);
+
+   // DMA watchdog, disabled until a period is set
+   INIT_DELAYED_WORK(&pgpDevice->dogWork,PgpCard_DogWork);
+   pgpDevice->dogPeriod   = 0;
+   pgpDevice->dogTxAge    = DEF_DOG_TX_AGE;
+   pgpDevice->dogRxAge    = DEF_DOG_RX_AGE;
+   pgpDevice->dogAuto     = 0;
+   pgpDevice->dogRxMask   = 0;
+   pgpDevice->dogReclaims = 0;
+   pgpDevice->dogLateDone = 0;
+   memset(pgpDevice->dogTxStuck,0,sizeof(pgpDevice->dogTxStuck));
+   memset(pgpDevice->dogTxOldest,0,sizeof(pgpDevice->dogTxOldest));
+   memset(pgpDevice->dogRxLost,0,sizeof(pgpDevice->dogRxLost));
+   memset(pgpDevice->dogTxReclaimed,0,sizeof(pgpDevice->dogTxReclaimed));
+   memset(pgpDevice->dogRxReclaimed,0,sizeof(pgpDevice->dogRxReclaimed));
+   memset(pgpDevice->rxLaneLast,0,sizeof(pgpDevice->rxLaneLast));
+
+   // Link monitor, disabled until a lane mask is set
+   pgpDevice->monMask       = 0;
+   pgpDevice->monNext       = jiffies;
+   pgpDevice->monPeriod     = DEF_MON_PERIOD;
+   pgpDevice->monDownLimit  = DEF_MON_DOWN_LIMIT;
+   pgpDevice->monDown       = 0;
+   pgpDevice->monResetting  = 0;
+   pgpDevice->monEventRead  = 0;
+   pgpDevice->monEventWrite = 0;
+   memset(pgpDevice->monResets,0,sizeof(pgpDevice->monResets));
+   memset(pgpDevice->monRecovered,0,sizeof(pgpDevice->monRecovered));
+   memset(pgpDevice->monLastDown,0,sizeof(pgpDevice->monLastDown));
+
+   // TX scheduling, lock must be ready before the IRQ is requested
+   spin_lock_init(&pgpDevice->txLock);
+   pgpDevice->txFifoThresh  = DEF_TX_FIFO_THRESH;
+   pgpDevice->txPollMask    = 0xFF;
+   pgpDevice->txSched       = 0;
+   for (i=0; i < 8; i++) {
+      pgpDevice->txLaneCnt[i]     = 0;
+      pgpDevice->txLaneWeight[i]  = DEF_TX_LANE_WEIGHT;
+      pgpDevice->txLaneDeficit[i] = 0;
+   }
 
    // Add device
    if ( cdev_add(&pgpDevice->cdev, chrdev, 1) ) 
@@ -1152,45 +4868,14 @@ static int PgpCard_Probe(struct pci_dev *pcidev, const struct pci_device_id *dev
       return (ERROR);
    }
 
-   // Init TX Buffers
-   pgpDevice->txBuffSize = DEF_TX_BUF_SIZE;
-   pgpDevice->txBuffCnt  = DEF_TX_BUF_CNT;
-   pgpDevice->txBuffer   = (struct TxBuffer **)kmalloc(pgpDevice->txBuffCnt * sizeof(struct TxBuffer *),GFP_KERNEL);
-   pgpDevice->txQueue    = (struct TxBuffer **)kmalloc((pgpDevice->txBuffCnt+2) * sizeof(struct TxBuffer *),GFP_KERNEL);
-
-   for ( idx=0; idx < pgpDevice->txBuffCnt; idx++ ) {
-      pgpDevice->txBuffer[idx] = (struct TxBuffer *)kmalloc(sizeof(struct TxBuffer ),GFP_KERNEL);
-      if ((pgpDevice->txBuffer[idx]->buffer = pci_alloc_consistent(pcidev,pgpDevice->txBuffSize,&(pgpDevice->txBuffer[idx]->dma))) == NULL ) {
-         printk(KERN_WARNING"%s: Init: unable to allocate tx buffer. Maj=%i\n",MOD_NAME,pgpDevice->major);
-         return ERROR;
-      }
-      pgpDevice->txQueue[idx] = pgpDevice->txBuffer[idx];
-   }
-   pgpDevice->txWrite = pgpDevice->txBuffCnt;
-   pgpDevice->txRead  = 0;
-
-   // Set max frame size, clear rx buffer reset
-   pgpDevice->rxBuffSize = DEF_RX_BUF_SIZE;
-   pgpDevice->reg->rxMaxFrame = pgpDevice->rxBuffSize | 0x80000000;
-
-   // Init RX Buffers
-   pgpDevice->rxBuffCnt  = DEF_RX_BUF_CNT;
-   pgpDevice->rxBuffer   = (struct RxBuffer **)kmalloc(pgpDevice->rxBuffCnt * sizeof(struct RxBuffer *),GFP_KERNEL);
-   pgpDevice->rxQueue    = (struct RxBuffer **)kmalloc((pgpDevice->rxBuffCnt+2) * sizeof(struct RxBuffer *),GFP_KERNEL);
-
-   for ( idx=0; idx < pgpDevice->rxBuffCnt; idx++ ) {
-      pgpDevice->rxBuffer[idx] = (struct RxBuffer *)kmalloc(sizeof(struct RxBuffer ),GFP_KERNEL);
-      if ((pgpDevice->rxBuffer[idx]->buffer = pci_alloc_consistent(pcidev,pgpDevice->rxBuffSize,&(pgpDevice->rxBuffer[idx]->dma))) == NULL ) {
-         printk(KERN_WARNING"%s: Init: unable to allocate tx buffer. Maj=%i\n",MOD_NAME,pgpDevice->major);
-         return ERROR;
-      };
-
-      // Add to RX queue (evenly distributed to all free list RX FIFOs)
-      iowrite32(pgpDevice->rxBuffer[idx]->dma,&(pgpDevice->reg->rxFree[idx % 8]));
-      asm("nop");
-   }
-   pgpDevice->rxRead  = 0;
-   pgpDevice->rxWrite = 0;
+   // DMA pools are allocated on first open or arm
+   pgpDevice->poolReady   = 0;
+   pgpDevice->bypass      = 0;
+   pgpDevice->bypassOwner = NULL;
+   atomic_set(&(pgpDevice->poolMaps),0);
+   pgpDevice->freeOnClose = cfgFreeOnClose;
+   pgpDevice->txLaneQuota = 0;
+   pgpDevice->reg->rxMaxFrame = 0;
 
    // Init queues
    init_waitqueue_head(&pgpDevice->inq);
@@ -1206,8 +4891,9 @@ static int PgpCard_Probe(struct pci_dev *pcidev, const struct pci_device_id *dev
 
 // Remove
 static void PgpCard_Remove(struct pci_dev *pcidev) {
-   __u32 idx;
    int  i;
+   unsigned long flags;
+   __u32 orphan;
    struct PgpDevice *pgpDevice = NULL;
 
    // Look for matching device
@@ -1224,27 +4910,45 @@ static void PgpCard_Remove(struct pci_dev *pcidev) {
    }
    else {
 
-      // Disable interrupts
-      pgpDevice->reg->irq = 0;
-
-      // Clear RX buffer
-      pgpDevice->reg->rxMaxFrame = 0;
-
-      // Free TX Buffers
-      for ( idx=0; idx < pgpDevice->txBuffCnt; idx++ ) {
-         pci_free_consistent(pcidev,pgpDevice->txBuffSize,pgpDevice->txBuffer[idx]->buffer,pgpDevice->txBuffer[idx]->dma);
-         kfree(pgpDevice->txBuffer[idx]);
+      // Stop the link sampler, trigger generator, counter sampling and DMA watchdog
+      pgpDevice->monMask       = 0;
+      pgpDevice->stateWatchers = 0;
+      hrtimer_cancel(&(pgpDevice->linkTimer));
+      hrtimer_cancel(&(pgpDevice->trigTimer));
+      pgpDevice->cntRunning = 0;
+      hrtimer_cancel(&(pgpDevice->cntTimer));
+      pgpDevice->dogPeriod = 0;
+      cancel_delayed_work_sync(&(pgpDevice->dogWork));
+
+      // Stop the shared RX ring
+      down_write(&(pgpDevice->poolSem));
+      PgpCard_RingSetup(pgpDevice,0);
+      up_write(&(pgpDevice->poolSem));
+      cancel_delayed_work_sync(&(pgpDevice->rxRingWork));
+
+      // Free DMA pools, card is about to be reset so pools are freed even if TX buffers are outstanding
+      // RX buffers still referenced by pipes can not be freed, the pools are left to the last pipe release.
+      down_write(&(pgpDevice->poolSem));
+      if ( PgpCard_PoolRelease(pgpDevice) != SUCCESS && pgpDevice->poolReady ) {
+         PgpCard_PoolFlush(pgpDevice);
+         pgpDevice->poolReady = 0;
+         pci_dev_get(pcidev);
+
+         spin_lock_irqsave(&(pgpDevice->rxLock),flags);
+         orphan = ( atomic_read(&(pgpDevice->rxSpliced)) > 0 );
+         pgpDevice->rxOrphan = orphan;
+         spin_unlock_irqrestore(&(pgpDevice->rxLock),flags);
+
+         if ( orphan ) printk(KERN_WARNING"%s: Remove: RX buffers are held by pipes, pools freed on release. Maj=%i\n",MOD_NAME,pgpDevice->major);
+         else {
+            PgpCard_PoolFree(pgpDevice);
+            pci_dev_put(pcidev);
+         }
       }
-      kfree(pgpDevice->txBuffer);
-      kfree(pgpDevice->txQueue);
+      up_write(&(pgpDevice->poolSem));
 
-      // Free RX Buffers
-      for ( idx=0; idx < pgpDevice->rxBuffCnt; idx++ ) {
-         pci_free_consistent(pcidev,pgpDevice->rxBuffSize,pgpDevice->rxBuffer[idx]->buffer,pgpDevice->rxBuffer[idx]->dma);
-         kfree(pgpDevice->rxBuffer[idx]);
-      }
-      kfree(pgpDevice->rxBuffer);
-      kfree(pgpDevice->rxQueue);
+      // Disable interrupts
+      pgpDevice->reg->irq = 0;
 
       // Set card reset, bit 1 of cardRstStat register
       pgpDevice->reg->cardRstStat |= 0x00000002;
@@ -1277,6 +4981,13 @@ static int PgpCard_Init(void) {
 
    printk(KERN_INFO"%s: Init: PgpCard Init.\n", MOD_NAME);
 
+   // Streaming RX buffers are limited in size, the defaults must be usable at open
+   if ( cfgRxStreaming && cfgRxSize > MAX_STREAM_BUF_SIZE ) {
+      printk(KERN_ERR"%s: Init: cfgRxSize %u is above %lu, the largest streaming RX buffer. Lower cfgRxSize or clear cfgRxStreaming.\n",
+         MOD_NAME,cfgRxSize,MAX_STREAM_BUF_SIZE);
+      return(-EINVAL);
+   }
+
    // Register driver
    return(pci_register_driver(&PgpCardDriver));
 }
@@ -1292,13 +5003,17 @@ static void PgpCard_Exit(void) {
 // Memory map
 int PgpCard_Mmap(struct file *filp, struct vm_area_struct *vma) {
 
-   struct PgpDevice *pgpDevice = (struct PgpDevice *)filp->private_data;
+   struct PgpDevice *pgpDevice = ((struct PgpFile *)filp->private_data)->pgpDevice;
 
    unsigned long offset = vma->vm_pgoff << PAGE_SHIFT;
    unsigned long physical = ((unsigned long) pgpDevice->baseHdwr) + offset;
    unsigned long vsize = vma->vm_end - vma->vm_start;
    int result;
 
+   // Shared RX ring and DMA pool mappings
+   if ( offset == PGP_MAP_RX_RING ) return(PgpCard_RingMmap(pgpDevice,vma));
+   if ( offset >= PGP_MAP_TX_POOL ) return(PgpCard_PoolMmap(pgpDevice,filp,vma));
+
    // Check bounds of memory map
    if (vsize > pgpDevice->baseLen) {
       printk(KERN_WARNING"%s: Mmap: mmap vsize %08x, baseLen %08x. Maj=%i\n", MOD_NAME,
@@ -1319,14 +5034,38 @@ int PgpCard_Mmap(struct file *filp, struct vm_area_struct *vma) {
 }
 
 
-void PgpCard_VmOpen(struct vm_area_struct *vma) { }
+// Pool mappings keep the pools from being released
+void PgpCard_VmOpen(struct vm_area_struct *vma) {
+   struct PgpDevice *pgpDevice = (struct PgpDevice *)vma->vm_private_data;
+   if ( pgpDevice != NULL ) atomic_inc(&(pgpDevice->poolMaps));
+}
+
+
+void PgpCard_VmClose(struct vm_area_struct *vma) {
+   struct PgpDevice *pgpDevice = (struct PgpDevice *)vma->vm_private_data;
+   if ( pgpDevice != NULL ) atomic_dec(&(pgpDevice->poolMaps));
+}
+
+
+// Ring mappings keep the shared RX ring from being freed
+void PgpCard_RingVmOpen(struct vm_area_struct *vma) {
+   struct PgpDevice *pgpDevice = (struct PgpDevice *)vma->vm_private_data;
+   atomic_inc(&(pgpDevice->rxRingMaps));
+}
 
 
-void PgpCard_VmClose(struct vm_area_struct *vma) { }
+void PgpCard_RingVmClose(struct vm_area_struct *vma) {
+   struct PgpDevice *pgpDevice = (struct PgpDevice *)vma->vm_private_data;
+   atomic_dec(&(pgpDevice->rxRingMaps));
+}
 
 
 // Flush queue
 int PgpCard_Fasync(int fd, struct file *filp, int mode) {
-   struct PgpDevice *pgpDevice = (struct PgpDevice *)filp->private_data;
+   struct PgpFile   *pgpFile   = (struct PgpFile *)filp->private_data;
+   struct PgpDevice *pgpDevice = pgpFile->pgpDevice;
+
+   // SIGIO also reports link state changes
+   if ( mode && ! pgpFile->stateWatch ) PgpCard_StateWatch(pgpDevice,pgpFile,1);
    return fasync_helper(fd, filp, mode, &(pgpDevice->async_queue));
 }
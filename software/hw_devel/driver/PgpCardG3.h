@@ -28,6 +28,15 @@
 #include <linux/cdev.h>
 #include <asm/uaccess.h>
 #include <linux/types.h>
+#include <linux/rwsem.h>
+#include <linux/pipe_fs_i.h>
+#include <linux/splice.h>
+#include <linux/mutex.h>
+#include <linux/vmalloc.h>
+#include <linux/hrtimer.h>
+#include <linux/workqueue.h>
+#include <linux/delay.h>
+#include <asm/div64.h>
 
 // DMA Buffer Size, Bytes
 #define DEF_RX_BUF_SIZE 2097152//0x200000
@@ -37,6 +46,61 @@
 #define DEF_RX_BUF_CNT 32
 #define DEF_TX_BUF_CNT 32
 
+// Pool limits, the card holds at most 8 x 1023 free RX buffers
+#define MAX_RX_BUF_CNT 8184
+#define MAX_TX_BUF_CNT 1024
+#define MAX_BUF_SIZE   0x4000000
+
+// Streaming RX buffers are contiguous pages, higher orders fail on a fragmented host
+#define MAX_STREAM_ORDER    8
+#define MAX_STREAM_BUF_SIZE (PAGE_SIZE << MAX_STREAM_ORDER)
+
+// Time allowed for the card to return TX buffers before pools are freed
+#define POOL_DRAIN_TIMEOUT HZ
+
+// TX lane scheduling defaults
+#define DEF_TX_LANE_QUOTA  16     // Max buffers held by a single lane
+#define DEF_TX_LANE_WEIGHT 1      // Scheduler weight per lane
+#define DEF_TX_FIFO_THRESH 8      // Hold back descriptors at this hardware fifo count, 0 = never
+#define TX_SCHED_QUANTUM   0x8000 // Deficit added per round and per weight unit, dwords
+#define MAX_TX_LANE_WEIGHT 0x1000 // Keeps quantum x weight plus the largest frame within 32 bits
+#define TX_SCHED_DEF_MAX   ((TX_SCHED_QUANTUM * MAX_TX_LANE_WEIGHT) + 0x00FFFFFF)
+
+// Zero copy TX, frames in flight and completions held for IOCTL_ZeroCopy_Done
+#define TX_ZC_SLOTS        32
+#define TX_ZC_ALL          0xFFFFFFFF
+#define TX_ZC_DONE_CNT     256
+
+// Largest shared RX ring, bytes
+#define MAX_RX_RING_SIZE   0x8000000
+
+// Shortest trigger generator period, nanoseconds
+#define TRIG_MIN_PERIOD    10000
+
+// Shortest counter sampling period in microseconds and queued counter snapshots
+#define CNT_MIN_PERIOD     100
+#define CNT_SNAP_CNT       64
+
+// Shortest and default link state sampling period in microseconds and queued link state events
+#define STATE_MIN_PERIOD   100
+#define DEF_STATE_PERIOD   250
+#define STATE_EVENT_CNT    64
+
+// Link monitor defaults, milliseconds
+#define DEF_MON_PERIOD     10
+#define DEF_MON_DOWN_LIMIT 100
+#define MON_EVENT_CNT      64
+
+// DMA watchdog defaults, milliseconds
+#define DEF_DOG_TX_AGE     1000
+#define DEF_DOG_RX_AGE     1000
+#define DOG_DRAIN_TIMEOUT  10     // Wait for a reset lane to drop its descriptors, ms
+
+// RX buffer return defaults
+#define DEF_RX_RET_BATCH   8      // Flush when this many returns are pending
+#define DEF_RX_RET_THRESH  2      // Flush when a lane free list holds fewer buffers
+#define DEF_RX_RET_DELAY   200    // Flush pending returns after this delay, usec
+
 // PCI IDs
 #define PCI_VENDOR_ID_SLAC           0x1A4A
 #define PCI_DEVICE_ID_SLAC_PGPCARD   0x2020
@@ -56,18 +120,61 @@ struct TxBuffer {
    __u32       lane;
    __u32       vc;
    __u32       length;
+
+   // Zero copy frames send pinned user pages in place of buffer
+   __u32         zeroCopy;
+   struct page **pages;
+   __u32         npages;
+   __u64         userAddr;
+
+   // Held by the card since postTime, protected by txLock
+   __u32         posted;
+   unsigned long postTime;
 };
 
 // Structure for RX buffers
 struct RxBuffer {
    dma_addr_t dma;
    unchar*     buffer;
+   struct PgpDevice *pgpDevice;
+   atomic_t    spliceRef;
+   __u32       index;
+   __u32       userHeld;
+   __u64       userOffset;
+   __u32       streaming;     // Streaming mapping, synced when ownership changes
+   __u32       owned;         // Scratch flag for watchdog reclaim
    __u32       lengthError;
    __u32       fifoError;
    __u32       eofe;
    __u32       lane;
    __u32       vc;
    __u32       length;
+   __u32       seq;           // Per lane/VC frame sequence
+   __u32       gseq;          // Per card frame sequence
+};
+
+// Open file state, held in filp->private_data
+struct PgpFile {
+   struct PgpDevice *pgpDevice;
+   struct list_head  list;          // Entry in pgpDevice->files
+   __u32             rxFilter;      // Lanes/VCs this file accepts, bit lane*4+vc
+   __u32             rxErrMode;     // Errored frame policy applied when this file takes a frame
+   __u32             stateWatch;    // File polls or asked for link state events, counted in stateWatchers
+};
+
+// Consumer group member, frames for its lane/VC mask are queued here instead of the shared queue
+// Frames on priority lanes/VCs go to prioQueue, which is emptied first.
+struct PgpReader {
+   struct file      *filp;
+   __u32             mask;
+   struct RxBuffer **queue;
+   __u32             read;
+   __u32             write;
+   struct RxBuffer **prioQueue;
+   __u32             prioRead;
+   __u32             prioWrite;
+   __u32             depth;         // Entries in each queue, sized to hold every RX buffer at join
+   __u32             frames;
 };
 
 // Device structure
@@ -85,8 +192,9 @@ struct PgpDevice {
    // Async queue
    struct fasync_struct *async_queue;     
 
-   // Device is already open
+   // Open count and per file state, the list is protected by poolSem
    __u32 isOpen;
+   struct list_head files;
 
    // Debug flag
    __u32 debug;
@@ -94,6 +202,20 @@ struct PgpDevice {
    // IRQ
    int irq;
 
+   // PCI device, used for DMA pool allocation
+   struct pci_dev *pcidev;
+
+   // DMA pools are allocated on first open or arm and may be released on close
+   struct rw_semaphore poolSem;
+   __u32               poolReady;
+   __u32               freeOnClose;
+   __u32               rxStreaming;
+
+   // Kernel bypass, the owning file posts and harvests descriptors itself with interrupts masked
+   __u32               bypass;
+   struct file        *bypassOwner;
+   atomic_t            poolMaps;
+
    // RX/TX Buffer Structures
    __u32            rxBuffCnt;
    __u32            rxBuffSize;
@@ -107,11 +229,199 @@ struct PgpDevice {
    __u32            rxRead;
    __u32            rxWrite;
 
+   // Strict priority queue for the lane/VC mask rxPrioMask, bit lane*4+vc, same size as rxQueue
+   struct RxBuffer **rxPrioQueue;
+   __u32            rxPrioRead;
+   __u32            rxPrioWrite;
+   __u32            rxPrioMask;
+   __u32            rxPrioFrames;
+   __u32            rxSplicePrio;
+
+   // Receive filter, bit lane*4+vc set to accept, and frames dropped per lane/VC
+   __u32             rxFilter;
+   __u32             rxFiltered[32];
+
+   // Errored frames are dropped in the interrupt handler when every open file drops them,
+   // the shared ring applies the policy of the file that started it
+   __u32             rxErrDrop;
+   __u32             rxRingErrMode;
+   __u32             rxErrors[8];
+   __u32             rxErrDropped[8];
+
+   // User registered RX region, replaces the driver RX buffers while registered
+   __u32             rxUserCnt;
+   struct page     **rxUserPages;
+   __u32             rxUserPageCnt;
+   struct RxBuffer **rxDrvBuffer;
+   __u32             rxDrvCnt;
+   __u32             rxDrvSize;
+
+   // Bytes of the head frame already spliced, and RX buffers referenced by pipes
+   // rxOrphan is set under rxLock when the device is removed while pipes still reference RX buffers,
+   // the pools are then freed by the last pipe release and the device slot stays reserved until then.
+   __u32             rxSpliceOff;
+   atomic_t          rxSpliced;
+   __u32             rxOrphan;
+
+   // Read-modify-write of the shared control registers
+   spinlock_t        regLock;
+
+   // Link monitor, lane masks and event ring, protected by regLock
+   // Checked by the link sampler every monPeriod milliseconds, next at monNext
+   __u32             monMask;
+   __u32             monPeriod;
+   __u32             monDownLimit;
+   __u32             monDown;
+   __u32             monResetting;
+   unsigned long     monNext;
+   unsigned long     monDownStart[8];
+   unsigned long     monResetAt[8];
+   __u32             monResets[8];
+   __u32             monRecovered[8];
+   __u32             monLastDown[8];
+   PgpCardLinkEvent  monEvent[MON_EVENT_CNT];
+   __u32             monEventRead;
+   __u32             monEventWrite;
+
+   // Op-code trigger generator, settings and statistics protected by regLock
+   struct hrtimer    trigTimer;
+   __u32             trigRunning;
+   __u32             trigPeriod;
+   __u32             trigCount;
+   __u32             trigCode[PGP_TRIG_CODES];
+   __u32             trigCodeCnt;
+   __u32             trigSent;
+   __u32             trigMissed;
+   __u64             trigLateSum;
+   __u64             trigLateMax;
+   ktime_t           trigStart;
+   ktime_t           trigStop;
+   ktime_t           trigNext;
+
+   // Serializes files consuming the shared RX queue
+   struct mutex      rxReadLock;
+
+   // Consumer group members and the lane/VC mask they serve, protected by rxLock
+   struct PgpReader  reader[PGP_GROUP_MAX];
+   __u32             rxGroupMask;
+   __u32             rxGroupNext;
+
+   // Deferred return of RX buffers to the card free lists, rxBuffCnt entries per lane
+   spinlock_t        rxLock;
+   __u32             rxLaneFree[8];
+   __u32            *rxRet[8];
+   __u32             rxRetCnt[8];
+   __u32             rxRetTotal;
+   __u32             rxRetBatch;
+   __u32             rxRetThresh;
+   __u32             rxRetDelay;
+   struct timer_list rxRetTimer;
+
+   // Receive backpressure, returns for paused lanes wait in rxRet, protected by rxLock
+   // rxLaneHeld counts delivered frames not yet returned, lanes reaching rxHighWater pause
+   // automatically and resume at half of it
+   __u32             rxPauseUser;
+   __u32             rxPauseAuto;
+   __u32             rxHighWater;
+   __u32             rxLaneHeld[8];
+   __u32             rxPauses[8];
+
+   // Shared RX ring, filled by rxRingWork while rxRing is set, protected by poolSem and rxReadLock
+   // rxRingHead is the producer offset, the copy in the ring header is only read by the application
+   void              *rxRing;
+   PgpCardRingHdr    *rxRingHdr;
+   unchar            *rxRingData;
+   __u32             rxRingSize;
+   __u32             rxRingHead;
+   __u32             rxRingFrames;
+   __u32             rxRingFull;
+   atomic_t          rxRingMaps;
+   struct delayed_work rxRingWork;
+
+   // Frame sequence numbers, assigned in the interrupt to frames that pass the receive filter
+   // rxSeqDrops counts numbered frames the driver dropped, indexed by lane*4+vc
+   __u32             rxSeq[32];
+   __u32             rxGlobalSeq;
+   __u32             rxSeqDrops[32];
+
    // Top pointer for tx queue, 2 entries larger than txBuffCnt
    struct TxBuffer **txQueue;
    __u32            txRead;
    __u32            txWrite;
 
+   // Per lane TX accounting and pending queues, 1 entry larger than txBuffCnt
+   spinlock_t        txLock;
+   __u32             txLaneCnt[8];
+   __u32             txLaneQuota;
+   __u32             txLaneWeight[8];
+   __u32             txLaneDeficit[8];
+   __u32             txFifoThresh;
+   __u32             txPollMask;
+   __u32             txSched;
+   struct TxBuffer **txPend[8];
+   __u32             txPendRead[8];
+   __u32             txPendWrite[8];
+
+   // TX completions collected by writers ahead of the interrupt
+   __u32             txReaped;
+
+   // Link sampler, linkTimer reads the link and EVR ready bits for the link monitor and the state watch
+   // It runs while the monitor is enabled or any file watches, at statePeriod microseconds when a file
+   // watches. Changes are queued in stateEvent and raise POLLPRI, protected by regLock
+   struct hrtimer    linkTimer;
+   __u32             linkRunning;
+   __u32             stateWatchers;
+   __u32             statePeriod;
+   __u32             stateLoc;
+   __u32             stateRem;
+   __u32             stateEvr;
+   PgpCardStateEvent stateEvent[STATE_EVENT_CNT];
+   __u32             stateEventRead;
+   __u32             stateEventWrite;
+
+   // Extended counters, sampled by cntTimer while cntRunning, protected by regLock
+   // cntLaneLast, cntRxLast and cntTxLast hold the register values of the previous sample
+   struct hrtimer    cntTimer;
+   __u32             cntRunning;
+   __u32             cntPeriod;
+   __u32             cntSnapEvery;
+   __u32             cntSamples;
+   __u32             cntLate;
+   __u32             cntLaneLast[8];
+   __u32             cntRxLast;
+   __u32             cntTxLast;
+   ktime_t           cntTime;
+   PgpCardCounters   cnt;
+   PgpCardCntSnap    cntSnap[CNT_SNAP_CNT];
+   __u32             cntSnapRead;
+   __u32             cntSnapWrite;
+
+   // DMA watchdog, checks run from dogWork while dogPeriod is non zero
+   struct delayed_work dogWork;
+   __u32             dogPeriod;
+   __u32             dogTxAge;
+   __u32             dogRxAge;
+   __u32             dogAuto;
+   __u32             dogTxStuck[8];
+   __u32             dogTxOldest[8];
+   __u32             dogRxLost[8];
+   __u32             dogRxMask;
+   unsigned long     dogRxShort[8];
+   __u32             dogTxReclaimed[8];
+   __u32             dogRxReclaimed[8];
+   __u32             dogReclaims;
+   __u32             dogLateDone;
+   unsigned long     rxLaneLast[8];
+
+   // Zero copy TX slots, free mask and done ring, protected by txLock
+   // txZcUsed counts frames in flight or waiting in the done ring
+   struct TxBuffer   txZc[TX_ZC_SLOTS];
+   __u32             txZcFree;
+   __u32             txZcUsed;
+   __u64             txZcDone[TX_ZC_DONE_CNT];
+   __u32             txZcDoneRead;
+   __u32             txZcDoneWrite;
+
    // Queues
    wait_queue_head_t inq;
    wait_queue_head_t outq;
@@ -150,8 +460,16 @@ typedef struct {
    __u32   fifoErr;
    __u32   lengthErr;
 
+   // Frame sequence numbers
+   __u32   seq;
+   __u32   gseq;
+
 } PgpCardRx32;
 
+// Read structure sizes from before the sequence numbers were added
+#define RX_SIZE_NOSEQ   offsetof(PgpCardRx,seq)
+#define RX32_SIZE_NOSEQ offsetof(PgpCardRx32,seq)
+
 // Function prototypes
 int PgpCard_Open(struct inode *inode, struct file *filp);
 int PgpCard_Release(struct inode *inode, struct file *filp);
@@ -167,8 +485,98 @@ static int PgpCard_Init(void);
 static void PgpCard_Exit(void);
 int PgpCard_Mmap(struct file *filp, struct vm_area_struct *vma);
 int PgpCard_Fasync(int fd, struct file *filp, int mode);
+static __u32 PgpCard_TxIdle(struct PgpDevice *pgpDevice);
+static int PgpCard_PoolAlloc(struct PgpDevice *pgpDevice, PgpCardPool *pool);
+static void PgpCard_PoolFree(struct PgpDevice *pgpDevice);
+static int PgpCard_PoolRelease(struct PgpDevice *pgpDevice);
+static int PgpCard_PoolResize(struct PgpDevice *pgpDevice, PgpCardPool *pool);
+static void PgpCard_PoolFlush(struct PgpDevice *pgpDevice);
+static void PgpCard_PoolPost(struct PgpDevice *pgpDevice);
+static int PgpCard_RxBufAlloc(struct PgpDevice *pgpDevice, struct RxBuffer *rxBuffer);
+static void PgpCard_RxBufFree(struct PgpDevice *pgpDevice, struct RxBuffer *rxBuffer);
+static void PgpCard_RxSyncCpu(struct PgpDevice *pgpDevice, struct RxBuffer *rxBuffer, __u32 length);
+static void PgpCard_RxSyncDev(struct PgpDevice *pgpDevice, struct RxBuffer *rxBuffer);
+static int PgpCard_CopyBench(struct PgpDevice *pgpDevice, PgpCardBench *bench);
+static int PgpCard_BypassEnter(struct PgpDevice *pgpDevice, struct file *filp);
+static int PgpCard_BypassExit(struct PgpDevice *pgpDevice);
+static int PgpCard_BufInfo(struct PgpDevice *pgpDevice, PgpCardBufInfo *bufInfo);
+static int PgpCard_PoolMmap(struct PgpDevice *pgpDevice, struct file *filp, struct vm_area_struct *vma);
+static void PgpCard_FileMasks(struct PgpDevice *pgpDevice);
+static struct PgpReader *PgpCard_GroupFind(struct PgpDevice *pgpDevice, struct file *filp);
+static __u32 PgpCard_GroupMember(struct PgpDevice *pgpDevice, struct file *filp);
+static __u32 PgpCard_RxReady(struct PgpDevice *pgpDevice, struct file *filp);
+static struct RxBuffer *PgpCard_RxHead(struct PgpDevice *pgpDevice, __u32 *prio);
+static void PgpCard_RxPop(struct PgpDevice *pgpDevice, __u32 prio);
+static __u32 PgpCard_RxDepth(struct PgpDevice *pgpDevice);
+static void PgpCard_GroupMask(struct PgpDevice *pgpDevice);
+static __u32 PgpCard_GroupPush(struct PgpDevice *pgpDevice, struct RxBuffer *rxBuffer);
+static struct RxBuffer *PgpCard_GroupPop(struct PgpDevice *pgpDevice, struct PgpReader *reader, struct file *filp);
+static int PgpCard_GroupJoin(struct PgpDevice *pgpDevice, struct file *filp, __u32 mask);
+static void PgpCard_GroupLeave(struct PgpDevice *pgpDevice, struct file *filp);
+static void PgpCard_RxReturn(struct PgpDevice *pgpDevice, struct RxBuffer *rxBuffer);
+static void PgpCard_RxFlush(struct PgpDevice *pgpDevice);
+static void PgpCard_RxPauseSet(struct PgpDevice *pgpDevice, __u32 user, __u32 autoMask);
+static void PgpCard_RxRetTimer(unsigned long data);
+static int PgpCard_RxPeek(struct PgpDevice *pgpDevice, PgpCardPeek *peek);
+static int PgpCard_RxDiscard(struct PgpDevice *pgpDevice);
+static int PgpCard_RxRegister(struct PgpDevice *pgpDevice, PgpCardRegion *region);
+static void PgpCard_RxUserFree(struct PgpDevice *pgpDevice);
+static int PgpCard_RxUnregister(struct PgpDevice *pgpDevice);
+static int PgpCard_RxUserRecv(struct PgpDevice *pgpDevice, PgpCardRxDesc *rxDesc);
+static int PgpCard_RxUserReturn(struct PgpDevice *pgpDevice, __u32 index);
+static void PgpCard_SpliceUnref(struct RxBuffer *rxBuffer);
+static void PgpCard_SpliceHold(struct PgpDevice *pgpDevice);
+static void PgpCard_PipeRelease(struct pipe_inode_info *pipe, struct pipe_buffer *buf);
+static void PgpCard_PipeGet(struct pipe_inode_info *pipe, struct pipe_buffer *buf);
+static int PgpCard_PipeSteal(struct pipe_inode_info *pipe, struct pipe_buffer *buf);
+static void PgpCard_SpliceRelease(struct splice_pipe_desc *spd, unsigned int i);
+static ssize_t PgpCard_SpliceRead(struct file *filp, loff_t *ppos, struct pipe_inode_info *pipe, size_t len, unsigned int flags);
+static struct TxBuffer *PgpCard_TxAcquire(struct PgpDevice *pgpDevice, __u32 lane);
+static __u32 PgpCard_TxAvail(struct PgpDevice *pgpDevice, __u32 laneMask);
+static void PgpCard_TxRelease(struct PgpDevice *pgpDevice, struct TxBuffer *txBuffer);
+static struct TxBuffer *PgpCard_TxZcAcquire(struct PgpDevice *pgpDevice, __u32 lane, __u32 *full);
+static __u32 PgpCard_TxZcAvail(struct PgpDevice *pgpDevice, __u32 lane);
+static int PgpCard_TxZcMap(struct PgpDevice *pgpDevice, struct TxBuffer *txBuffer, PgpCardTx *pgpCardTx);
+static void PgpCard_TxZcCancel(struct PgpDevice *pgpDevice, struct TxBuffer *txBuffer);
+static void PgpCard_TxZcDone(struct PgpDevice *pgpDevice, __u64 userAddr);
+static void PgpCard_TxZcUnreserve(struct PgpDevice *pgpDevice);
+static struct TxBuffer *PgpCard_TxZcFind(struct PgpDevice *pgpDevice, __u32 dma);
+static void PgpCard_TxPost(struct PgpDevice *pgpDevice, struct TxBuffer *txBuffer);
+static void PgpCard_CfgApply(struct PgpDevice *pgpDevice, PgpCardConfig *config);
+static void PgpCard_CfgRead(struct PgpDevice *pgpDevice, PgpCardConfig *config);
+static void PgpCard_MonEvent(struct PgpDevice *pgpDevice, __u32 lane, __u32 type, __u32 duration);
+static void PgpCard_MonRelease(struct PgpDevice *pgpDevice);
+static void PgpCard_MonCheck(struct PgpDevice *pgpDevice, __u32 linkUp);
+static enum hrtimer_restart PgpCard_TrigTimer(struct hrtimer *timer);
+static int PgpCard_TrigStart(struct PgpDevice *pgpDevice, PgpCardTrigger *trigger);
+static void PgpCard_TrigRead(struct PgpDevice *pgpDevice, PgpCardTrigger *trigger);
+static void PgpCard_CntSync(struct PgpDevice *pgpDevice);
+static void PgpCard_CntSample(struct PgpDevice *pgpDevice, ktime_t now);
+static enum hrtimer_restart PgpCard_CntTimer(struct hrtimer *timer);
+static int PgpCard_CntStart(struct PgpDevice *pgpDevice, PgpCardCntConfig *cfg);
+static void PgpCard_CntRead(struct PgpDevice *pgpDevice, PgpCardCntConfig *cfg);
+static void PgpCard_StateRead(struct PgpDevice *pgpDevice, __u32 *loc, __u32 *rem, __u32 *evr);
+static __u64 PgpCard_LinkPeriod(struct PgpDevice *pgpDevice);
+static void PgpCard_LinkUpdate(struct PgpDevice *pgpDevice);
+static void PgpCard_StateWatch(struct PgpDevice *pgpDevice, struct PgpFile *pgpFile, __u32 watch);
+static enum hrtimer_restart PgpCard_LinkTimer(struct hrtimer *timer);
+static __u32 PgpCard_DogCheck(struct PgpDevice *pgpDevice);
+static void PgpCard_DogReclaim(struct PgpDevice *pgpDevice);
+static void PgpCard_DogWork(struct work_struct *work);
+static void PgpCard_DogRead(struct PgpDevice *pgpDevice, PgpCardWatchdog *dog);
+static void PgpCard_TxSchedule(struct PgpDevice *pgpDevice);
+static __u32 PgpCard_TxReap(struct PgpDevice *pgpDevice);
+static void PgpCard_SeqDrop(struct PgpDevice *pgpDevice, struct RxBuffer *rxBuffer);
+static __u32 PgpCard_RxErrDrop(struct PgpDevice *pgpDevice, struct RxBuffer *rxBuffer, __u32 mode);
+static void PgpCard_SeqDropQueued(struct PgpDevice *pgpDevice);
+static int PgpCard_RingSetup(struct PgpDevice *pgpDevice, __u32 size);
+static int PgpCard_RingPut(struct PgpDevice *pgpDevice, struct RxBuffer *rxBuffer);
+static void PgpCard_RingWork(struct work_struct *work);
+static int PgpCard_RingMmap(struct PgpDevice *pgpDevice, struct vm_area_struct *vma);
 void PgpCard_VmOpen(struct vm_area_struct *vma);
 void PgpCard_VmClose(struct vm_area_struct *vma);
+void PgpCard_RingVmOpen(struct vm_area_struct *vma);
+void PgpCard_RingVmClose(struct vm_area_struct *vma);
 
 // PCI device IDs
 static struct pci_device_id PgpCard_Ids[] = {
@@ -194,6 +602,18 @@ struct file_operations PgpCard_Intf = {
    poll:    PgpCard_Poll,
    fasync:  PgpCard_Fasync,
    mmap:    PgpCard_Mmap,      
+   splice_read: PgpCard_SpliceRead,
+};
+
+// Pipe buffer operations for spliced RX buffers
+static struct pipe_buf_operations PgpCard_PipeOps = {
+  can_merge: 0,
+  map:       generic_pipe_buf_map,
+  unmap:     generic_pipe_buf_unmap,
+  confirm:   generic_pipe_buf_confirm,
+  release:   PgpCard_PipeRelease,
+  steal:     PgpCard_PipeSteal,
+  get:       PgpCard_PipeGet,
 };
 
 // Virtual memory operations
@@ -201,3 +621,9 @@ static struct vm_operations_struct PgpCard_VmOps = {
   open:  PgpCard_VmOpen,
   close: PgpCard_VmClose,
 };
+
+// Shared RX ring mappings, counted so that the ring is not freed while mapped
+static struct vm_operations_struct PgpCard_RingVmOps = {
+  open:  PgpCard_RingVmOpen,
+  close: PgpCard_RingVmClose,
+};
@@ -47,6 +47,14 @@ typedef struct {
 
 } PgpCardTx;
 
+// Gather write entry, size in bytes, total must be a dword multiple
+#define PGP_IOV_MAX 8
+typedef struct {
+   __u64   data;
+   __u32   size;
+   __u32   pad;
+} PgpCardIov;
+
 // RX Structure
 typedef struct {
     __u32   model; // large=8, small=4
@@ -65,8 +73,297 @@ typedef struct {
    __u32   fifoErr;
    __u32   lengthErr;
 
+   // Frame sequence numbers, filled in when the full structure is passed
+   // The structure without them is still accepted by read()
+   __u32   seq;   // Per lane/VC, a gap means the driver dropped frames
+   __u32   gseq;  // Per card
+
 } PgpCardRx;
 
+// DMA Pool Configuration, sizes in bytes
+typedef struct {
+   __u32   txCount;
+   __u32   txSize;
+   __u32   rxCount;
+   __u32   rxSize;
+   __u32   freeOnClose; // Release pools when the device is closed
+   __u32   rxStreaming; // RX buffers in cached memory with streaming DMA mappings, rxSize up to 256 pages
+} PgpCardPool;
+
+// Copy benchmark, times loops copies of size bytes from the RX pool to data, DMA syncs included
+typedef struct {
+   __u64   data;
+   __u32   size;        // Bytes per copy
+   __u32   loops;
+   __u32   streaming;   // Returned, RX pool allocation in use
+   __u32   pad;
+   __u64   nsec;        // Returned, elapsed time
+} PgpCardBench;
+
+// Pool buffer information for bypass mode, index and isTx are set by the caller
+typedef struct {
+   __u32   isTx;      // 0 = RX pool, 1 = TX pool
+   __u32   index;     // Buffer index within the pool
+   __u32   count;     // Number of buffers in the pool
+   __u32   size;      // Buffer size, bytes
+   __u32   stride;    // Buffer spacing in the pool mapping, bytes
+   __u32   mapOffset; // mmap offset of this buffer
+   __u32   dma;       // Bus address posted to rxFree or txWrB
+} PgpCardBufInfo;
+
+// Consumer group members per card
+#define PGP_GROUP_MAX 8
+
+// Driver Status Structure, counters are indexed by lane*4+vc
+typedef struct {
+   __u32   rxFilter;       // Lane/VC mask accepted by any open file
+   __u32   rxFiltered[32]; // Frames dropped by the receive filter
+   __u32   rxErrMode;      // Errored frame policy of the calling file
+   __u32   rxErrors[8];    // Errored frames received per lane
+   __u32   rxErrDropped[8];// Errored frames dropped per lane
+   __u32   rxGroupMask;    // Lane/VC mask served by the consumer group
+   __u32   rxGroup[PGP_GROUP_MAX];       // Lane/VC mask per member slot, 0 when free
+   __u32   rxGroupFrames[PGP_GROUP_MAX]; // Frames delivered per member slot
+   __u32   rxPrioMask;     // Lane/VC mask delivered with strict priority
+   __u32   rxPrioFrames;   // Frames queued with strict priority
+   __u32   txReaped;       // TX buffers reclaimed by writers before the interrupt
+   __u32   rxPauseMask;    // Lanes paused by IOCTL_Rx_Pause
+   __u32   rxPauseAuto;    // Lanes paused at the high water mark
+   __u32   rxHighWater;    // Automatic pause level, 0 when disabled
+   __u32   rxLaneHeld[8];  // Frames delivered and not yet returned per lane
+   __u32   rxPauses[8];    // Pauses per lane
+   __u32   rxRingSize;     // Shared RX ring size in bytes, 0 when stopped
+   __u32   rxRingFrames;   // Frames copied into the shared RX ring
+   __u32   rxRingFull;     // Times the shared RX ring had no room
+   __u32   rxSeqDrops[32]; // Numbered frames dropped by the driver
+} PgpCardDrvStatus;
+
+// Card configuration sections selected by PgpCardConfig.apply
+#define PGP_CFG_EVR_CTRL   0x01
+#define PGP_CFG_EVR_MASK   0x02
+#define PGP_CFG_EVR_CODES  0x04
+#define PGP_CFG_EVR_DELAYS 0x08
+#define PGP_CFG_LOOP       0x10
+#define PGP_CFG_RESET      0x20
+#define PGP_CFG_ALL        0x3F
+
+// Card Configuration Structure, an apply of zero only reads back
+typedef struct {
+   __u32   apply;          // Sections to write, PGP_CFG_*
+   __u32   evrCtrl;        // Bit 0 enable, bit 1 reset, bit 2 PLL reset
+   __u32   evrMask;        // EVR virtual channel mask
+   __u32   runCode[8];
+   __u32   acceptCode[8];
+   __u32   runDelay[8];
+   __u32   acceptDelay[8];
+   __u32   loopMask;       // Loopback lane mask
+   __u32   rxResetMask;    // RX reset lane mask
+   __u32   txResetMask;    // TX reset lane mask
+} PgpCardConfig;
+
+// Link Monitor Structure, times in milliseconds
+typedef struct {
+   __u32   laneMask;       // Lanes to watch, 0 to stop
+   __u32   period;         // Poll period
+   __u32   downLimit;      // Time a lane stays down before its resets are pulsed
+   __u32   linkDown;       // Lanes currently down
+   __u32   resets[8];      // Reset pulses per lane
+   __u32   recovered[8];   // Recoveries per lane
+   __u32   lastDown[8];    // Duration of the last outage per lane
+} PgpCardLinkMon;
+
+// Link monitor event types
+#define PGP_LINK_DOWN  0
+#define PGP_LINK_RESET 1
+#define PGP_LINK_UP    2
+
+// Link Event Structure
+typedef struct {
+   __u32   lane;
+   __u32   type;           // PGP_LINK_*
+   __u32   time;           // Event time, milliseconds
+   __u32   duration;       // Time the lane has been down, milliseconds
+   __u32   downCount;      // Lane link down counter
+} PgpCardLinkEvent;
+
+// Link State Event Structure, queued when a link ready or EVR ready bit changes
+typedef struct {
+   __u64   time;           // Sample time, nanoseconds of the monotonic clock
+   __u32   seq;            // Event number, a gap means older events were overwritten
+   __u32   locLink;        // Local link ready, bit per lane
+   __u32   remLink;        // Remote link ready, bit per lane
+   __u32   evrReady;
+   __u32   locChanged;     // Bits changed since the previous sample
+   __u32   remChanged;
+   __u32   evrChanged;
+   __u32   pad;
+} PgpCardStateEvent;
+
+// Trigger generator actions and op-code pattern length
+#define PGP_TRIG_START 1
+#define PGP_TRIG_STOP  2
+#define PGP_TRIG_CODES 8
+
+// Trigger Generator Structure, times in nanoseconds
+typedef struct {
+   __u32   apply;          // PGP_TRIG_START, PGP_TRIG_STOP or 0 to read back
+   __u32   period;         // Time between op-codes, 10000 minimum
+   __u32   count;          // Op-codes to send, 0 to run until stopped
+   __u32   codeCnt;        // Pattern length
+   __u32   opCode[PGP_TRIG_CODES]; // Op-codes sent in turn
+   __u32   running;        // Returned, generator is active
+   __u32   sent;           // Returned, op-codes sent
+   __u32   missed;         // Returned, periods skipped because the timer ran late
+   __u32   pad;
+   __u64   elapsed;        // Returned, time from start to the last op-code or now
+   __u64   lateAvg;        // Returned, average delay behind the ideal schedule
+   __u64   lateMax;        // Returned, largest delay behind the ideal schedule
+} PgpCardTrigger;
+
+// Counter sampling actions
+#define PGP_CNT_START 1
+#define PGP_CNT_STOP  2
+
+// Extended counters, 64 bit totals of the 4 bit pgpLaneStat fields and the 32 bit DMA counts
+typedef struct {
+   __u64   linkErr[8];
+   __u64   linkDown[8];
+   __u64   cellErr[8];
+   __u64   fifoErr[8];
+   __u64   rxCount[8][4];  // Per lane and VC
+   __u64   rxDma;          // rxCount register
+   __u64   txDma;          // txCount register
+} PgpCardCounters;
+
+// Counter Sampling Structure, an apply of zero only reads back
+typedef struct {
+   __u32   apply;          // PGP_CNT_START or PGP_CNT_STOP
+   __u32   period;         // Sampling period in microseconds, 100 minimum
+   __u32   snapEvery;      // Samples between queued snapshots, 0 for none
+   __u32   running;        // Returned, sampling is active
+   __u32   samples;        // Returned, samples taken
+   __u32   late;           // Returned, samples more than one period late, a 4 bit field may have wrapped
+} PgpCardCntConfig;
+
+// Counter Snapshot Structure
+typedef struct {
+   __u32   next;           // 0 for the current totals, 1 for the oldest queued snapshot
+   __u32   sample;         // Returned, sample number of the totals
+   __u64   time;           // Returned, sample time in nanoseconds of the monotonic clock
+   PgpCardCounters cnt;    // Returned, totals since load or the last count reset
+} PgpCardCntSnap;
+
+// DMA watchdog actions selected by PgpCardWatchdog.apply
+#define PGP_DOG_SET     1
+#define PGP_DOG_RECLAIM 2
+
+// DMA Watchdog Structure, times in milliseconds, an apply of zero only reads back
+typedef struct {
+   __u32   apply;          // PGP_DOG_SET to change the settings, PGP_DOG_RECLAIM to reclaim now
+   __u32   period;         // Check period, 0 to stop
+   __u32   txAge;          // TX buffer held by the card longer than this is stuck
+   __u32   rxAge;          // RX free list shortfall on an idle lane older than this is a loss
+   __u32   autoReclaim;    // Reclaim as soon as stuck or lost buffers are found
+   __u32   txStuck[8];     // TX buffers held past txAge per lane
+   __u32   txOldest[8];    // Age of the oldest TX buffer held by the card per lane
+   __u32   rxLost[8];      // RX buffers missing from the lane free list past rxAge
+   __u32   txReclaimed[8]; // TX buffers taken back per lane
+   __u32   rxReclaimed[8]; // RX buffers taken back per lane
+   __u32   reclaims;       // Reclaim passes run
+   __u32   lateDone;       // Completions received for TX buffers already taken back
+} PgpCardWatchdog;
+
+// Header peek, words copied from the start of the head frame
+#define PGP_PEEK_MAX 16
+
+// Peek Structure, peekSize is set by the caller and updated with the words copied
+typedef struct {
+   __u32   pgpLane;
+   __u32   pgpVc;
+   __u32   rxSize;  // dwords
+   __u32   eofe;
+   __u32   fifoErr;
+   __u32   lengthErr;
+   __u32   peekSize; // dwords
+   __u32   data[PGP_PEEK_MAX];
+   __u32   seq;      // Per lane/VC frame sequence
+   __u32   gseq;     // Per card frame sequence
+} PgpCardPeek;
+
+// User RX region, addr is page aligned and bufSize a multiple of the page size
+typedef struct {
+   __u64   addr;
+   __u64   size;    // bytes
+   __u32   bufSize; // bytes
+   __u32   count;   // Buffers carved from the region, set by the driver
+} PgpCardRegion;
+
+// User RX region frame descriptor
+typedef struct {
+   __u32   index;   // Pass back to IOCTL_Rx_User_Return
+   __u32   pad;
+   __u64   offset;  // Frame location in the region, bytes
+   __u32   pgpLane;
+   __u32   pgpVc;
+   __u32   rxSize;  // dwords
+   __u32   eofe;
+   __u32   fifoErr;
+   __u32   lengthErr;
+   __u32   seq;     // Per lane/VC frame sequence
+   __u32   gseq;    // Per card frame sequence
+} PgpCardRxDesc;
+
+// Splice header, written ahead of each frame spliced from the device
+typedef struct {
+   __u32   pgpLane;
+   __u32   pgpVc;
+   __u32   rxSize;   // dwords received
+   __u32   dataSize; // dwords following the header
+   __u32   eofe;
+   __u32   fifoErr;
+   __u32   lengthErr;
+} PgpCardSpliceHdr;
+
+// Shared RX ring header, first page of the ring mapping, records start at dataOff
+// The driver advances head past each record it writes, the application advances tail past each
+// record it consumes. The ring is empty when head equals tail, offsets are relative to dataOff.
+typedef struct {
+   __u32   size;      // Record area size, bytes
+   __u32   dataOff;   // Offset of the record area in the mapping
+   __u32   head;      // Producer offset, written by the driver
+   __u32   tail;      // Consumer offset, written by the application
+   __u32   frames;    // Frames copied into the ring
+   __u32   full;      // Times the driver found no room, frames stay queued in the driver
+} PgpCardRingHdr;
+
+// Shared RX ring record, followed by dataSize dwords and padded to 8 bytes
+// A record with pgpLane set to PGP_RING_WRAP fills the end of the ring, the next one is at offset 0
+typedef struct {
+   __u32   recSize;   // Bytes to the next record
+   __u32   pgpLane;
+   __u32   pgpVc;
+   __u32   rxSize;    // dwords received
+   __u32   dataSize;  // dwords following the record
+   __u32   eofe;
+   __u32   fifoErr;
+   __u32   lengthErr;
+   __u32   seq;       // Per lane/VC frame sequence
+   __u32   gseq;      // Per card frame sequence
+} PgpCardRingRec;
+
+#define PGP_RING_WRAP 0xFFFFFFFF
+
+// Errored frame policy
+#define PGP_RX_ERR_DELIVER 0 // Copy payload and report error flags
+#define PGP_RX_ERR_DROP    1 // Drop in the driver, counted in rxErrDropped
+#define PGP_RX_ERR_META    2 // Report size and error flags only, read returns 0 words
+
+// Memory map offsets, the register space is mapped at offset 0
+// TX pool mappings must fit below the RX pool offset
+#define PGP_MAP_RX_RING 0x10000000
+#define PGP_MAP_TX_POOL 0x20000000
+#define PGP_MAP_RX_POOL 0x40000000
+
 // Status Structure
 typedef struct {
 
@@ -215,6 +512,14 @@ struct PgpCardReg {
 // No Operation
 #define IOCTL_Pgp_OpCode 0x04
 
+// Zero copy write, same arguments as IOCTL_Normal_Write
+// Frames the card can not reach in one descriptor are copied and complete at once
+#define IOCTL_ZeroCopy_Write 0x05
+
+// Gather write, data points to a PgpCardIov list and size is the entry count
+// The entries are copied back to back into one frame, returns the frame size in dwords
+#define IOCTL_Gather_Write   0x06
+
 // Set Loopback, Pass PGP Channel As Arg
 #define IOCTL_Set_Loop 0x10
 #define IOCTL_Clr_Loop 0x11
@@ -274,6 +579,131 @@ struct PgpCardReg {
 #define IOCTL_Evr_AcceptDelay6 0x4E
 #define IOCTL_Evr_AcceptDelay7 0x4F
 
+// TX lane scheduling
+// Quota:  Pass max buffers held by a single lane as arg
+// Weight: Pass (weight << 8) | lane as arg, weight 1 to 4096
+// Thresh: Pass hardware fifo count at which descriptors are held back as arg, 0 to disable
+// Poll:   Pass mask of lanes considered for writability in poll/select as arg
+#define IOCTL_Tx_Lane_Quota  0x50
+#define IOCTL_Tx_Lane_Weight 0x51
+#define IOCTL_Tx_Fifo_Thresh 0x52
+#define IOCTL_Tx_Poll_Mask   0x53
+
+// RX buffer return batching, pass returns to group, free list low water mark or flush delay in usec
+// A batch size of 1 returns every buffer as soon as it is read
+#define IOCTL_Rx_Ret_Batch   0x54
+#define IOCTL_Rx_Ret_Thresh  0x55
+#define IOCTL_Rx_Ret_Delay   0x56
+
+// Set lane/VC receive filter for this file, Pass mask as arg, bit lane*4+vc set to accept
+// The card drops frames no open file accepts, they are counted and their buffers go straight back to the card
+#define IOCTL_Rx_Filter      0x57
+
+// Read driver status, Pass pointer to PgpCardDrvStatus as arg
+#define IOCTL_Read_Drv_Status 0x58
+
+// Set errored frame policy for this file, Pass PGP_RX_ERR_DELIVER, PGP_RX_ERR_DROP or PGP_RX_ERR_META as arg
+// The policy applies to frames this file reads or splices, the shared ring keeps the policy of the file that started it
+#define IOCTL_Rx_Err_Mode    0x59
+
+// Peek at the head frame without consuming it, Pass pointer to PgpCardPeek as arg
+// Returns -EAGAIN when no frame is queued, a following read consumes the frame
+#define IOCTL_Rx_Peek        0x5A
+
+// Discard the head frame without copying it, returns -EAGAIN when no frame is queued
+#define IOCTL_Rx_Discard     0x5B
+
+// Next user buffer released by a zero copy write, Pass pointer to __u64 as arg
+// Returns -EAGAIN when none is pending
+#define IOCTL_ZeroCopy_Done  0x5C
+
+// Apply a card configuration in one call, Pass pointer to PgpCardConfig as arg
+// The structure is overwritten with the read back configuration
+#define IOCTL_Card_Config    0x5D
+
+// Configure the link monitor, Pass pointer to PgpCardLinkMon as arg
+// A period of zero leaves the settings unchanged, the counters are read back
+#define IOCTL_Link_Monitor   0x5E
+
+// Next link monitor event, Pass pointer to PgpCardLinkEvent as arg
+// Returns -EAGAIN when no event is pending
+#define IOCTL_Link_Event     0x5F
+
+// Set lane/VC strict priority mask, Pass mask as arg, bit lane*4+vc set for priority
+// Priority frames are read ahead of every other queued frame, by the shared queue and by group members
+#define IOCTL_Rx_Priority    0x67
+
+// Op-code trigger generator, Pass pointer to PgpCardTrigger as arg
+// The structure is overwritten with the generator settings and statistics
+#define IOCTL_Trig_Gen       0x66
+
+// Allocate DMA pools, Pass pointer to PgpCardPool as arg, 0 for module defaults
+#define IOCTL_Pool_Arm       0x60
+
+// Release DMA pools once the card has returned all TX buffers
+#define IOCTL_Pool_Release   0x61
+
+// Quiesce and reallocate DMA pools, Pass pointer to PgpCardPool as arg, resulting sizing is returned
+#define IOCTL_Pool_Resize    0x62
+
+// Time copies from the RX pool to user space, Pass pointer to PgpCardBench as arg
+#define IOCTL_Copy_Bench     0x63
+
+// Consumer group, each frame for the lane/VC mask (bit lane*4+vc) goes to the least loaded member
+// Members read their frames with read(), frames no member accepts stay on the shared queue
+#define IOCTL_Rx_Group_Join  0x64
+#define IOCTL_Rx_Group_Leave 0x65
+
+// Bypass mode, the opener drives rxFree/txWrA/txWrB and polls rxRead/txRead with interrupts masked
+// Enable requires all TX buffers to be free and no other open file, further opens fail while enabled.
+// Only the enabling file may map the pools or disable, disable waits for the lane fifos to drain.
+#define IOCTL_Bypass_Enable  0x68
+#define IOCTL_Bypass_Disable 0x69
+
+// Pool buffer information, Pass pointer to PgpCardBufInfo as arg
+#define IOCTL_Bypass_BufInfo 0x6A
+
+// DMA watchdog, Pass pointer to PgpCardWatchdog as arg
+// The structure is overwritten with the settings and the per lane report
+#define IOCTL_Dma_Watchdog   0x6B
+
+// Receive directly into a pinned user region, Pass pointer to PgpCardRegion as arg
+// read() is unavailable while registered, frames are taken with IOCTL_Rx_User_Recv
+#define IOCTL_Rx_User_Register   0x6C
+#define IOCTL_Rx_User_Unregister 0x6D
+
+// Receive backpressure, buffers of a paused lane are not given back to its free list so that
+// PGP flow control holds off the remote end, no frames are dropped
+// Pause: Pass mask of lanes to pause as arg, lanes not in the mask are resumed
+// High:  Pass frames held per lane at which the lane pauses until half are returned, 0 to disable
+#define IOCTL_Rx_Pause           0x70
+#define IOCTL_Rx_High_Water      0x71
+
+// Shared RX ring, Pass pointer to __u32 ring size in bytes as arg, 0 to stop
+// The size is overwritten with the length to mmap at PGP_MAP_RX_RING. Frames not taken by a
+// consumer group member are copied into the ring and their buffers go straight back to the card.
+// read(), peek, discard and splice are unavailable while the ring runs.
+#define IOCTL_Rx_Ring            0x72
+
+// Extended counters, the driver samples pgpLaneStat and the DMA counts on a timer and keeps 64 bit totals
+// Config:   Pass pointer to PgpCardCntConfig as arg, the structure is overwritten with the settings
+// Snapshot: Pass pointer to PgpCardCntSnap as arg, returns -EAGAIN when next is set and none is queued
+#define IOCTL_Cnt_Config         0x73
+#define IOCTL_Cnt_Snapshot       0x74
+
+// Link state watch, changes of the link ready and EVR ready bits are queued and raise POLLPRI
+// The driver watches while the link monitor runs or any file polls, uses SIGIO or asked to watch
+// Watch: Pass sampling period in microseconds as arg, 100 minimum, 0 to stop watching until the next poll
+// Event: Pass pointer to PgpCardStateEvent as arg, returns -EAGAIN when no event is pending
+#define IOCTL_Link_State         0x75
+#define IOCTL_Link_State_Event   0x76
+
+// Take the next frame, Pass pointer to PgpCardRxDesc as arg, returns -EAGAIN when none is queued
+#define IOCTL_Rx_User_Recv       0x6E
+
+// Return a user region buffer to the card, Pass buffer index as arg
+#define IOCTL_Rx_User_Return     0x6F
+
 // Set Debug, Pass Debug Value As Arg
 #define IOCTL_Set_Debug 0xFE
 
@@ -29,9 +29,20 @@
 // Send Frame, size in dwords
 // int pgpcard_send(int fd, void *buf, size_t count, uint lane, uint vc);
 
+// Send Frame from the user buffer without a copy, size in dwords
+// The buffer must not be modified until pgpcard_zeroCopyDone returns its address
+// int pgpcard_sendZeroCopy(int fd, void *buf, size_t count, uint lane, uint vc);
+// int pgpcard_zeroCopyDone(int fd, __u64 *addr);
+
+// Send Frame gathered from a list of buffers, entry sizes in bytes, returns frame size in dwords
+// int pgpcard_sendv(int fd, PgpCardIov *iov, uint count, uint lane, uint vc);
+
 // Receive Frame, size in dwords, return in dwords
 // int pgpcard_recv(int fd, void *buf, size_t maxSize, uint *lane, uint *vc, uint *eofe, uint *fifoErr, uint *lengthErr);
 
+// Receive Frame with its per lane/VC and per card sequence numbers
+// int pgpcard_recvSeq(int fd, void *buf, size_t maxSize, uint *lane, uint *vc, uint *eofe, uint *fifoErr, uint *lengthErr, uint *seq, uint *gseq);
+
 // Send PGP OP-Code
 // int pgpcard_sendOpCode(int fd, uint opCode);
 
@@ -80,6 +91,107 @@
 // Set EVR Virtual Channel Masking
 // int pgpcard_evrMask(int fd, uint mask) {
 
+// Apply EVR, loopback and reset configuration in one call, config is overwritten with the read back state
+// int pgpcard_config(int fd, PgpCardConfig *config)
+
+// Configure the link monitor, a period of zero only reads back the counters
+// int pgpcard_linkMonitor(int fd, PgpCardLinkMon *mon)
+
+// Get the next link monitor event, returns -1 when none are pending
+// int pgpcard_linkEvent(int fd, PgpCardLinkEvent *event)
+
+// Start, stop or read back the op-code trigger generator, trig is overwritten with its statistics
+// int pgpcard_trigGen(int fd, PgpCardTrigger *trig)
+
+// Configure the DMA watchdog or reclaim stuck buffers, dog is overwritten with the per lane report
+// int pgpcard_dmaWatchdog(int fd, PgpCardWatchdog *dog)
+
+// Set TX per lane buffer quota
+// int pgpcard_setTxLaneQuota(int fd, uint quota)
+
+// Set TX scheduler weight for a lane
+// int pgpcard_setTxLaneWeight(int fd, uint lane, uint weight)
+
+// Set TX hardware fifo count at which descriptors are held back, 0 to disable
+// int pgpcard_setTxFifoThresh(int fd, uint thresh)
+
+// Set lanes considered for writability in poll/select
+// int pgpcard_setTxPollMask(int fd, uint mask)
+
+// Set number of RX buffer returns grouped together, 1 to disable
+// int pgpcard_setRxRetBatch(int fd, uint count)
+
+// Set lane/VC receive filter, bit lane*4+vc set to accept
+// int pgpcard_setRxFilter(int fd, uint mask)
+
+// Set lane/VC mask delivered ahead of all other frames, bit lane*4+vc
+// int pgpcard_setRxPriority(int fd, uint mask)
+
+// Pause receive on a lane mask, resume the others, or set the automatic pause level
+// int pgpcard_setRxPause(int fd, uint mask)
+// int pgpcard_setRxHighWater(int fd, uint frames)
+
+// Start the shared RX ring with size bytes, 0 to stop, size returns the length to map at PGP_MAP_RX_RING
+// int pgpcard_rxRing(int fd, uint *size)
+
+// Configure counter sampling, read the current 64 bit counter totals or the oldest queued snapshot
+// int pgpcard_cntConfig(int fd, PgpCardCntConfig *cfg)
+// int pgpcard_cntRead(int fd, PgpCardCntSnap *snap)
+// int pgpcard_cntSnapshot(int fd, PgpCardCntSnap *snap)
+
+// Watch the link and EVR ready bits, poll() reports POLLPRI while change events are pending
+// int pgpcard_linkState(int fd, uint usec)
+// int pgpcard_linkStateEvent(int fd, PgpCardStateEvent *event)
+
+// Read driver status
+// int pgpcard_drvStatus(int fd, PgpCardDrvStatus *status)
+
+// Set errored frame policy, PGP_RX_ERR_DELIVER, PGP_RX_ERR_DROP or PGP_RX_ERR_META
+// int pgpcard_setRxErrMode(int fd, uint mode)
+
+// Peek at metadata and the first words of the next frame, pgpcard_recv then consumes it
+// int pgpcard_peek(int fd, PgpCardPeek *peek)
+
+// Discard the next frame without copying it
+// int pgpcard_discard(int fd)
+
+// Join the consumer group for a lane/VC mask, bit lane*4+vc, or leave it
+// int pgpcard_groupJoin(int fd, uint mask)
+// int pgpcard_groupLeave(int fd)
+
+// Set RX free list low water mark that forces returns out
+// int pgpcard_setRxRetThresh(int fd, uint thresh)
+
+// Set delay after which pending RX returns are flushed
+// int pgpcard_setRxRetDelay(int fd, uint usec)
+
+// Allocate DMA pools, pool may be NULL for module defaults
+// int pgpcard_poolArm(int fd, PgpCardPool *pool)
+
+// Release DMA pools
+// int pgpcard_poolRelease(int fd)
+
+// Quiesce the card and reallocate DMA pools, pool is updated with the resulting sizing
+// int pgpcard_poolResize(int fd, PgpCardPool *pool)
+
+// Time copies from the RX pool buffers to user space
+// int pgpcard_copyBench(int fd, PgpCardBench *bench)
+
+// Enter or leave bypass mode
+// int pgpcard_bypassEnable(int fd)
+// int pgpcard_bypassDisable(int fd)
+
+// Get pool buffer information, set info->isTx and info->index before the call
+// int pgpcard_bufInfo(int fd, PgpCardBufInfo *info)
+
+// Receive directly into a pinned user region, region->count returns the number of buffers
+// int pgpcard_rxRegister(int fd, PgpCardRegion *region)
+// int pgpcard_rxUnregister(int fd)
+
+// Take the next frame from the user region and return its buffer when done
+// int pgpcard_rxUserRecv(int fd, PgpCardRxDesc *desc)
+// int pgpcard_rxUserReturn(int fd, uint index)
+
 // Set debug
 // int pgpcard_setDebug(int fd, uint level);
 
@@ -101,6 +213,44 @@ inline int pgpcard_send(int fd, void *buf, size_t size, uint lane, uint vc) {
    return(write(fd,&pgpCardTx,sizeof(PgpCardTx)));
 }
 
+// Send Frame from the user buffer without a copy, size in dwords
+inline int pgpcard_sendZeroCopy(int fd, void *buf, size_t size, uint lane, uint vc) {
+   PgpCardTx pgpCardTx;
+
+   pgpCardTx.model   = (sizeof(buf));
+   pgpCardTx.cmd     = IOCTL_ZeroCopy_Write;
+   pgpCardTx.pgpVc   = vc;
+   pgpCardTx.pgpLane = lane;
+   pgpCardTx.size    = size;
+   pgpCardTx.data    = (__u32*)buf;
+
+   return(write(fd,&pgpCardTx,sizeof(PgpCardTx)));
+}
+
+// Send Frame gathered from a list of buffers, entry sizes in bytes
+inline int pgpcard_sendv(int fd, PgpCardIov *iov, uint count, uint lane, uint vc) {
+   PgpCardTx pgpCardTx;
+
+   pgpCardTx.model   = (sizeof(iov));
+   pgpCardTx.cmd     = IOCTL_Gather_Write;
+   pgpCardTx.pgpVc   = vc;
+   pgpCardTx.pgpLane = lane;
+   pgpCardTx.size    = count;
+   pgpCardTx.data    = (__u32*)iov;
+
+   return(write(fd,&pgpCardTx,sizeof(PgpCardTx)));
+}
+
+// Get the next user buffer released by a zero copy send, returns -1 when none are pending
+inline int pgpcard_zeroCopyDone(int fd, __u64 *addr) {
+   PgpCardTx  t;
+
+   t.model = (sizeof(PgpCardTx*));
+   t.cmd   = IOCTL_ZeroCopy_Done;
+   t.data  = (__u32*)addr;
+   return(write(fd, &t, sizeof(PgpCardTx)));
+}
+
 // Receive Frame, size in dwords, return in dwords
 inline int pgpcard_recv(int fd, void *buf, size_t maxSize, uint *lane, uint *vc, uint *eofe, uint *fifoErr, uint *lengthErr) {
    PgpCardRx pgpCardRx;
@@ -121,6 +271,28 @@ inline int pgpcard_recv(int fd, void *buf, size_t maxSize, uint *lane, uint *vc,
    return(ret);
 }
 
+// Receive Frame with sequence numbers
+inline int pgpcard_recvSeq(int fd, void *buf, size_t maxSize, uint *lane, uint *vc, uint *eofe, uint *fifoErr, uint *lengthErr, uint *seq, uint *gseq) {
+   PgpCardRx pgpCardRx;
+   int       ret;
+
+   pgpCardRx.maxSize = maxSize;
+   pgpCardRx.data    = (__u32*)buf;
+   pgpCardRx.model   = sizeof(buf);
+
+   ret = read(fd,&pgpCardRx,sizeof(PgpCardRx));
+
+   *lane      = pgpCardRx.pgpLane;
+   *vc        = pgpCardRx.pgpVc;
+   *eofe      = pgpCardRx.eofe;
+   *fifoErr   = pgpCardRx.fifoErr;
+   *lengthErr = pgpCardRx.lengthErr;
+   *seq       = pgpCardRx.seq;
+   *gseq      = pgpCardRx.gseq;
+
+   return(ret);
+}
+
 // Send PGP OP-Code
 inline int pgpcard_sendOpCode(int fd, uint opCode){
    PgpCardTx  t;
@@ -447,6 +619,399 @@ inline int pgpcard_evrMask(int fd, uint mask) {
    return(write(fd, &t, sizeof(PgpCardTx)));
 }
 
+// Apply EVR, loopback and reset configuration in one call
+// Only the sections set in config->apply are written, config is overwritten with the read back state
+inline int pgpcard_config(int fd, PgpCardConfig *config) {
+   PgpCardTx  t;
+
+   t.model = sizeof(PgpCardTx*);
+   t.cmd   = IOCTL_Card_Config;
+   t.data  = (__u32*) config;
+   return(write(fd, &t, sizeof(PgpCardTx)));
+}
+
+// Configure the link monitor, a period of zero only reads back the counters
+inline int pgpcard_linkMonitor(int fd, PgpCardLinkMon *mon) {
+   PgpCardTx  t;
+
+   t.model = sizeof(PgpCardTx*);
+   t.cmd   = IOCTL_Link_Monitor;
+   t.data  = (__u32*) mon;
+   return(write(fd, &t, sizeof(PgpCardTx)));
+}
+
+// Get the next link monitor event
+inline int pgpcard_linkEvent(int fd, PgpCardLinkEvent *event) {
+   PgpCardTx  t;
+
+   t.model = sizeof(PgpCardTx*);
+   t.cmd   = IOCTL_Link_Event;
+   t.data  = (__u32*) event;
+   return(write(fd, &t, sizeof(PgpCardTx)));
+}
+
+// Start, stop or read back the op-code trigger generator
+inline int pgpcard_trigGen(int fd, PgpCardTrigger *trig) {
+   PgpCardTx  t;
+
+   t.model = sizeof(PgpCardTx*);
+   t.cmd   = IOCTL_Trig_Gen;
+   t.data  = (__u32*) trig;
+   return(write(fd, &t, sizeof(PgpCardTx)));
+}
+
+// Configure, trigger or read back the DMA watchdog
+inline int pgpcard_dmaWatchdog(int fd, PgpCardWatchdog *dog) {
+   PgpCardTx  t;
+
+   t.model = sizeof(PgpCardTx*);
+   t.cmd   = IOCTL_Dma_Watchdog;
+   t.data  = (__u32*) dog;
+   return(write(fd, &t, sizeof(PgpCardTx)));
+}
+
+// Set TX per lane buffer quota
+inline int pgpcard_setTxLaneQuota(int fd, uint quota) {
+   PgpCardTx  t;
+
+   t.model = sizeof(PgpCardTx*);
+   t.cmd   = IOCTL_Tx_Lane_Quota;
+   t.data  = (__u32*)(unsigned long) quota;
+   return(write(fd, &t, sizeof(PgpCardTx)));
+}
+
+// Set TX scheduler weight for a lane
+inline int pgpcard_setTxLaneWeight(int fd, uint lane, uint weight) {
+   PgpCardTx  t;
+
+   t.model = sizeof(PgpCardTx*);
+   t.cmd   = IOCTL_Tx_Lane_Weight;
+   t.data  = (__u32*)(unsigned long) ((weight << 8) | (lane & 0x7));
+   return(write(fd, &t, sizeof(PgpCardTx)));
+}
+
+// Set TX hardware fifo count at which descriptors are held back, 0 to disable
+inline int pgpcard_setTxFifoThresh(int fd, uint thresh) {
+   PgpCardTx  t;
+
+   t.model = sizeof(PgpCardTx*);
+   t.cmd   = IOCTL_Tx_Fifo_Thresh;
+   t.data  = (__u32*)(unsigned long) thresh;
+   return(write(fd, &t, sizeof(PgpCardTx)));
+}
+
+// Set lanes considered for writability in poll/select
+inline int pgpcard_setTxPollMask(int fd, uint mask) {
+   PgpCardTx  t;
+
+   t.model = sizeof(PgpCardTx*);
+   t.cmd   = IOCTL_Tx_Poll_Mask;
+   t.data  = (__u32*)(unsigned long) mask;
+   return(write(fd, &t, sizeof(PgpCardTx)));
+}
+
+// Set lane/VC receive filter
+inline int pgpcard_setRxFilter(int fd, uint mask) {
+   PgpCardTx  t;
+
+   t.model = sizeof(PgpCardTx*);
+   t.cmd   = IOCTL_Rx_Filter;
+   t.data  = (__u32*)(unsigned long) mask;
+   return(write(fd, &t, sizeof(PgpCardTx)));
+}
+
+// Set lane/VC strict priority mask
+inline int pgpcard_setRxPriority(int fd, uint mask) {
+   PgpCardTx  t;
+
+   t.model = sizeof(PgpCardTx*);
+   t.cmd   = IOCTL_Rx_Priority;
+   t.data  = (__u32*)(unsigned long) mask;
+   return(write(fd, &t, sizeof(PgpCardTx)));
+}
+
+// Pause receive on a lane mask, lanes not in the mask are resumed
+inline int pgpcard_setRxPause(int fd, uint mask) {
+   PgpCardTx  t;
+
+   t.model = sizeof(PgpCardTx*);
+   t.cmd   = IOCTL_Rx_Pause;
+   t.data  = (__u32*)(unsigned long) mask;
+   return(write(fd, &t, sizeof(PgpCardTx)));
+}
+
+// Set frames held per lane at which receive pauses, 0 to disable
+inline int pgpcard_setRxHighWater(int fd, uint frames) {
+   PgpCardTx  t;
+
+   t.model = sizeof(PgpCardTx*);
+   t.cmd   = IOCTL_Rx_High_Water;
+   t.data  = (__u32*)(unsigned long) frames;
+   return(write(fd, &t, sizeof(PgpCardTx)));
+}
+
+// Start or stop the shared RX ring
+inline int pgpcard_rxRing(int fd, uint *size) {
+   PgpCardTx  t;
+
+   t.model = sizeof(PgpCardTx*);
+   t.cmd   = IOCTL_Rx_Ring;
+   t.data  = (__u32*) size;
+   return(write(fd, &t, sizeof(PgpCardTx)));
+}
+
+// Configure counter sampling
+inline int pgpcard_cntConfig(int fd, PgpCardCntConfig *cfg) {
+   PgpCardTx  t;
+
+   t.model = sizeof(PgpCardTx*);
+   t.cmd   = IOCTL_Cnt_Config;
+   t.data  = (__u32*) cfg;
+   return(write(fd, &t, sizeof(PgpCardTx)));
+}
+
+// Read the current counter totals
+inline int pgpcard_cntRead(int fd, PgpCardCntSnap *snap) {
+   PgpCardTx  t;
+
+   snap->next = 0;
+   t.model = sizeof(PgpCardTx*);
+   t.cmd   = IOCTL_Cnt_Snapshot;
+   t.data  = (__u32*) snap;
+   return(write(fd, &t, sizeof(PgpCardTx)));
+}
+
+// Take the oldest queued counter snapshot
+inline int pgpcard_cntSnapshot(int fd, PgpCardCntSnap *snap) {
+   PgpCardTx  t;
+
+   snap->next = 1;
+   t.model = sizeof(PgpCardTx*);
+   t.cmd   = IOCTL_Cnt_Snapshot;
+   t.data  = (__u32*) snap;
+   return(write(fd, &t, sizeof(PgpCardTx)));
+}
+
+// Set the link state sampling period, 0 to stop watching until the next poll
+inline int pgpcard_linkState(int fd, uint usec) {
+   PgpCardTx  t;
+
+   t.model = sizeof(PgpCardTx*);
+   t.cmd   = IOCTL_Link_State;
+   t.data  = (__u32*)(unsigned long) usec;
+   return(write(fd, &t, sizeof(PgpCardTx)));
+}
+
+// Take the next link state event
+inline int pgpcard_linkStateEvent(int fd, PgpCardStateEvent *event) {
+   PgpCardTx  t;
+
+   t.model = sizeof(PgpCardTx*);
+   t.cmd   = IOCTL_Link_State_Event;
+   t.data  = (__u32*) event;
+   return(write(fd, &t, sizeof(PgpCardTx)));
+}
+
+// Read driver status
+inline int pgpcard_drvStatus(int fd, PgpCardDrvStatus *status) {
+   PgpCardTx  t;
+
+   t.model = sizeof(PgpCardTx*);
+   t.cmd   = IOCTL_Read_Drv_Status;
+   t.data  = (__u32*) status;
+   return(write(fd, &t, sizeof(PgpCardTx)));
+}
+
+// Peek at the next frame
+inline int pgpcard_peek(int fd, PgpCardPeek *peek) {
+   PgpCardTx  t;
+
+   t.model = sizeof(PgpCardTx*);
+   t.cmd   = IOCTL_Rx_Peek;
+   t.data  = (__u32*) peek;
+   return(write(fd, &t, sizeof(PgpCardTx)));
+}
+
+// Discard the next frame
+inline int pgpcard_discard(int fd) {
+   PgpCardTx  t;
+
+   t.model = sizeof(PgpCardTx*);
+   t.cmd   = IOCTL_Rx_Discard;
+   t.data  = (__u32*) 0x0;
+   return(write(fd, &t, sizeof(PgpCardTx)));
+}
+
+// Join the consumer group for a lane/VC mask
+inline int pgpcard_groupJoin(int fd, uint mask) {
+   PgpCardTx  t;
+
+   t.model = sizeof(PgpCardTx*);
+   t.cmd   = IOCTL_Rx_Group_Join;
+   t.data  = (__u32*)(unsigned long) mask;
+   return(write(fd, &t, sizeof(PgpCardTx)));
+}
+
+// Leave the consumer group
+inline int pgpcard_groupLeave(int fd) {
+   PgpCardTx  t;
+
+   t.model = sizeof(PgpCardTx*);
+   t.cmd   = IOCTL_Rx_Group_Leave;
+   t.data  = (__u32*) 0x0;
+   return(write(fd, &t, sizeof(PgpCardTx)));
+}
+
+// Set errored frame policy
+inline int pgpcard_setRxErrMode(int fd, uint mode) {
+   PgpCardTx  t;
+
+   t.model = sizeof(PgpCardTx*);
+   t.cmd   = IOCTL_Rx_Err_Mode;
+   t.data  = (__u32*)(unsigned long) mode;
+   return(write(fd, &t, sizeof(PgpCardTx)));
+}
+
+// Set number of RX buffer returns grouped together, 1 to disable
+inline int pgpcard_setRxRetBatch(int fd, uint count) {
+   PgpCardTx  t;
+
+   t.model = sizeof(PgpCardTx*);
+   t.cmd   = IOCTL_Rx_Ret_Batch;
+   t.data  = (__u32*)(unsigned long) count;
+   return(write(fd, &t, sizeof(PgpCardTx)));
+}
+
+// Set RX free list low water mark that forces returns out
+inline int pgpcard_setRxRetThresh(int fd, uint thresh) {
+   PgpCardTx  t;
+
+   t.model = sizeof(PgpCardTx*);
+   t.cmd   = IOCTL_Rx_Ret_Thresh;
+   t.data  = (__u32*)(unsigned long) thresh;
+   return(write(fd, &t, sizeof(PgpCardTx)));
+}
+
+// Set delay after which pending RX returns are flushed
+inline int pgpcard_setRxRetDelay(int fd, uint usec) {
+   PgpCardTx  t;
+
+   t.model = sizeof(PgpCardTx*);
+   t.cmd   = IOCTL_Rx_Ret_Delay;
+   t.data  = (__u32*)(unsigned long) usec;
+   return(write(fd, &t, sizeof(PgpCardTx)));
+}
+
+// Allocate DMA pools, pool may be NULL for module defaults
+inline int pgpcard_poolArm(int fd, PgpCardPool *pool) {
+   PgpCardTx  t;
+
+   t.model = sizeof(PgpCardTx*);
+   t.cmd   = IOCTL_Pool_Arm;
+   t.data  = (__u32*) pool;
+   return(write(fd, &t, sizeof(PgpCardTx)));
+}
+
+// Release DMA pools
+inline int pgpcard_poolRelease(int fd) {
+   PgpCardTx  t;
+
+   t.model = sizeof(PgpCardTx*);
+   t.cmd   = IOCTL_Pool_Release;
+   t.data  = (__u32*) 0x0;
+   return(write(fd, &t, sizeof(PgpCardTx)));
+}
+
+// Quiesce the card and reallocate DMA pools, pool is updated with the resulting sizing
+inline int pgpcard_poolResize(int fd, PgpCardPool *pool) {
+   PgpCardTx  t;
+
+   t.model = sizeof(PgpCardTx*);
+   t.cmd   = IOCTL_Pool_Resize;
+   t.data  = (__u32*) pool;
+   return(write(fd, &t, sizeof(PgpCardTx)));
+}
+
+// Time copies from the RX pool buffers to user space
+inline int pgpcard_copyBench(int fd, PgpCardBench *bench) {
+   PgpCardTx  t;
+
+   t.model = sizeof(PgpCardTx*);
+   t.cmd   = IOCTL_Copy_Bench;
+   t.data  = (__u32*) bench;
+   return(write(fd, &t, sizeof(PgpCardTx)));
+}
+
+// Enter bypass mode
+inline int pgpcard_bypassEnable(int fd) {
+   PgpCardTx  t;
+
+   t.model = sizeof(PgpCardTx*);
+   t.cmd   = IOCTL_Bypass_Enable;
+   t.data  = (__u32*) 0x0;
+   return(write(fd, &t, sizeof(PgpCardTx)));
+}
+
+// Leave bypass mode
+inline int pgpcard_bypassDisable(int fd) {
+   PgpCardTx  t;
+
+   t.model = sizeof(PgpCardTx*);
+   t.cmd   = IOCTL_Bypass_Disable;
+   t.data  = (__u32*) 0x0;
+   return(write(fd, &t, sizeof(PgpCardTx)));
+}
+
+// Get pool buffer information
+inline int pgpcard_bufInfo(int fd, PgpCardBufInfo *info) {
+   PgpCardTx  t;
+
+   t.model = sizeof(PgpCardTx*);
+   t.cmd   = IOCTL_Bypass_BufInfo;
+   t.data  = (__u32*) info;
+   return(write(fd, &t, sizeof(PgpCardTx)));
+}
+
+// Receive into a user region
+inline int pgpcard_rxRegister(int fd, PgpCardRegion *region) {
+   PgpCardTx  t;
+
+   t.model = sizeof(PgpCardTx*);
+   t.cmd   = IOCTL_Rx_User_Register;
+   t.data  = (__u32*) region;
+   return(write(fd, &t, sizeof(PgpCardTx)));
+}
+
+// Release the user region
+inline int pgpcard_rxUnregister(int fd) {
+   PgpCardTx  t;
+
+   t.model = sizeof(PgpCardTx*);
+   t.cmd   = IOCTL_Rx_User_Unregister;
+   t.data  = (__u32*) 0x0;
+   return(write(fd, &t, sizeof(PgpCardTx)));
+}
+
+// Take the next frame from the user region
+inline int pgpcard_rxUserRecv(int fd, PgpCardRxDesc *desc) {
+   PgpCardTx  t;
+
+   t.model = sizeof(PgpCardTx*);
+   t.cmd   = IOCTL_Rx_User_Recv;
+   t.data  = (__u32*) desc;
+   return(write(fd, &t, sizeof(PgpCardTx)));
+}
+
+// Return a user region buffer
+inline int pgpcard_rxUserReturn(int fd, uint index) {
+   PgpCardTx  t;
+
+   t.model = sizeof(PgpCardTx*);
+   t.cmd   = IOCTL_Rx_User_Return;
+   t.data  = (__u32*)(unsigned long) index;
+   return(write(fd, &t, sizeof(PgpCardTx)));
+}
+
 // Set debug
 inline int pgpcard_setDebug(int fd, uint level) {
    PgpCardTx  t;